@@ -1,10 +1,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <windows.h>
-#include <conio.h>
 
-short is_running = 1;
+#include "pacman_game.h"
+#include "pacman_ghost_dirs.h"
+#include "pacman_level.h"
+#include "pacman_platform.h"
+#include "pacman_replay.h"
+#include "pacman_trace.h"
+
+#ifdef PACMAN_HEADLESS
+#include "pacman_autopilot.h"
+#include "pacman_batch.h"
+#include "pacman_netplay.h"
+#include "pacman_workers.h"
+#else
+#include "pacman_autopilot.h"
+#include "pacman_input.h"
+#include "pacman_render.h"
+#endif
 
 typedef enum {
 	KEY_UP = 'w',
@@ -12,880 +26,844 @@ typedef enum {
 	KEY_LEFT = 'a',
 	KEY_RIGHT = 'd',
 	KEY_QUIT = 'q'
-} key_t;
+} input_key_t;
 
-typedef enum {
-	DIR_UP,
-	DIR_DOWN,
-	DIR_LEFT,
-	DIR_RIGHT,
-	DIR_NONE,
-	NUM_DIRS
-} dir_t;
+static game_ctx_t game;
+static level_pack_t level_pack;
 
-typedef enum {
-	GHOST_BLINKY,
-	GHOST_PINKY,
-	GHOST_INKY,
-	GHOST_CLYDE,
-	NUM_GHOSTS
-} ghost_type_t;
+static dir_t key_to_dir(char key) {
+	switch (key)
+	{
+	case KEY_UP:
+		return DIR_UP;
+	case KEY_DOWN:
+		return DIR_DOWN;
+	case KEY_LEFT:
+		return DIR_LEFT;
+	case KEY_RIGHT:
+		return DIR_RIGHT;
+	default:
+		return DIR_NONE;
+	}
+}
 
-typedef enum {
-	STATE_NONE,
-	STATE_CHASE,
-	STATE_SCATTER,
-	STATE_FRIGHTENED,
-	NUM_STATES
-} ghost_state_t;
+static const char* ghost_targeting_names[] = { "greedy", "table", "field" };
 
+static int parse_ghost_targeting(const char* name, ghost_targeting_t* targeting) {
+	for (int i = 0; i < (int)(sizeof(ghost_targeting_names) / sizeof(ghost_targeting_names[0])); i++) {
+		if (strcmp(name, ghost_targeting_names[i]) == 0) {
+			*targeting = (ghost_targeting_t)i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+#ifdef PACMAN_HEADLESS
 typedef enum {
-	TILE_EMPTY,
-	TILE_GHOST_BLINKY,
-	TILE_GHOST_PINKY,
-	TILE_GHOST_INKY,
-	TILE_GHOST_CLYDE,
-	TILE_PACMAN,
-	TILE_WALL,
-	TILE_POINT,
-	TILE_ENERGIZER,
-	TILE_HEART
-} tile_type_t;
-
-typedef struct {
-	int tick;
-} event_t;
-
-typedef struct {
-	short x;
-	short y;
-} vector_2d_t;
-
-typedef struct {
-	tile_type_t type;
-	tile_type_t default_type;
-	short is_active;
-} tile_t;
-
-typedef struct {
-	vector_2d_t dir;
-	vector_2d_t pos;
-} entity_state_t;
-
-typedef struct {
-	entity_state_t entity_state;
-	ghost_type_t type;
-	ghost_state_t state;
-
-	vector_2d_t target;
-
-	int release_threshold;
-
-	event_t last_frightened;
-	event_t last_eaten;
-
-	event_t last_chase;
-	event_t last_scatter;
-
-	short state_cycles_completed;
-} ghost_t;
-
-typedef struct {
-	entity_state_t entity_state;
-} pacman_t;
+	POLICY_SCRIPT,
+	POLICY_RANDOM,
+	POLICY_AUTOPILOT
+} input_policy_t;
 
 static struct {
-	struct {
-		int current_tick;
-		event_t next_tick;
-	} time;
-
-	struct {
-		int score;
-		short num_lives;
-		short level;
-		float level_multiplier;
-
-		ghost_t ghosts[NUM_GHOSTS];
-		pacman_t pacman;
-
-		tile_t** tiles;
-		tile_t** heart_tiles;
-		vector_2d_t* heart_tiles_pos;
-		vector_2d_t* pending_tile_updates;
-		int num_pending_tile_updates;
-
-		short remaining_point_tiles;
-
-		int xorshift;
-	} state;
-
-	struct {
-		short window_width;
-		short window_height;
-
-		short ticks_per_second;
-		short skip_ticks;
-
-		short pacman_max_lives;
-		short total_point_tiles;
-
-		vector_2d_t pacman_start_pos;
-		vector_2d_t ghost_start_pos[NUM_GHOSTS];
-		vector_2d_t ghost_scatter_target_pos[NUM_GHOSTS];
-
-		vector_2d_t dirs[NUM_DIRS];
-	} def_vals;
-} game;
-
-static int xorshift32(void) {
-	int x = game.state.xorshift;
+	long long num_ticks;
+	int seed;
+	input_policy_t policy;
+	const char* script;
+	int hold_ticks;
+	int sample_interval;
+	int num_envs;
+	int num_threads;
+	int autopilot_budget_us;
+	ghost_targeting_t ghost_targeting;
+	int num_ghosts;
+	int num_ghost_threads;
+	int ghost_dirs_kernel;
+	const char* record_path;
+	const char* replay_path;
+	const char* level_pack_path;
+	int netplay_delay;
+	int netplay_loss_percent;
+
+	int policy_xorshift;
+	double clock_overhead_ns;
+} headless = {
+	.num_ticks = 1000000,
+	.seed = 0x12345678,
+	.policy = POLICY_SCRIPT,
+	.script = "aawwddssddwwaass",
+	.hold_ticks = 8,
+	.sample_interval = 16,
+	.num_envs = 0,
+	.autopilot_budget_us = 1000,
+	.num_ghost_threads = 1,
+	.ghost_dirs_kernel = -1,
+	.ghost_targeting = GHOST_TARGETING_GREEDY,
+	.netplay_delay = -1
+};
+
+static int policy_xorshift32(void) {
+	int x = headless.policy_xorshift;
 	x ^= x << 13;
 	x ^= x >> 17;
 	x ^= x << 5;
-	return game.state.xorshift = x;
-}
-
-static vector_2d_t vector_2d_add(vector_2d_t a, vector_2d_t b) {
-	return (vector_2d_t) { .x = a.x + b.x, .y = a.y + b.y };
-}
-
-static vector_2d_t vector_2d_sub(vector_2d_t a, vector_2d_t b) {
-	return (vector_2d_t) { .x = a.x - b.x, .y = a.y - b.y };
-}
-
-static short vector_2d_eq(vector_2d_t a, vector_2d_t b) {
-	return a.x == b.x && a.y == b.y;
+	return headless.policy_xorshift = x;
 }
 
-static int vector_2d_euclidean_distance(vector_2d_t a, vector_2d_t b) {
-	return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
-}
-
-static vector_2d_t vector_2d_mul_scalar(vector_2d_t a, short scalar) {
-	return (vector_2d_t) { .x = a.x * scalar, .y = a.y * scalar };
-}
-
-static vector_2d_t reverse_dir(vector_2d_t dir) {
-	return vector_2d_mul_scalar(dir, -1);
-}
-
-static vector_2d_t clamp_vector_2d(vector_2d_t a, int min_val_x, int max_val_x, int min_val_y, int max_val_y) {
-	return (vector_2d_t) { .x = a.x < min_val_x ? max_val_x : a.x > max_val_x ? min_val_x : a.x, .y = a.y < min_val_y ? max_val_y : a.y > max_val_y ? min_val_y : a.y };
-}
-
-static vector_2d_t gen_random_target() {
-	return (vector_2d_t) {
-		.x = xorshift32() % game.def_vals.window_width, .y = xorshift32() % game.def_vals.window_height
-	};
-}
-
-void cleanup() {
-	for (int i = 0; i < game.def_vals.window_height; i++) free(game.state.tiles[i]);
-	free(game.state.tiles);
-	free(game.state.heart_tiles);
-	free(game.state.heart_tiles_pos);
-	free(game.state.pending_tile_updates);
-}
-
-static float calculate_level_multiplier(short level) {
-	return 1 + level * 0.1;
-}
-
-static void clear_screen() {
-	system("cls");
-}
-
-static void init_def_vals() {
-	game.def_vals.window_width = 28;
-	game.def_vals.window_height = 36;
-	game.def_vals.ticks_per_second = 60;
-	game.def_vals.skip_ticks = 16;
-	game.def_vals.pacman_max_lives = 3;
-
-	game.def_vals.pacman_start_pos = (vector_2d_t){ .x = 13, .y = game.def_vals.window_height - 10 };
-
-	game.def_vals.ghost_start_pos[GHOST_BLINKY] = (vector_2d_t){ .x = 13, .y = 16 };
-	game.def_vals.ghost_start_pos[GHOST_PINKY] = (vector_2d_t){ .x = 13, .y = 17 };
-	game.def_vals.ghost_start_pos[GHOST_INKY] = (vector_2d_t){ .x = 11, .y = 17 };
-	game.def_vals.ghost_start_pos[GHOST_CLYDE] = (vector_2d_t){ .x = 15, .y = 17 };
-
-	game.def_vals.ghost_scatter_target_pos[GHOST_BLINKY] = (vector_2d_t){ .x = game.def_vals.window_width - 3, .y = 0 };
-	game.def_vals.ghost_scatter_target_pos[GHOST_PINKY] = (vector_2d_t){ .x = 2, .y = 0 };
-	game.def_vals.ghost_scatter_target_pos[GHOST_INKY] = (vector_2d_t){ .x = game.def_vals.window_width - 1, .y = game.def_vals.window_height - 2 };
-	game.def_vals.ghost_scatter_target_pos[GHOST_CLYDE] = (vector_2d_t){ .x = 0, .y = game.def_vals.window_height - 2 };
-
-	game.def_vals.dirs[DIR_NONE] = (vector_2d_t){ .x = 0, .y = 0 };
-	game.def_vals.dirs[DIR_UP] = (vector_2d_t){ .x = 0, .y = -1 };
-	game.def_vals.dirs[DIR_DOWN] = (vector_2d_t){ .x = 0, .y = 1 };
-	game.def_vals.dirs[DIR_LEFT] = (vector_2d_t){ .x = -1, .y = 0 };
-	game.def_vals.dirs[DIR_RIGHT] = (vector_2d_t){ .x = 1, .y = 0 };
-}
+static dir_t get_scripted_dir(long long tick_idx) {
+	if (tick_idx % headless.hold_ticks != 0) return DIR_NONE;
 
-static void init_ghosts() {
-	game.state.ghosts[GHOST_BLINKY] = (ghost_t){
-		.entity_state = (entity_state_t) {.pos = (vector_2d_t){.x = 13, .y = 14 }, .dir = game.def_vals.dirs[DIR_LEFT] },
-		.type = GHOST_BLINKY,
-		.state = STATE_NONE,
-		.target = game.def_vals.ghost_scatter_target_pos[GHOST_BLINKY],
-		.release_threshold = game.state.score,
-		.last_frightened.tick = -1,
-		.last_eaten.tick = -1,
-		.last_chase.tick = -1,
-		.last_scatter.tick = -1,
-		.state_cycles_completed = 0
-	};
-	game.state.ghosts[GHOST_PINKY] = (ghost_t){
-		.entity_state = (entity_state_t) {.pos = game.def_vals.ghost_start_pos[GHOST_PINKY], .dir = game.def_vals.dirs[DIR_NONE] },
-		.type = GHOST_PINKY,
-		.state = STATE_NONE,
-		.target = game.def_vals.ghost_scatter_target_pos[GHOST_PINKY],
-		.release_threshold = game.state.score,
-		.last_frightened.tick = -1,
-		.last_eaten.tick = -1,
-		.last_chase.tick = -1,
-		.last_scatter.tick = -1,
-		.state_cycles_completed = 0
-	};
-	game.state.ghosts[GHOST_INKY] = (ghost_t){
-		.entity_state = (entity_state_t) {.pos = game.def_vals.ghost_start_pos[GHOST_INKY], .dir = game.def_vals.dirs[DIR_NONE] },
-		.type = GHOST_INKY,
-		.state = STATE_NONE,
-		.target = game.def_vals.ghost_scatter_target_pos[GHOST_INKY],
-		.release_threshold = 30 / game.state.level_multiplier + game.state.score,
-		.last_frightened.tick = -1,
-		.last_eaten.tick = -1,
-		.last_chase.tick = -1,
-		.last_scatter.tick = -1,
-		.state_cycles_completed = 0
-	};
-	game.state.ghosts[GHOST_CLYDE] = (ghost_t){
-		.entity_state = (entity_state_t) {.pos = game.def_vals.ghost_start_pos[GHOST_CLYDE], .dir = game.def_vals.dirs[DIR_NONE] },
-		.type = GHOST_CLYDE,
-		.state = STATE_NONE,
-		.target = game.def_vals.ghost_scatter_target_pos[GHOST_CLYDE],
-		.release_threshold = 60 / game.state.level_multiplier + game.state.score,
-		.last_frightened.tick = -1,
-		.last_eaten.tick = -1,
-		.last_chase.tick = -1,
-		.last_scatter.tick = -1,
-		.state_cycles_completed = 0
-	};
-}
+	if (headless.policy == POLICY_RANDOM) return (unsigned int)policy_xorshift32() % DIR_NONE;
 
-static void init_pacman() {
-	game.state.pacman = (pacman_t){
-		.entity_state = (entity_state_t) {.pos = game.def_vals.pacman_start_pos, .dir = game.def_vals.dirs[DIR_NONE] }
-	};
+	long long step = tick_idx / headless.hold_ticks;
+	return key_to_dir(headless.script[step % strlen(headless.script)]);
 }
 
-static void set_tile(char c, tile_t* tile, short x, short y) {
-	tile->type = TILE_EMPTY;
-	tile->default_type = TILE_EMPTY;
-	tile->is_active = 1;
-
-	switch (c)
-	{
-	case '#':
-		tile->type = TILE_WALL;
-		tile->default_type = TILE_WALL;
-		break;
-	case '.':
-		tile->type = TILE_POINT;
-		tile->default_type = TILE_POINT;
-		game.def_vals.total_point_tiles++;
-		break;
-	case '@':
-		tile->type = TILE_ENERGIZER;
-		tile->default_type = TILE_ENERGIZER;
-		break;
-	case 'o':
-		if (game.state.num_lives >= game.def_vals.pacman_max_lives) break;
-		tile->type = TILE_HEART;
-		tile->default_type = TILE_HEART;
-
-		game.state.heart_tiles[game.state.num_lives] = tile;
-		game.state.heart_tiles_pos[game.state.num_lives] = (vector_2d_t){.x = x, .y = y};
-		game.state.num_lives++;
-		break;
-	default:
-		break;
-	}
+/* Phases are only timed on sampled ticks so the clock reads don't dominate ns/tick. */
+static void calibrate_clock_overhead() {
+	const int num_reads = 100000;
+	long long start_ns = get_time_ns();
+	for (int i = 0; i < num_reads; i++) get_time_ns();
+	headless.clock_overhead_ns = (double)(get_time_ns() - start_ns) / num_reads;
 }
 
-static void init_tiles() {
-	const char* tilemap =
-		"                            "
-		"                            "
-		"                            "
-		"############################"
-		"#............##............#"
-		"#.####.#####.##.#####.####.#"
-		"#@#  #.#   #.##.#   #.#  #@#"
-		"#.####.#####.##.#####.####.#"
-		"#..........................#"
-		"#.####.##.########.##.####.#"
-		"#.####.##.########.##.####.#"
-		"#......##....##....##......#"
-		"######.##### ## #####.######"
-		"     #.##### ## #####.#     "
-		"     #.##          ##.#     "
-		"     #.## ###  ### ##.#     "
-		"######.## #      # ##.######"
-		"      .   #      #   .      "
-		"######.## #      # ##.######"
-		"     #.## ######## ##.#     "
-		"     #.##          ##.#     "
-		"     #.## ######## ##.#     "
-		"######.## ######## ##.######"
-		"#............##............#"
-		"#.####.#####.##.#####.####.#"
-		"#.####.#####.##.#####.####.#"
-		"#@..##.......  .......##..@#"
-		"###.##.##.########.##.##.###"
-		"###.##.##.########.##.##.###"
-		"#......##....##....##......#"
-		"#.##########.##.##########.#"
-		"#.##########.##.##########.#"
-		"#..........................#"
-		"############################"
-		" ooo                        "
-		"                            ";
-
-	game.state.tiles = (tile_t**)malloc(game.def_vals.window_height * sizeof(tile_t*));
-	game.state.heart_tiles = (tile_t**)malloc(game.def_vals.pacman_max_lives * sizeof(tile_t*));
-	game.state.heart_tiles_pos = (vector_2d_t*)malloc(game.def_vals.pacman_max_lives * sizeof(vector_2d_t));
-	for (int i = 0; i < game.def_vals.window_height; i++) game.state.tiles[i] = (tile_t*)malloc(game.def_vals.window_width * sizeof(tile_t));
-	game.state.pending_tile_updates = (vector_2d_t*)malloc((game.def_vals.window_width * game.def_vals.window_height) * sizeof(vector_2d_t));
-	game.state.num_pending_tile_updates = 0;
+static void print_ghost_paths_report(const ghost_paths_t* paths) {
+	printf("ghost_targeting: %s\n", ghost_targeting_names[paths->mode]);
+	if (paths->mode == GHOST_TARGETING_GREEDY) return;
 
-	if (game.state.tiles == NULL || game.state.pending_tile_updates == NULL) {
-		cleanup();
-		exit(-1);
+	printf("path_nodes: %d\n", paths->graph->num_nodes);
+	printf("path_build_us: %.1f\n", paths->graph->build_ns / 1e3);
+	if (paths->mode == GHOST_TARGETING_PATH_TABLE) {
+		const long long num_pairs = (long long)paths->graph->num_nodes * paths->graph->num_nodes;
+		printf("path_table_bytes: %lld\n", (num_pairs + 3) / 4 + (num_pairs + 7) / 8);
 	}
-
-	game.def_vals.total_point_tiles = 0;
-	for (int i = 0; i < game.def_vals.window_height; i++) {
-		for (int j = 0; j < game.def_vals.window_width; j++) {	
-			int tile_idx = i * game.def_vals.window_width + j;
-			set_tile(tilemap[tile_idx], &game.state.tiles[i][j], j, i);
-		}
+	else {
+		printf("distance_field_lookups: %lld\n", paths->num_field_lookups);
+		printf("distance_field_builds: %lld\n", paths->num_field_builds);
 	}
 }
 
-static void reset_tiles() {
-	game.state.num_pending_tile_updates = 0;
-
-	for (int i = 0; i < game.def_vals.window_height; i++) {
-		for (int j = 0; j < game.def_vals.window_width; j++) {
-			tile_t* tile = &game.state.tiles[i][j];
-			tile->type = tile->default_type;
-			tile->is_active = 1;
+static void print_autopilot_report(const autopilot_t* autopilot) {
+	if (autopilot->num_decisions == 0) return;
+
+	const double search_s = autopilot->search_ns / 1e9;
+	printf("autopilot_threads: %d\n", autopilot->num_threads);
+	printf("autopilot_budget_us: %lld\n", autopilot->budget_ns / 1000);
+	printf("decisions: %lld\n", autopilot->num_decisions);
+	printf("decision_us: %.1f\n", autopilot->search_ns / 1e3 / autopilot->num_decisions);
+	printf("rollouts_per_decision: %.1f\n", (double)autopilot->num_rollouts / autopilot->num_decisions);
+	printf("rollouts_per_s: %.0f\n", autopilot->num_rollouts / search_s);
+	printf("rollout_ticks_per_s: %.0f\n", autopilot->num_rollout_ticks / search_s);
+	printf("search_depth_avg: %.2f\n", (double)autopilot->depth_sum / autopilot->num_decisions);
+	printf("search_depth_max: %d\n", autopilot->max_depth);
+}
+
+static double get_phase_ns_per_tick(game_phase_t phase) {
+	if (game.profile.num_samples == 0) return 0;
+	double ns = (double)game.profile.ns[phase] / game.profile.num_samples - headless.clock_overhead_ns;
+	return ns > 0 ? ns : 0;
+}
+
+static void print_usage(const char* program) {
+	fprintf(stderr,
+		"usage: %s [-n ticks] [-s seed] [-p script|random|autopilot] [-i input] [-h hold_ticks] [-S sample_interval] [-b envs] [-t threads] [-B budget_us] [-g greedy|table|field] [-G ghosts] [-T ghost_threads] [-K scalar|sse2|avx2] [-w replay] [-R replay] [-N delay] [-L loss_percent] [-l level_pack]\n"
+		"  -i  direction script made of w/a/s/d characters, each held for hold_ticks and repeated\n"
+		"  -g  ghost targeting: greedy euclidean pick, shortest-path table or cached distance fields\n"
+		"  -G  number of ghosts, cycling through the four personalities; thousands make a stress test\n"
+		"  -T  threads updating the ghosts of a single game; the result is the same for any number\n"
+		"  -K  kernel picking ghost directions instead of the best one the CPU supports; all agree\n"
+		"  -b  step this many games per tick through the batch API instead of a single game\n"
+		"  -t  threads stepping the batch (default 1) or searching for the autopilot (default all cores)\n"
+		"  -B  autopilot search time per decision; a decision is made every AUTOPILOT_HOLD_TICKS ticks\n"
+		"  -w  record the inputs of the first game to a replay file\n"
+		"  -R  replay a recorded game at full speed and check its final score and state hash\n"
+		"  -N  play two rollback netplay peers over a loopback link delaying packets by this many ticks\n"
+		"  -L  percentage of netplay packets the loopback link drops\n"
+		"  -l  play the levels of a pack built by pacman-levelc instead of the built-in maze\n",
+		program);
+}
+
+static int parse_headless_args(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 >= argc || argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0') return -1;
+
+		const char* val = argv[++i];
+		switch (argv[i - 1][1])
+		{
+		case 'n':
+			headless.num_ticks = strtoll(val, NULL, 0);
+			break;
+		case 's':
+			headless.seed = (int)strtoul(val, NULL, 0);
+			break;
+		case 'p':
+			if (strcmp(val, "script") == 0) headless.policy = POLICY_SCRIPT;
+			else if (strcmp(val, "random") == 0) headless.policy = POLICY_RANDOM;
+			else if (strcmp(val, "autopilot") == 0) headless.policy = POLICY_AUTOPILOT;
+			else return -1;
+			break;
+		case 'i':
+			headless.script = val;
+			break;
+		case 'h':
+			headless.hold_ticks = atoi(val);
+			break;
+		case 'S':
+			headless.sample_interval = atoi(val);
+			break;
+		case 'b':
+			headless.num_envs = atoi(val);
+			break;
+		case 't':
+			headless.num_threads = atoi(val);
+			break;
+		case 'B':
+			headless.autopilot_budget_us = atoi(val);
+			break;
+		case 'g':
+			if (parse_ghost_targeting(val, &headless.ghost_targeting) != 0) return -1;
+			break;
+		case 'G':
+			headless.num_ghosts = atoi(val);
+			break;
+		case 'T':
+			headless.num_ghost_threads = atoi(val);
+			break;
+		case 'K':
+			for (int k = 0; k < NUM_GHOST_DIRS_KERNELS; k++) {
+				if (strcmp(val, ghost_dirs_kernel_names[k]) == 0) headless.ghost_dirs_kernel = k;
+			}
+			if (headless.ghost_dirs_kernel < 0) return -1;
+			break;
+		case 'w':
+			headless.record_path = val;
+			break;
+		case 'R':
+			headless.replay_path = val;
+			break;
+		case 'l':
+			headless.level_pack_path = val;
+			break;
+		case 'N':
+			headless.netplay_delay = atoi(val);
+			break;
+		case 'L':
+			headless.netplay_loss_percent = atoi(val);
+			break;
+		default:
+			return -1;
 		}
 	}
-}
-
-static void init_level(short level) {
-	game.state.level = level;
-	game.state.level_multiplier = calculate_level_multiplier(game.state.level);
 
-	if (level == 0) {
-		init_def_vals();
+	if (headless.num_ticks <= 0 || headless.seed == 0 || headless.hold_ticks <= 0 || headless.sample_interval <= 0 || strlen(headless.script) == 0) return -1;
+	if (headless.num_envs < 0 || headless.num_threads < 0 || headless.autopilot_budget_us <= 0 || headless.num_ghosts < 0 || headless.num_ghosts > MAX_GHOSTS || headless.num_ghost_threads < 1) return -1;
+	if (headless.record_path != NULL && headless.num_envs > 0) return -1;
+	if (headless.policy == POLICY_AUTOPILOT && (headless.num_envs > 0 || headless.netplay_delay >= 0)) return -1;
 
-		game.time.current_tick = 0;
-		game.time.next_tick.tick = 0;
-		game.state.score = 0;
-		game.state.num_lives = 0;
-		game.state.xorshift = 0x12345678;
+	if (headless.num_threads == 0) headless.num_threads = headless.policy == POLICY_AUTOPILOT ? get_num_cores() : 1;
+	if (headless.netplay_delay >= LOOPBACK_LINK_CAPACITY || headless.netplay_loss_percent < 0 || headless.netplay_loss_percent >= 100) return -1;
+	return 0;
+}
 
-		init_tiles();
+static void save_recorded_game(replay_recorder_t* recorder) {
+	if (save_replay(recorder, &game, headless.record_path) != 0) {
+		fprintf(stderr, "Error writing replay %s\n", headless.record_path);
 	}
-	else {
-		reset_tiles();
+	free_replay_recorder(recorder);
+}
+
+/*
+ * Runs a single game as fast as possible: no input thread, no rendering and
+ * no sleeping. When a game ends a new one is started with the RNG carried
+ * over, so the run always covers num_ticks ticks. With the autopilot the run
+ * is bound by its search budget instead, which makes a long one a soak test.
+ */
+static int run_headless_single() {
+	calibrate_clock_overhead();
+
+	game.def_vals.ghost_targeting = headless.ghost_targeting;
+	game.def_vals.num_ghosts = headless.num_ghosts;
+	game.def_vals.level_set = level_pack.level_set;
+
+	worker_pool_t ghost_pool;
+	if (headless.num_ghost_threads > 1) {
+		if (init_worker_pool(&ghost_pool, headless.num_ghost_threads) != 0) {
+			fprintf(stderr, "Error starting %d ghost threads\n", headless.num_ghost_threads);
+			return 1;
+		}
+		game.def_vals.run_parallel = run_worker_pool;
+		game.def_vals.parallel_pool = &ghost_pool;
 	}
 
-	game.state.remaining_point_tiles = game.def_vals.total_point_tiles;
-
-	init_ghosts();
-	init_pacman();
-}
+	init_level(&game, 0);
+	game.state.xorshift = headless.seed;
+	headless.policy_xorshift = headless.seed;
 
-static char get_tile_repr(tile_t* tile) {
-	switch (tile->type)
-	{
-	case TILE_EMPTY:
-		return ' ';
-		break;
-	case TILE_GHOST_BLINKY:
-		return 'B';
-		break;
-	case TILE_GHOST_PINKY:
-		return 'P';
-		break;
-	case TILE_GHOST_INKY:
-		return 'I';
-		break;
-	case TILE_GHOST_CLYDE:
-		return 'C';
-		break;
-	case TILE_PACMAN:
-		return 'O';
-		break;
-	case TILE_WALL:
-		return '#';
-		break;
-	case TILE_POINT:
-		if (tile->is_active) return '.';
-		else return ' ';
-		break;
-	case TILE_ENERGIZER:
-		if (tile->is_active) return '@';
-		else return ' ';
-		break;
-	case TILE_HEART:
-		if (tile->is_active) return 'o';
-		else return ' ';
-		break;
-	default:
-		return ' ';
-		break;
+	autopilot_t autopilot;
+	short is_autopilot = headless.policy == POLICY_AUTOPILOT;
+	if (is_autopilot && init_autopilot(&autopilot, &game, headless.num_threads, headless.autopilot_budget_us * 1000LL) != 0) {
+		fprintf(stderr, "Error starting the autopilot on %d threads\n", headless.num_threads);
+		cleanup(&game);
+		exit(-1);
 	}
-}
 
-static void render_tiles() {
-	for (int i = 0; i < game.def_vals.window_height; i++) {
-		for (int j = 0; j < game.def_vals.window_width; j++) {
-			printf("%c", get_tile_repr(&game.state.tiles[i][j]));
-		}
-		printf("\n");
+	replay_recorder_t recorder;
+	short is_recording = headless.record_path != NULL;
+	if (is_recording && begin_replay_recording(&recorder, &game) != 0) {
+		cleanup(&game);
+		exit(-1);
 	}
-}
 
-static void frighten_ghosts() {
-	for (ghost_type_t type = GHOST_BLINKY; type < NUM_GHOSTS; type++) {
-		if(game.state.ghosts[type].state == STATE_NONE) continue;
-		if (game.state.ghosts[type].state == STATE_SCATTER || game.state.ghosts[type].state == STATE_CHASE)
-			game.state.ghosts[type].entity_state.dir = reverse_dir(game.state.ghosts[type].entity_state.dir);
+	long long num_games = 1;
+	long long total_score = 0;
 
-		game.state.ghosts[type].state = STATE_FRIGHTENED;
-		game.state.ghosts[type].last_frightened.tick = game.time.current_tick;
-	}
-}
+	const long long start_ns = get_time_ns();
 
-static void eat_ghost(ghost_type_t type) {
-	game.state.ghosts[type].state = STATE_NONE;
-	game.state.ghosts[type].entity_state.dir = game.def_vals.dirs[DIR_NONE];
-	game.state.ghosts[type].entity_state.pos = game.def_vals.ghost_start_pos[type];
-	game.state.ghosts[type].last_eaten.tick = game.time.current_tick;
-	game.state.score += 10;
-}
+	for (long long i = 0; i < headless.num_ticks; i++) {
+		dir_t dir = DIR_NONE;
+		if (!is_autopilot) dir = get_scripted_dir(i);
+		else if (i % AUTOPILOT_HOLD_TICKS == 0) dir = choose_autopilot_dir(&autopilot, &game);
 
-static short check_pacman_collisions(vector_2d_t new_pos) {
-	switch (game.state.tiles[new_pos.y][new_pos.x].type)
-	{
-	case TILE_WALL:
-		return 2;
-		break;
-	case TILE_POINT:
-		if (game.state.tiles[new_pos.y][new_pos.x].is_active) {
-			game.state.tiles[new_pos.y][new_pos.x].is_active = 0;
-			return 1;
-		}
-		break;
-	case TILE_ENERGIZER:
-		if (game.state.tiles[new_pos.y][new_pos.x].is_active) {
-			game.state.tiles[new_pos.y][new_pos.x].is_active = 0;
-			frighten_ghosts();
-			return 1;
-		}
-		break;
-	case TILE_GHOST_BLINKY:
-		if (game.state.ghosts[GHOST_BLINKY].state == STATE_FRIGHTENED) {
-			eat_ghost(GHOST_BLINKY);
-			return 1;
-		}
-		else return -1;
-		break;
-	case TILE_GHOST_PINKY:
-		if (game.state.ghosts[GHOST_PINKY].state == STATE_FRIGHTENED) {
-			eat_ghost(GHOST_PINKY);
-			return 1;
-		}
-		else return -1;
-		break;
-	case TILE_GHOST_INKY:
-		if (game.state.ghosts[GHOST_INKY].state == STATE_FRIGHTENED) {
-			eat_ghost(GHOST_INKY);
-			return 1;
-		}
-		else return -1;
-		break;
-	case TILE_GHOST_CLYDE:
-		if (game.state.ghosts[GHOST_CLYDE].state == STATE_FRIGHTENED) {
-			eat_ghost(GHOST_CLYDE);
-			return 1;
+		if (dir != DIR_NONE) {
+			game.state.pacman.entity_state.dir = game.def_vals.dirs[dir];
+			if (is_recording && record_replay_dir(&recorder, &game, dir) != 0) {
+				cleanup(&game);
+				exit(-1);
+			}
 		}
-		else return -1;
-		break;
-	default:
-		break;
-	}
 
-	return 0;
-}
+		game.profile.is_sampling = i % headless.sample_interval == 0;
+		game.profile.num_samples += game.profile.is_sampling;
 
-static void update_pacman_pos(vector_2d_t new_pos) {
-	int p_x = game.state.pacman.entity_state.pos.x, p_y = game.state.pacman.entity_state.pos.y;
+		step_game_tick(&game);
 
-	game.state.tiles[p_y][p_x].type = game.state.tiles[p_y][p_x].default_type;
-	game.state.pending_tile_updates[game.state.num_pending_tile_updates++] = (vector_2d_t){ .x = p_x, .y = p_y };
-
-	game.state.pacman.entity_state.pos = new_pos;
-	p_x = game.state.pacman.entity_state.pos.x, p_y = game.state.pacman.entity_state.pos.y;
-
-	game.state.tiles[p_y][p_x].type = TILE_PACMAN;
-	game.state.pending_tile_updates[game.state.num_pending_tile_updates++] = (vector_2d_t){ .x = p_x, .y = p_y };
-}
+		game.state.num_pending_tile_updates = 0;
+		game.state.is_redraw_pending = 0;
 
-static void pacman_lose_life() {
-	if (game.state.num_lives == 0) {
-		is_running = 0;
-		return;
+		if (!game.is_running) {
+			if (is_recording) {
+				save_recorded_game(&recorder);
+				is_recording = 0;
+			}
+			total_score += game.state.score;
+			num_games++;
+			restart_game(&game);
+		}
 	}
 
-	game.state.num_lives--;
-	game.state.heart_tiles[game.state.num_lives]->is_active = 0;
-	vector_2d_t tile_pos = game.state.heart_tiles_pos[game.state.num_lives];
-	game.state.pending_tile_updates[game.state.num_pending_tile_updates++] = (vector_2d_t){ .x = tile_pos.x, .y = tile_pos.y };
-
-	if (game.state.num_lives == 0) {
-		is_running = 0;
-		return;
+	const long long elapsed_ns = get_time_ns() - start_ns;
+	total_score += game.state.score;
+	if (is_recording) save_recorded_game(&recorder);
+
+	printf("ticks: %lld\n", headless.num_ticks);
+	printf("games: %lld\n", num_games);
+	printf("total_score: %lld\n", total_score);
+	printf("final_level: %d\n", game.state.level);
+	printf("ghosts: %d\n", game.state.ghosts.count);
+	printf("ghost_threads: %d\n", headless.num_ghost_threads);
+	printf("ghost_dirs_kernel: %s\n", ghost_dirs_kernel_names[get_active_ghost_dirs_kernel()]);
+	print_ghost_paths_report(&game.def_vals.paths);
+	printf("elapsed_s: %.6f\n", elapsed_ns / 1e9);
+	printf("ticks_per_s: %.0f\n", headless.num_ticks / (elapsed_ns / 1e9));
+	printf("ns_per_tick: %.2f\n", (double)elapsed_ns / headless.num_ticks);
+	printf("update_ghosts_ns_per_tick: %.2f\n", get_phase_ns_per_tick(PHASE_UPDATE_GHOSTS));
+	printf("update_ghosts_ns_per_ghost: %.2f\n", get_phase_ns_per_tick(PHASE_UPDATE_GHOSTS) / game.state.ghosts.count);
+	printf("update_pacman_ns_per_tick: %.2f\n", get_phase_ns_per_tick(PHASE_UPDATE_PACMAN));
+	printf("state_hash: %016llx\n", (unsigned long long)get_state_hash(&game));
+	if (is_autopilot) {
+		print_autopilot_report(&autopilot);
+		free_autopilot(&autopilot);
 	}
 
-	update_pacman_pos(game.def_vals.pacman_start_pos);
+	if (headless.num_ghost_threads > 1) shutdown_worker_pool(&ghost_pool);
+	cleanup(&game);
+	return 0;
 }
 
-static void update_pacman() {
-	int p_x = game.state.pacman.entity_state.pos.x, p_y = game.state.pacman.entity_state.pos.y;
-	vector_2d_t new_pos = vector_2d_add(game.state.pacman.entity_state.pos, game.state.pacman.entity_state.dir);
-	new_pos = clamp_vector_2d(new_pos, 0, game.def_vals.window_width - 1, 0, game.def_vals.window_height - 1);
+/*
+ * Steps num_envs games per batch_step() until num_ticks env-steps have been
+ * taken. Observations of all games land in one contiguous buffer.
+ */
+static int run_headless_batch() {
+	const int num_envs = headless.num_envs;
 
-	short collision_result = check_pacman_collisions(new_pos);
+	game_ctx_t* ctxs = (game_ctx_t*)calloc(num_envs, sizeof(game_ctx_t));
+	game_ctx_t** ctx_ptrs = (game_ctx_t**)malloc(num_envs * sizeof(game_ctx_t*));
+	uint8_t* actions = (uint8_t*)malloc(num_envs);
+	uint8_t* observations = NULL;
 
-	if (collision_result == 2) {
-		return;
+	if (ctxs == NULL || ctx_ptrs == NULL || actions == NULL || batch_init(headless.num_threads) != 0) {
+		fprintf(stderr, "Error initializing batch of %d games\n", num_envs);
+		return 1;
 	}
-	else if (collision_result == 1) {
-		game.state.score++;
-		game.state.remaining_point_tiles--;
 
-		if (game.state.remaining_point_tiles == 0) {
-			init_level(game.state.level + 1);
-			clear_screen();
-			render_tiles();
-			return;
+	headless.policy_xorshift = headless.seed;
+	for (int i = 0; i < num_envs; i++) {
+		ctx_ptrs[i] = &ctxs[i];
+		ctxs[i].def_vals.ghost_targeting = headless.ghost_targeting;
+		ctxs[i].def_vals.num_ghosts = headless.num_ghosts;
+		ctxs[i].def_vals.level_set = level_pack.level_set;
+		if (i == 0) {
+			init_level(&ctxs[0], 0);
+			observations = (uint8_t*)malloc((size_t)num_envs * get_observation_size(&ctxs[0]));
+			cleanup(&ctxs[0]);
+			if (observations == NULL) return 1;
 		}
+		init_batch_game(&ctxs[i], policy_xorshift32(), observations + (size_t)i * get_observation_size(&ctxs[0]));
 	}
-	else if (collision_result == -1) {
-		pacman_lose_life();
-		return;
+
+	long long num_steps = (headless.num_ticks + num_envs - 1) / num_envs;
+	const long long start_ns = get_time_ns();
+
+	for (long long i = 0; i < num_steps; i++) {
+		for (int j = 0; j < num_envs; j++) actions[j] = get_scripted_dir(i);
+		batch_step(ctx_ptrs, actions, num_envs);
 	}
-	
-	update_pacman_pos(new_pos);
+
+	const long long elapsed_ns = get_time_ns() - start_ns;
+	const double env_steps_per_s = num_steps * num_envs / (elapsed_ns / 1e9);
+
+	long long num_episodes = 0;
+	for (int i = 0; i < num_envs; i++) num_episodes += ctxs[i].env.num_episodes;
+
+	printf("envs: %d\n", num_envs);
+	printf("threads: %d\n", headless.num_threads);
+	printf("env_steps: %lld\n", num_steps * num_envs);
+	printf("episodes: %lld\n", num_episodes);
+	printf("elapsed_s: %.6f\n", elapsed_ns / 1e9);
+	printf("env_steps_per_s: %.0f\n", env_steps_per_s);
+	printf("env_steps_per_s_per_core: %.0f\n", env_steps_per_s / headless.num_threads);
+	printf("ns_per_env_step: %.2f\n", (double)elapsed_ns / (num_steps * num_envs));
+
+	batch_shutdown();
+	for (int i = 0; i < num_envs; i++) cleanup(&ctxs[i]);
+	free(observations);
+	free(actions);
+	free(ctx_ptrs);
+	free(ctxs);
+	return 0;
 }
 
-static void navigate_ghost_state_cycle(ghost_t* ghost, short scatter_duration_s, short chase_duration_s) {
-	if (scatter_duration_s > 0) {
-		if (ghost->state == STATE_SCATTER && game.time.current_tick - ghost->last_scatter.tick >= scatter_duration_s * game.def_vals.ticks_per_second) {
-			ghost->state = STATE_CHASE;
-			ghost->last_chase.tick = game.time.current_tick;
-		}
+/*
+ * Re-simulates a recorded game with no clock and no input thread and checks
+ * that it ends on the recorded score and state hash. Returns 1 on a mismatch.
+ */
+static int run_headless_replay() {
+	replay_reader_t reader;
+	if (load_replay(&reader, headless.replay_path) != 0) {
+		fprintf(stderr, "Error reading replay %s\n", headless.replay_path);
+		return 1;
 	}
-	if (chase_duration_s > 0) {
-		if (ghost->state == STATE_CHASE && game.time.current_tick - ghost->last_chase.tick >= chase_duration_s * game.def_vals.ticks_per_second) {
-			ghost->state = STATE_SCATTER;
-			ghost->last_scatter.tick = game.time.current_tick;
-			ghost->state_cycles_completed++;
-		}
+
+	game.def_vals.level_set = level_pack.level_set;
+	if (init_replay_game(&reader, &game) != 0) {
+		fprintf(stderr, "Error replaying %s: it was recorded on other levels, pass the same -l\n", headless.replay_path);
+		free_replay_reader(&reader);
+		cleanup(&game);
+		return 1;
 	}
-}
 
-static void update_ghost_state(ghost_t* ghost) {
-	if (ghost->release_threshold > game.state.score) return; 
+	long long num_ticks = 0;
+	const long long start_ns = get_time_ns();
 
-	ghost_state_t old_state = ghost->state;
+	while (step_replay(&reader, &game)) {
+		game.state.num_pending_tile_updates = 0;
+		game.state.is_redraw_pending = 0;
+		num_ticks++;
+	}
 
-	if (ghost->state == STATE_NONE) {
-		if (ghost->last_eaten.tick == -1 || game.time.current_tick - ghost->last_eaten.tick > 6 * game.def_vals.ticks_per_second) {
-			ghost->state = STATE_SCATTER;
-			ghost->last_scatter.tick = game.time.current_tick;
-		}
-		return;
+	const long long elapsed_ns = get_time_ns() - start_ns;
+	const uint64_t hash = get_state_hash(&game);
+	const int final_tick = game.time.next_tick.tick / game.def_vals.skip_ticks;
+	const short is_match = final_tick == reader.final_tick && game.state.score == reader.final_score && hash == reader.final_hash;
+
+	printf("ghost_targeting: %s\n", ghost_targeting_names[reader.ghost_targeting]);
+	printf("ticks: %lld\n", num_ticks);
+	printf("final_tick: %d (recorded %d)\n", final_tick, reader.final_tick);
+	printf("score: %d (recorded %d)\n", game.state.score, reader.final_score);
+	printf("state_hash: %016llx (recorded %016llx)\n", (unsigned long long)hash, (unsigned long long)reader.final_hash);
+	printf("elapsed_s: %.6f\n", elapsed_ns / 1e9);
+	printf("ticks_per_s: %.0f\n", num_ticks / (elapsed_ns / 1e9));
+	printf("replay: %s\n", is_match ? "match" : "MISMATCH");
+
+	free_replay_reader(&reader);
+	cleanup(&game);
+	return is_match ? 0 : 1;
+}
+
+static game_ctx_t peer_game;
+
+static void print_netplay_report(const char* name, const netplay_session_t* session, const loopback_link_t* tx) {
+	printf("%s_ticks: %d\n", name, session->tick);
+	printf("%s_stall_frames: %lld\n", name, session->num_stalls);
+	printf("%s_packets_sent: %lld\n", name, tx->num_sent);
+	printf("%s_packets_lost: %lld\n", name, tx->num_lost);
+	printf("%s_rollbacks: %lld\n", name, session->num_rollbacks);
+	printf("%s_resimulated_ticks: %lld\n", name, session->num_resimulated_ticks);
+	printf("%s_max_rollback_ticks: %d\n", name, session->max_rollback_ticks);
+	printf("%s_save_ns: %.1f\n", name, session->num_saves > 0 ? (double)session->save_ns / session->num_saves : 0);
+	printf("%s_restore_ns: %.1f\n", name, session->num_restores > 0 ? (double)session->restore_ns / session->num_restores : 0);
+	printf("%s_rollback_us: %.2f\n", name, session->num_rollbacks > 0 ? session->rollback_ns / 1e3 / session->num_rollbacks : 0);
+	printf("%s_max_rollback_us: %.2f\n", name, session->max_rollback_ns / 1e3);
+}
+
+/*
+ * Two peers in one process, each with its own game, connected by a pair of
+ * loopback links. One loop iteration is one frame for both; a peer that is
+ * done keeps polling until it has the other's inputs for every tick it ran,
+ * after which both games must be in the same state.
+ */
+static int run_headless_netplay() {
+	game_ctx_t* ctxs[NUM_NETPLAY_PLAYERS] = { &game, &peer_game };
+	loopback_link_t links[NUM_NETPLAY_PLAYERS];
+	netplay_session_t sessions[NUM_NETPLAY_PLAYERS];
+
+	headless.policy_xorshift = headless.seed;
+	for (int i = 0; i < NUM_NETPLAY_PLAYERS; i++) {
+		ctxs[i]->def_vals.ghost_targeting = headless.ghost_targeting;
+		ctxs[i]->def_vals.num_ghosts = headless.num_ghosts;
+		ctxs[i]->def_vals.level_set = level_pack.level_set;
+		init_level(ctxs[i], 0);
+		ctxs[i]->state.xorshift = headless.seed;
+		init_loopback_link(&links[i], headless.netplay_delay, headless.netplay_loss_percent, policy_xorshift32());
 	}
+	for (int i = 0; i < NUM_NETPLAY_PLAYERS; i++) init_netplay_session(&sessions[i], i, &links[i], &links[1 - i]);
+
+	const int max_frames = (int)(headless.num_ticks < 1000000 ? headless.num_ticks : 1000000) * 4 + 1000;
+	const long long start_ns = get_time_ns();
+	int frame = 0;
+	short is_done = 0;
+
+	for (; frame < max_frames && !is_done; frame++) {
+		is_done = 1;
+		for (int i = 0; i < NUM_NETPLAY_PLAYERS; i++) {
+			/* After game over the ticks change nothing, but the peers still have to end on the same one. */
+			short is_advancing = sessions[i].tick < headless.num_ticks && (ctxs[i]->is_running || sessions[i].tick < sessions[1 - i].tick);
+			if (is_advancing) {
+				advance_netplay(&sessions[i], ctxs[i], get_scripted_dir(sessions[i].tick), frame);
+				is_done = 0;
+			}
+			else {
+				poll_netplay(&sessions[i], ctxs[i], frame);
+				is_done &= is_netplay_confirmed(&sessions[i]);
+			}
 
-	if (ghost->state == STATE_FRIGHTENED) {
-		if (game.time.current_tick - ghost->last_frightened.tick > 6 * game.def_vals.ticks_per_second) {
-			ghost->last_scatter.tick += game.time.current_tick - ghost->last_frightened.tick;
-			ghost->last_chase.tick += game.time.current_tick - ghost->last_frightened.tick;
+			ctxs[i]->state.num_pending_tile_updates = 0;
+			ctxs[i]->state.is_redraw_pending = 0;
 		}
-		else return;
 	}
 
-	switch (ghost->state_cycles_completed)
-	{
-	case 0:
-	case 1:
-		navigate_ghost_state_cycle(ghost, 7 / game.state.level_multiplier, 20);
-		break;
-	case 2:
-		navigate_ghost_state_cycle(ghost, 5 / game.state.level_multiplier, 20);
-		break;
-	case 3:
-		navigate_ghost_state_cycle(ghost, 5 / game.state.level_multiplier, -1);
-		break;
-	default:
-		break;
+	const long long elapsed_ns = get_time_ns() - start_ns;
+	const short is_synced = is_done && get_state_hash(&game) == get_state_hash(&peer_game);
+
+	printf("delay_ticks: %d\n", headless.netplay_delay);
+	printf("loss_percent: %d\n", headless.netplay_loss_percent);
+	printf("frames: %d\n", frame);
+	printf("snapshot_bytes: %d\n", (int)(sizeof(game_snapshot_t) + game.state.ghosts.arena_size));
+	for (int i = 0; i < NUM_NETPLAY_PLAYERS; i++) print_netplay_report(i == 0 ? "peer0" : "peer1", &sessions[i], &links[i]);
+	printf("score: %d / %d\n", game.state.score, peer_game.state.score);
+	printf("elapsed_s: %.6f\n", elapsed_ns / 1e9);
+	printf("netplay: %s\n", is_synced ? "in sync" : "DESYNC");
+
+	for (int i = 0; i < NUM_NETPLAY_PLAYERS; i++) {
+		free_netplay_session(&sessions[i]);
+		cleanup(ctxs[i]);
 	}
-
-	if (old_state != ghost->state && (old_state == STATE_SCATTER || old_state == STATE_CHASE))
-		ghost->entity_state.dir = reverse_dir(ghost->entity_state.dir);
+	return is_synced ? 0 : 1;
 }
 
-static void update_ghost_target(ghost_t* ghost) {
-	entity_state_t pacman_state = game.state.pacman.entity_state;
-
-	vector_2d_t curr_pos = ghost->entity_state.pos;
-
-	if (curr_pos.x >= 13 && curr_pos.x <= 14 && curr_pos.y >= 16 && curr_pos.y <= 18) {
-		ghost->target = (vector_2d_t){.x = 13, .y=15};
-		return;
+int main(int argc, char** argv)
+{
+	if (parse_headless_args(argc, argv) != 0) {
+		print_usage(argv[0]);
+		return 1;
 	}
-
-	switch (ghost->state)
-	{
-	case STATE_SCATTER:
-		ghost->target = game.def_vals.ghost_scatter_target_pos[ghost->type];
-		break;
-	case STATE_CHASE:
-		switch (ghost->type) {
-		case GHOST_BLINKY:
-			ghost->target = pacman_state.pos;
-			break;
-		case GHOST_PINKY:
-			ghost->target = vector_2d_add(pacman_state.pos, vector_2d_mul_scalar(pacman_state.dir, 4));
-			break;
-		case GHOST_INKY:
-		{
-			vector_2d_t blinky_pos = game.state.ghosts[GHOST_BLINKY].entity_state.pos;
-			vector_2d_t p = vector_2d_add(pacman_state.pos, vector_2d_mul_scalar(pacman_state.dir, 2));
-			vector_2d_t d = vector_2d_sub(p, blinky_pos);
-			ghost->target = vector_2d_add(blinky_pos, vector_2d_mul_scalar(d, 4));
-		}
-		break;
-		case GHOST_CLYDE:
-			if (vector_2d_euclidean_distance(ghost->entity_state.pos, pacman_state.pos) > 64)
-				ghost->target = pacman_state.pos;
-			else
-				ghost->target = game.def_vals.ghost_scatter_target_pos[GHOST_CLYDE];
-		default:
-			break;
-		}
-	case STATE_FRIGHTENED:
-		ghost->target = gen_random_target();
-		break;
-	default:
-		break;
+	if (headless.level_pack_path != NULL && open_level_pack(&level_pack, headless.level_pack_path) != 0) {
+		fprintf(stderr, "Error reading level pack %s\n", headless.level_pack_path);
+		return 1;
 	}
-}
-
-static short check_ghost_collisions(ghost_t* ghost, vector_2d_t new_pos) {
-	switch (game.state.tiles[new_pos.y][new_pos.x].type) {
-	case TILE_WALL:
-		return 2;
-		break;
-	case TILE_PACMAN:
-		if (ghost->state == STATE_FRIGHTENED) {
-			eat_ghost(ghost->type);
-			return -1;
-		}
-		else {
-			pacman_lose_life();
-			return 1;
-		}
-	default:
-		break;
+	if (headless.ghost_dirs_kernel >= 0 && set_ghost_dirs_kernel(headless.ghost_dirs_kernel) != 0) {
+		fprintf(stderr, "The %s kernel is not supported here\n", ghost_dirs_kernel_names[headless.ghost_dirs_kernel]);
+		close_level_pack(&level_pack);
+		return 1;
 	}
-	return 0;
-}
 
-static short is_redzone(vector_2d_t pos) {
-	return pos.x >= 10 && pos.x <= 17 && (pos.y == 14 || pos.y == 26);
+	int result;
+	if (headless.replay_path != NULL) result = run_headless_replay();
+	else if (headless.netplay_delay >= 0) result = run_headless_netplay();
+	else result = headless.num_envs > 0 ? run_headless_batch() : run_headless_single();
+
+	close_level_pack(&level_pack);
+	TRACE_WRITE();
+	return result;
 }
+#else
+#define BG_COLOR 0x41454d
 
-static void update_ghost_pos(ghost_t* ghost) {
-	if (ghost->state == STATE_NONE) return;
+/* Same palette as the JS version. */
+static const uint32_t tile_colors[] = {
+	[TILE_EMPTY] = BG_COLOR,
+	[TILE_GHOST_BLINKY] = 0xe81515,
+	[TILE_GHOST_PINKY] = 0xe815a2,
+	[TILE_GHOST_INKY] = 0x15bed1,
+	[TILE_GHOST_CLYDE] = 0xd67f15,
+	[TILE_PACMAN] = 0xf0d807,
+	[TILE_WALL] = 0x290fd4,
+	[TILE_POINT] = 0xffffff,
+	[TILE_ENERGIZER] = 0x0fd478,
+	[TILE_HEART] = 0xb30c28
+};
 
-	update_ghost_target(ghost);
+static term_renderer_t renderer;
+static short use_color = 0;
 
-	vector_2d_t new_pos = vector_2d_add(ghost->entity_state.pos, vector_2d_mul_scalar(ghost->entity_state.dir, game.state.level_multiplier));
-	new_pos = clamp_vector_2d(new_pos, 0, game.def_vals.window_width - 1, 0, game.def_vals.window_height - 1);
+static input_queue_t input_queue;
+static latency_histogram_t input_queue_latency;
+static latency_histogram_t input_to_screen_latency;
+static long long unflushed_input_read_ns = -1;
 
-	short collision_result = check_ghost_collisions(ghost, new_pos);
+static const char* record_path = NULL;
+static replay_recorder_t recorder;
 
-	if (collision_result == -1 || collision_result == 2) return;
+static int autopilot_budget_ms = 0;
+static autopilot_t autopilot;
+static int num_autopilot_ticks = 0;
 
-	ghost->entity_state.pos = new_pos;
+static void render_tile(vector_2d_t pos) {
+	set_term_cell(&renderer, pos, get_tile_repr(&game, pos), tile_colors[get_tile_type(&game, pos)]);
+}
 
-	int min_dist = 100000;
-	int dist = 0;
-	vector_2d_t original_dir_reverse = reverse_dir(ghost->entity_state.dir);
+static void render_tiles() {
+	clear_term_screen(&renderer);
+	for (short i = 0; i < game.def_vals.window_height; i++) {
+		for (short j = 0; j < game.def_vals.window_width; j++) render_tile((vector_2d_t){ .x = j, .y = i });
+	}
+}
 
-	for (int i = 0; i < NUM_DIRS; i++) {
-		if (i == DIR_NONE) continue;
-		vector_2d_t dir = game.def_vals.dirs[i];
-		if (vector_2d_eq(original_dir_reverse, dir)) continue;
-		if (is_redzone(ghost->entity_state.pos) && (i == DIR_UP)) continue;
+/* Duplicate pending updates are harmless: the renderer only sends cells that differ from the screen. */
+static void on_frame_render() {
+	if (game.state.is_redraw_pending) {
+		game.state.is_redraw_pending = 0;
+		game.state.num_pending_tile_updates = 0;
+		TRACE_SPAN("render_tiles", render_tiles());
+	}
 
-		vector_2d_t test_pos = vector_2d_add(ghost->entity_state.pos, vector_2d_mul_scalar(dir, game.state.level_multiplier));
-		test_pos = clamp_vector_2d(test_pos, 0, game.def_vals.window_width - 1, 0, game.def_vals.window_height - 1);
+	short is_pacman_drawn = 0;
+	for (int i = 0; i < game.state.num_pending_tile_updates; i++) {
+		vector_2d_t pos = game.state.pending_tile_updates[i];
+		render_tile(pos);
+		is_pacman_drawn |= pos.x == game.state.pacman.entity_state.pos.x && pos.y == game.state.pacman.entity_state.pos.y;
+	}
+	game.state.num_pending_tile_updates = 0;
 
-		short test_collision_result = check_ghost_collisions(ghost, test_pos);
+	flush_term_frame(&renderer);
 
-		if (test_collision_result != -1 && test_collision_result != 2) {
-			if ((dist = vector_2d_euclidean_distance(test_pos, ghost->target)) < min_dist) {
-				min_dist = dist;
-				ghost->entity_state.dir = dir;
-			}
-		}
+	/* The first frame that redraws pacman after a direction change is the one that shows it. */
+	if (is_pacman_drawn && unflushed_input_read_ns >= 0) {
+		record_latency(&input_to_screen_latency, get_time_ns() - unflushed_input_read_ns);
+		unflushed_input_read_ns = -1;
 	}
 }
 
-static void update_ghost_repr(ghost_t* ghost, vector_2d_t old_pos) {
-	short pos_x = ghost->entity_state.pos.x, pos_y = ghost->entity_state.pos.y;
+/*
+ * Runs at tick boundaries, so input never changes state in the middle of a
+ * tick. At most one direction change is applied per tick and the rest stay
+ * queued, so two quick keypresses between ticks both take effect.
+ */
+static void apply_input_events() {
+	input_event_t event;
+	while (pop_input_event(&input_queue, &event)) {
+		event.applied_ns = get_time_ns();
+		record_latency(&input_queue_latency, event.applied_ns - event.read_ns);
+
+		if (event.key == KEY_QUIT) {
+			game.is_running = 0;
+			return;
+		}
 
-	game.state.tiles[old_pos.y][old_pos.x].type = game.state.tiles[old_pos.y][old_pos.x].default_type;
-	game.state.pending_tile_updates[game.state.num_pending_tile_updates++] = (vector_2d_t){ .x = old_pos.x, .y = old_pos.y };
+		dir_t dir_idx = key_to_dir((char)event.key);
+		vector_2d_t dir = game.def_vals.dirs[dir_idx];
+		vector_2d_t* pacman_dir = &game.state.pacman.entity_state.dir;
+		if (dir.x == pacman_dir->x && dir.y == pacman_dir->y) continue;
 
-	switch (ghost->type)
-	{
-	case GHOST_BLINKY:
-		game.state.tiles[pos_y][pos_x].type = TILE_GHOST_BLINKY;
-		break;
-	case GHOST_PINKY:
-		game.state.tiles[pos_y][pos_x].type = TILE_GHOST_PINKY;
-		break;
-	case GHOST_INKY:
-		game.state.tiles[pos_y][pos_x].type = TILE_GHOST_INKY;
-		break;
-	case GHOST_CLYDE:
-		game.state.tiles[pos_y][pos_x].type = TILE_GHOST_CLYDE;
-		break;
-	default:
-		break;
+		*pacman_dir = dir;
+		if (record_path != NULL && record_replay_dir(&recorder, &game, dir_idx) != 0) game.is_running = 0;
+		if (unflushed_input_read_ns < 0) unflushed_input_read_ns = event.read_ns;
+		return;
 	}
-
-	game.state.pending_tile_updates[game.state.num_pending_tile_updates++] = (vector_2d_t){ .x = ghost->entity_state.pos.x, .y = ghost->entity_state.pos.y };
 }
 
-static void update_ghost(ghost_type_t type) {
-	ghost_t* ghost = &game.state.ghosts[type];
-	vector_2d_t old_pos = ghost->entity_state.pos;
+/* Searches on the game thread, so the budget has to fit in a tick with room to render. */
+static void apply_autopilot_dir() {
+	if (num_autopilot_ticks++ % AUTOPILOT_HOLD_TICKS != 0) return;
 
-	update_ghost_state(ghost);
-	update_ghost_pos(ghost);
-	update_ghost_repr(ghost, old_pos);
-}
+	dir_t dir_idx;
+	TRACE_SPAN("choose_autopilot_dir", dir_idx = choose_autopilot_dir(&autopilot, &game));
+	if (dir_idx == DIR_NONE) return;
 
-static void update_ghosts() {
-	update_ghost(GHOST_BLINKY);
-	update_ghost(GHOST_PINKY);
-	update_ghost(GHOST_INKY);
-	update_ghost(GHOST_CLYDE);
-}
+	vector_2d_t dir = game.def_vals.dirs[dir_idx];
+	vector_2d_t* pacman_dir = &game.state.pacman.entity_state.dir;
+	if (dir.x == pacman_dir->x && dir.y == pacman_dir->y) return;
 
-static void on_game_tick() {
-	update_ghosts();
-	update_pacman();
+	*pacman_dir = dir;
+	if (record_path != NULL && record_replay_dir(&recorder, &game, dir_idx) != 0) game.is_running = 0;
 }
 
-static void on_frame_render() {
-	printf("\033[0;0H");
-	for (int i = 0; i < game.state.num_pending_tile_updates; i++) {
-		short pos_x = game.state.pending_tile_updates[i].x, pos_y = game.state.pending_tile_updates[i].y;
-		printf("\033[%d;%dH%c", pos_y + 1, pos_x + 1, get_tile_repr(&game.state.tiles[pos_y][pos_x]));
-	}
-	game.state.num_pending_tile_updates = 0;
+static void print_latency(const char* name, const latency_histogram_t* histogram) {
+	if (histogram->num_samples == 0) return;
+	printf("%s (us): p50 <%lld, p90 <%lld, p99 <%lld, max %lld, n=%lld\n", name,
+		get_latency_percentile_us(histogram, 0.5), get_latency_percentile_us(histogram, 0.9), get_latency_percentile_us(histogram, 0.99),
+		histogram->max_ns / 1000, histogram->num_samples);
 }
 
-static DWORD WINAPI input_thread_main(LPVOID lpParam) {
-	char ch;
-	while (is_running) {
-		ch = _getch();
+/* Only stamps and queues keys; the game loop applies them between ticks. */
+static void input_thread_main(void* param) {
+	game_ctx_t* ctx = (game_ctx_t*)param;
+	int ch;
+	while (ctx->is_running) {
+		ch = read_key();
 		switch (ch)
 		{
 		case KEY_QUIT:
-			is_running = 0;
-			break;
 		case KEY_UP:
-			game.state.pacman.entity_state.dir = game.def_vals.dirs[DIR_UP];
-			break;
 		case KEY_DOWN:
-			game.state.pacman.entity_state.dir = game.def_vals.dirs[DIR_DOWN];
-			break;
 		case KEY_LEFT:
-			game.state.pacman.entity_state.dir = game.def_vals.dirs[DIR_LEFT];
-			break;
 		case KEY_RIGHT:
-			game.state.pacman.entity_state.dir = game.def_vals.dirs[DIR_RIGHT];
+			push_input_event(&input_queue, (input_event_t){ .key = ch, .read_ns = get_time_ns() });
 			break;
 		default:
 			break;
 		}
 	}
-	return 0;
 }
 
+/*
+ * current_tick follows the wall clock at ticks_per_second, and a game tick is
+ * due every skip_ticks of it. Each game tick sees current_tick set to the tick
+ * it was scheduled for, so the simulation does not depend on render cost.
+ * At most max_catchup_ticks overdue ticks are run per frame; anything beyond
+ * that is dropped instead of snowballing into ever longer frames.
+ */
 static void run() {
-	HANDLE thread;
-	DWORD thread_id;
+	thread_t thread;
+	int err;
 
-	thread = CreateThread(NULL, 0, input_thread_main, NULL, 0, &thread_id);
+	init_terminal();
 
-	if (thread == NULL) {
-		printf("Error creating input thread: %d\n", GetLastError());
-		cleanup();
+	if (init_term_renderer(&renderer, game.def_vals.level_set.max_width, game.def_vals.level_set.max_height, use_color, BG_COLOR) != 0) {
+		restore_terminal();
+		cleanup(&game);
 		exit(-1);
 	}
 
-	int sleep_time = 0;
+	if ((err = start_thread(&thread, input_thread_main, &game)) != 0) {
+		printf("Error creating input thread: %d\n", err);
+		restore_terminal();
+		cleanup(&game);
+		exit(-1);
+	}
+
+	const long long ns_per_tick = 1000000000LL / game.def_vals.ticks_per_second;
+	const long long start_ns = get_time_ns();
+	int now_tick = 0;
+
+	game.state.is_redraw_pending = 1;
+	TRACE_SPAN("on_frame_render", on_frame_render());
+
+	while (game.is_running) {
+		now_tick = (int)((get_time_ns() - start_ns) / ns_per_tick);
 
-	clear_screen();
-	render_tiles();
+		short num_catchup_ticks = 0;
+		while (now_tick >= game.time.next_tick.tick && num_catchup_ticks < game.def_vals.max_catchup_ticks && game.is_running) {
+			if (num_catchup_ticks > 0) {
+				game.time.late_ticks++;
+				TRACE_INSTANT("late_tick", "tick", game.time.next_tick.tick);
+			}
+
+			apply_input_events();
+			if (autopilot_budget_ms > 0 && game.is_running) apply_autopilot_dir();
+			if (!game.is_running) break;
 
-	while (is_running) {
-		game.time.current_tick++;
-		while (game.time.current_tick > game.time.next_tick.tick) {
-			on_game_tick();
-			game.time.next_tick.tick += game.def_vals.skip_ticks;
+			step_game_tick(&game);
+			num_catchup_ticks++;
 		}
-		on_frame_render();
-		sleep_time = game.time.next_tick.tick - game.time.current_tick;
-		if (sleep_time >= 0) {
-			Sleep(sleep_time);
+
+		if (now_tick >= game.time.next_tick.tick) {
+			int num_dropped_ticks = (now_tick - game.time.next_tick.tick) / game.def_vals.skip_ticks + 1;
+			if (record_path != NULL && record_replay_drop(&recorder, &game, num_dropped_ticks) != 0) game.is_running = 0;
+			game.time.dropped_ticks += num_dropped_ticks;
+			TRACE_INSTANT("dropped_ticks", "ticks", num_dropped_ticks);
+			game.time.next_tick.tick += num_dropped_ticks * game.def_vals.skip_ticks;
 		}
+
+		TRACE_SPAN_ARG("on_frame_render", "tick", game.time.next_tick.tick, on_frame_render());
+		sleep_until_ns(start_ns + game.time.next_tick.tick * ns_per_tick);
 	}
 
-	WaitForSingleObject(thread, INFINITE);
-	CloseHandle(thread);
+	join_thread(thread);
+	restore_terminal();
 
-	clear_screen();
-	cleanup();
+	close_term_renderer(&renderer);
+	if (record_path != NULL) {
+		if (save_replay(&recorder, &game, record_path) != 0) printf("Error writing replay %s\n", record_path);
+		free_replay_recorder(&recorder);
+	}
+	cleanup(&game);
 	printf("FINAL SCORE: %d\n", game.state.score);
+	printf("LATE TICKS: %d, DROPPED TICKS: %d\n", game.time.late_ticks, game.time.dropped_ticks);
+	printf("BYTES/FRAME: %.1f, SYSCALLS/FRAME: %.3f\n", (double)renderer.num_bytes / renderer.num_frames, (double)renderer.num_syscalls / renderer.num_frames);
+	print_latency("INPUT QUEUE LATENCY", &input_queue_latency);
+	print_latency("INPUT TO SCREEN LATENCY", &input_to_screen_latency);
+	if (atomic_load(&input_queue.num_dropped) > 0) printf("DROPPED INPUTS: %u\n", atomic_load(&input_queue.num_dropped));
+	if (autopilot.num_decisions > 0) {
+		printf("AUTOPILOT: %d threads, %lld decisions, %.1f rollouts/decision, %.0f rollouts/s, search depth avg %.2f max %d\n",
+			autopilot.num_threads, autopilot.num_decisions, (double)autopilot.num_rollouts / autopilot.num_decisions,
+			autopilot.num_rollouts / (autopilot.search_ns / 1e9), (double)autopilot.depth_sum / autopilot.num_decisions, autopilot.max_depth);
+	}
+	if (autopilot_budget_ms > 0) free_autopilot(&autopilot);
+	free_term_renderer(&renderer);
+	close_level_pack(&level_pack);
+	TRACE_WRITE();
 }
 
-int main(void)
+int main(int argc, char** argv)
 {
-	init_level(0);
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-c") == 0) {
+			use_color = 1;
+		}
+		else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc && parse_ghost_targeting(argv[i + 1], &game.def_vals.ghost_targeting) == 0) {
+			i++;
+		}
+		else if (strcmp(argv[i], "-G") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) <= MAX_GHOSTS) {
+			game.def_vals.num_ghosts = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+			autopilot_budget_ms = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			record_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc && open_level_pack(&level_pack, argv[i + 1]) == 0) {
+			game.def_vals.level_set = level_pack.level_set;
+			i++;
+		}
+		else {
+			fprintf(stderr, "usage: %s [-c] [-g greedy|table|field] [-G ghosts] [-a budget_ms] [-r replay] [-l level_pack]\n  -c  24-bit color\n  -G  number of ghosts\n  -a  let the search autopilot play, thinking this long per move on all cores\n  -r  record the game to a replay file\n  -l  play the levels of a pack built by pacman-levelc\n", argv[0]);
+			return 1;
+		}
+	}
+
+	init_level(&game, 0);
+	if (record_path != NULL && begin_replay_recording(&recorder, &game) != 0) {
+		cleanup(&game);
+		exit(-1);
+	}
+	if (autopilot_budget_ms > 0 && init_autopilot(&autopilot, &game, get_num_cores(), autopilot_budget_ms * 1000000LL) != 0) {
+		cleanup(&game);
+		exit(-1);
+	}
 	run();
 }
+#endif
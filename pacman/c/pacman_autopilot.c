@@ -0,0 +1,295 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pacman_autopilot.h"
+#include "pacman_platform.h"
+#include "pacman_trace.h"
+
+#define AUTOPILOT_MAX_MOVES (AUTOPILOT_HORIZON_TICKS / AUTOPILOT_HOLD_TICKS)
+
+static const dir_t reverse_dirs[DIR_NONE] = { [DIR_UP] = DIR_DOWN, [DIR_DOWN] = DIR_UP, [DIR_LEFT] = DIR_RIGHT, [DIR_RIGHT] = DIR_LEFT };
+
+static int worker_xorshift32(autopilot_worker_t* worker) {
+	uint32_t x = (uint32_t)worker->xorshift;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return worker->xorshift = (int)x;
+}
+
+/* The directions pacman can move in from where it stands, wrapping at the edges like the game does. */
+static uint8_t get_legal_moves(game_ctx_t* game) {
+	const level_t* level = game->def_vals.level;
+	vector_2d_t pos = game->state.pacman.entity_state.pos;
+	uint8_t moves = 0;
+
+	for (dir_t d = 0; d < DIR_NONE; d++) {
+		vector_2d_t next = { .x = pos.x + game->def_vals.dirs[d].x, .y = pos.y + game->def_vals.dirs[d].y };
+		if (next.x < 0) next.x = level->width - 1;
+		else if (next.x >= level->width) next.x = 0;
+		if (next.y < 0) next.y = level->height - 1;
+		else if (next.y >= level->height) next.y = 0;
+
+		if (!((level->walls[next.y] >> next.x) & 1)) moves |= 1u << d;
+	}
+	return moves;
+}
+
+/*
+ * Breadth-first distance to the nearest point left, run on bitboards a row at
+ * a time and wrapping at the edges like get_legal_moves; a rollout that ends
+ * far from any point has nothing to show for it.
+ */
+static int get_point_distance(game_ctx_t* game) {
+	const level_t* level = game->def_vals.level;
+	const vector_2d_t pos = game->state.pacman.entity_state.pos;
+	const short width = level->width;
+	const short height = level->height;
+	const uint32_t row_mask = width >= 32 ? 0xffffffffu : (1u << width) - 1;
+	bitboard_t reached = { 0 };
+	reached[pos.y] = 1u << pos.x;
+
+	for (int distance = 0; distance < AUTOPILOT_MAX_POINT_DISTANCE; distance++) {
+		uint32_t has_point = 0, has_grown = 0;
+		for (short y = 0; y < height; y++) has_point |= reached[y] & game->state.active_points[y];
+		if (has_point) return distance;
+
+		bitboard_t next;
+		for (short y = 0; y < height; y++) {
+			uint32_t row = reached[y] | reached[y] << 1 | reached[y] >> 1;
+			row |= (reached[y] >> (width - 1)) & 1u;
+			row |= (reached[y] & 1u) << (width - 1);
+			row |= reached[y > 0 ? y - 1 : height - 1];
+			row |= reached[y + 1 < height ? y + 1 : 0];
+			next[y] = row & row_mask & ~level->walls[y];
+			has_grown |= next[y] ^ reached[y];
+		}
+		if (!has_grown) break;
+		memcpy(reached, next, height * sizeof(uint32_t));
+	}
+	return AUTOPILOT_MAX_POINT_DISTANCE;
+}
+
+/* Returns the ticks the move took, fewer than AUTOPILOT_HOLD_TICKS if the game ended. */
+static int play_move(game_ctx_t* game, dir_t dir) {
+	game->state.pacman.entity_state.dir = game->def_vals.dirs[dir];
+
+	int ticks = 0;
+	while (ticks < AUTOPILOT_HOLD_TICKS && game->is_running) {
+		step_game_tick(game);
+		ticks++;
+	}
+
+	game->state.num_pending_tile_updates = 0;
+	game->state.is_redraw_pending = 0;
+	return ticks;
+}
+
+/* Random, but only turning back at dead ends. */
+static dir_t pick_random_move(autopilot_worker_t* worker, uint8_t moves, dir_t last_dir) {
+	if (last_dir != DIR_NONE && (moves & ~(1u << reverse_dirs[last_dir])) != 0) moves &= ~(1u << reverse_dirs[last_dir]);
+
+	int num_moves = (moves & 1) + ((moves >> 1) & 1) + ((moves >> 2) & 1) + ((moves >> 3) & 1);
+	int pick = (int)((unsigned int)worker_xorshift32(worker) % num_moves);
+
+	for (dir_t d = 0; d < DIR_NONE; d++) {
+		if ((moves >> d) & 1 && pick-- == 0) return d;
+	}
+	return DIR_NONE;
+}
+
+static int add_node(autopilot_worker_t* worker) {
+	if (worker->num_nodes >= AUTOPILOT_MAX_NODES) return -1;
+
+	autopilot_node_t* node = &worker->nodes[worker->num_nodes];
+	for (dir_t d = 0; d < DIR_NONE; d++) node->children[d] = -1;
+	node->visits = 0;
+	node->value = 0;
+	return worker->num_nodes++;
+}
+
+static dir_t select_uct_move(autopilot_worker_t* worker, int node, uint8_t moves) {
+	const autopilot_node_t* parent = &worker->nodes[node];
+	const double log_visits = log((double)parent->visits);
+
+	double best_score = -INFINITY;
+	dir_t best_dir = DIR_NONE;
+	for (dir_t d = 0; d < DIR_NONE; d++) {
+		if (!((moves >> d) & 1)) continue;
+
+		const autopilot_node_t* child = &worker->nodes[parent->children[d]];
+		double score = child->value / child->visits + AUTOPILOT_EXPLORATION * sqrt(log_visits / child->visits);
+		if (score > best_score) {
+			best_score = score;
+			best_dir = d;
+		}
+	}
+	return best_dir;
+}
+
+static void run_rollout(autopilot_t* autopilot, autopilot_worker_t* worker) {
+	game_ctx_t* game = &worker->game;
+	restore_game_snapshot(game, &autopilot->root);
+
+	const int start_score = game->state.score;
+	const short start_lives = game->state.num_lives;
+
+	int path[AUTOPILOT_MAX_MOVES + 1];
+	int path_len = 0;
+	int node = 0;
+	int ticks = 0;
+	dir_t last_dir = DIR_NONE;
+	path[path_len++] = node;
+
+	/* Down the tree while every move of a node has been tried, then add one new node. */
+	while (ticks < AUTOPILOT_HORIZON_TICKS && game->is_running) {
+		uint8_t moves = get_legal_moves(game);
+		if (moves == 0) break;
+
+		dir_t dir = DIR_NONE;
+		for (dir_t d = 0; d < DIR_NONE && dir == DIR_NONE; d++) {
+			if ((moves >> d) & 1 && worker->nodes[node].children[d] < 0) dir = d;
+		}
+
+		short is_new = dir != DIR_NONE;
+		if (is_new) {
+			int child = add_node(worker);
+			if (child < 0) break;
+			worker->nodes[node].children[dir] = child;
+		}
+		else dir = select_uct_move(worker, node, moves);
+
+		node = worker->nodes[node].children[dir];
+		path[path_len++] = node;
+		ticks += play_move(game, dir);
+		last_dir = dir;
+
+		if (is_new) break;
+	}
+
+	if (path_len - 1 > worker->max_depth) worker->max_depth = path_len - 1;
+
+	while (ticks < AUTOPILOT_HORIZON_TICKS && game->is_running) {
+		uint8_t moves = get_legal_moves(game);
+		if (moves == 0) break;
+
+		last_dir = pick_random_move(worker, moves, last_dir);
+		ticks += play_move(game, last_dir);
+	}
+
+	double value = game->state.score - start_score - AUTOPILOT_LIFE_PENALTY * (start_lives - game->state.num_lives);
+	if (!game->is_running) value -= AUTOPILOT_GAME_OVER_PENALTY;
+	else value -= AUTOPILOT_POINT_DISTANCE_PENALTY * get_point_distance(game);
+
+	for (int i = 0; i < path_len; i++) {
+		worker->nodes[path[i]].visits++;
+		worker->nodes[path[i]].value += value;
+	}
+
+	worker->num_rollouts++;
+	worker->num_rollout_ticks += ticks;
+}
+
+/* Every thread runs at least one rollout, however small the budget. */
+static void search(autopilot_t* autopilot, autopilot_worker_t* worker) {
+	worker->num_nodes = 0;
+	worker->num_rollouts = 0;
+	worker->num_rollout_ticks = 0;
+	worker->max_depth = 0;
+	add_node(worker);
+
+	do {
+		TRACE_MUTED(run_rollout(autopilot, worker));
+	} while (get_time_ns() < autopilot->deadline_ns);
+}
+
+static void run_search_jobs(void* arg, int begin, int end) {
+	autopilot_t* autopilot = (autopilot_t*)arg;
+	for (int i = begin; i < end; i++) search(autopilot, &autopilot->workers[i]);
+}
+
+int init_autopilot(autopilot_t* autopilot, game_ctx_t* ctx, int num_threads, long long budget_ns) {
+	memset(autopilot, 0, sizeof(autopilot_t));
+	if (num_threads < 1) return -1;
+
+	autopilot->num_threads = num_threads;
+	autopilot->budget_ns = budget_ns;
+	autopilot->workers = (autopilot_worker_t*)calloc(num_threads, sizeof(autopilot_worker_t));
+	if (autopilot->workers == NULL) return -1;
+
+	for (int i = 0; i < num_threads; i++) {
+		autopilot_worker_t* worker = &autopilot->workers[i];
+		worker->nodes = (autopilot_node_t*)malloc(AUTOPILOT_MAX_NODES * sizeof(autopilot_node_t));
+		if (worker->nodes == NULL) {
+			free_autopilot(autopilot);
+			return -1;
+		}
+		worker->xorshift = (int)(0x2545f491u * (uint32_t)(i + 1));
+
+		worker->game.def_vals.ghost_targeting = ctx->def_vals.ghost_targeting;
+		worker->game.def_vals.num_ghosts = ctx->state.ghosts.count;
+		worker->game.def_vals.level_set = ctx->def_vals.level_set;
+		init_level(&worker->game, 0);
+	}
+
+	if (init_worker_pool(&autopilot->pool, num_threads) != 0) {
+		free_autopilot(autopilot);
+		return -1;
+	}
+	return 0;
+}
+
+void free_autopilot(autopilot_t* autopilot) {
+	if (autopilot->pool.threads != NULL) shutdown_worker_pool(&autopilot->pool);
+
+	for (int i = 0; autopilot->workers != NULL && i < autopilot->num_threads; i++) {
+		free(autopilot->workers[i].nodes);
+		cleanup(&autopilot->workers[i].game);
+	}
+	free(autopilot->workers);
+	free_game_snapshot(&autopilot->root);
+	memset(autopilot, 0, sizeof(autopilot_t));
+}
+
+dir_t choose_autopilot_dir(autopilot_t* autopilot, game_ctx_t* ctx) {
+	const long long start_ns = get_time_ns();
+
+	save_game_snapshot(ctx, &autopilot->root);
+	autopilot->deadline_ns = start_ns + autopilot->budget_ns;
+	TRACE_SPAN("autopilot_search", run_worker_jobs(&autopilot->pool, run_search_jobs, autopilot, autopilot->num_threads, 1));
+
+	int visits[DIR_NONE] = { 0 };
+	double values[DIR_NONE] = { 0 };
+	int num_rollouts = 0;
+	int depth = 0;
+
+	for (int i = 0; i < autopilot->num_threads; i++) {
+		const autopilot_worker_t* worker = &autopilot->workers[i];
+		for (dir_t d = 0; d < DIR_NONE; d++) {
+			int child = worker->nodes[0].children[d];
+			if (child < 0) continue;
+			visits[d] += worker->nodes[child].visits;
+			values[d] += worker->nodes[child].value;
+		}
+
+		num_rollouts += worker->num_rollouts;
+		autopilot->num_rollout_ticks += worker->num_rollout_ticks;
+		if (worker->max_depth > depth) depth = worker->max_depth;
+	}
+
+	dir_t best_dir = DIR_NONE;
+	for (dir_t d = 0; d < DIR_NONE; d++) {
+		if (visits[d] == 0) continue;
+		if (best_dir == DIR_NONE || visits[d] > visits[best_dir] || (visits[d] == visits[best_dir] && values[d] / visits[d] > values[best_dir] / visits[best_dir])) best_dir = d;
+	}
+
+	autopilot->last_rollouts = num_rollouts;
+	autopilot->last_depth = depth;
+	autopilot->num_decisions++;
+	autopilot->num_rollouts += num_rollouts;
+	autopilot->depth_sum += depth;
+	if (depth > autopilot->max_depth) autopilot->max_depth = depth;
+	autopilot->search_ns += get_time_ns() - start_ns;
+	return best_dir;
+}
@@ -0,0 +1,78 @@
+#ifndef PACMAN_AUTOPILOT_H
+#define PACMAN_AUTOPILOT_H
+
+#include "pacman_game.h"
+#include "pacman_workers.h"
+
+/*
+ * Plays pacman by Monte Carlo tree search (POSIX only). Each decision saves
+ * the game to a snapshot, and every search thread restores it into a clone
+ * game of its own and runs rollouts on it until the time budget is spent:
+ * the real ghost rules, timers and pellets, stepped tick by tick. The game is
+ * deterministic, RNG included, so the tree has no chance nodes; a move holds
+ * a direction for AUTOPILOT_HOLD_TICKS ticks and a rollout looks
+ * AUTOPILOT_HORIZON_TICKS ahead, with random moves past the tree. Threads
+ * search trees of their own and the most visited first move over all of them
+ * is played.
+ *
+ * A rollout scores the points gained, minus AUTOPILOT_LIFE_PENALTY per life
+ * lost and AUTOPILOT_GAME_OVER_PENALTY if the game ends. Otherwise it also
+ * loses AUTOPILOT_POINT_DISTANCE_PENALTY per tile between pacman and the
+ * nearest point left, so that eating nothing within the horizon still beats
+ * walking away from the points.
+ */
+#define AUTOPILOT_HOLD_TICKS 4
+#define AUTOPILOT_HORIZON_TICKS 64
+#define AUTOPILOT_MAX_NODES 65536
+#define AUTOPILOT_LIFE_PENALTY 100
+#define AUTOPILOT_GAME_OVER_PENALTY 1000
+#define AUTOPILOT_POINT_DISTANCE_PENALTY 1.0
+#define AUTOPILOT_MAX_POINT_DISTANCE 64
+#define AUTOPILOT_EXPLORATION 10.0
+
+typedef struct {
+	int children[DIR_NONE];
+	int visits;
+	double value;
+} autopilot_node_t;
+
+typedef struct {
+	game_ctx_t game;
+	autopilot_node_t* nodes;
+	int num_nodes;
+	int xorshift;
+
+	int num_rollouts;
+	long long num_rollout_ticks;
+	int max_depth;
+} autopilot_worker_t;
+
+typedef struct {
+	int num_threads;
+	long long budget_ns;
+	worker_pool_t pool;
+	autopilot_worker_t* workers;
+
+	game_snapshot_t root;
+	long long deadline_ns;
+
+	/* The last decision, then totals over all of them; depth is in moves below the root. */
+	int last_rollouts;
+	int last_depth;
+
+	long long num_decisions;
+	long long num_rollouts;
+	long long num_rollout_ticks;
+	long long depth_sum;
+	int max_depth;
+	long long search_ns;
+} autopilot_t;
+
+/* Call after init_level(ctx, 0); ctx's settings are copied into the clones. Returns -1 if out of memory or threads. */
+int init_autopilot(autopilot_t* autopilot, game_ctx_t* ctx, int num_threads, long long budget_ns);
+void free_autopilot(autopilot_t* autopilot);
+
+/* Searches for budget_ns and returns the direction to set before the next tick. */
+dir_t choose_autopilot_dir(autopilot_t* autopilot, game_ctx_t* ctx);
+
+#endif
@@ -0,0 +1,57 @@
+#include "pacman_batch.h"
+#include "pacman_workers.h"
+
+#define BATCH_GRAIN 16
+
+static worker_pool_t pool;
+
+typedef struct {
+	game_ctx_t** ctxs;
+	const uint8_t* actions;
+} batch_job_t;
+
+static void step_batch_game(game_ctx_t* ctx, uint8_t action) {
+	if (action < DIR_NONE) ctx->state.pacman.entity_state.dir = ctx->def_vals.dirs[action];
+
+	step_game_tick(ctx);
+	ctx->state.num_pending_tile_updates = 0;
+	ctx->state.is_redraw_pending = 0;
+
+	ctx->env.is_done = !ctx->is_running;
+	if (ctx->env.is_done) {
+		ctx->env.num_episodes++;
+		restart_game(ctx);
+	}
+
+	write_observation(ctx, ctx->env.observation);
+}
+
+static void run_batch_job(void* arg, int begin, int end) {
+	batch_job_t* job = (batch_job_t*)arg;
+	for (int i = begin; i < end; i++) step_batch_game(job->ctxs[i], job->actions[i]);
+}
+
+/* The calling thread is one of the pool's threads, so num_threads - 1 are spawned. */
+int batch_init(int num_threads) {
+	return init_worker_pool(&pool, num_threads);
+}
+
+void batch_shutdown(void) {
+	shutdown_worker_pool(&pool);
+}
+
+void init_batch_game(game_ctx_t* ctx, int seed, uint8_t* observation) {
+	init_level(ctx, 0);
+	ctx->state.xorshift = seed != 0 ? seed : 0x12345678;
+
+	ctx->env.observation = observation;
+	ctx->env.is_done = 0;
+	ctx->env.num_episodes = 0;
+
+	write_observation(ctx, observation);
+}
+
+void batch_step(game_ctx_t** ctxs, const uint8_t* actions, int n) {
+	batch_job_t job = { .ctxs = ctxs, .actions = actions };
+	run_worker_jobs(&pool, run_batch_job, &job, n, BATCH_GRAIN);
+}
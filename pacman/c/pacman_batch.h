@@ -0,0 +1,24 @@
+#ifndef PACMAN_BATCH_H
+#define PACMAN_BATCH_H
+
+#include <stdint.h>
+
+#include "pacman_game.h"
+
+/*
+ * Steps many independent games at once on a pool of worker threads (POSIX only).
+ *
+ * Each game is bound to its own slice of a caller-provided observation buffer
+ * with init_batch_game(); batch_step() applies one action per game (a dir_t,
+ * DIR_NONE keeps the current direction), advances every game by one tick and
+ * writes the resulting observation straight into that slice. Finished games
+ * set env.is_done and are restarted in place.
+ */
+
+int batch_init(int num_threads);
+void batch_shutdown(void);
+
+void init_batch_game(game_ctx_t* ctx, int seed, uint8_t* observation);
+void batch_step(game_ctx_t** ctxs, const uint8_t* actions, int n);
+
+#endif
@@ -0,0 +1,364 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Built in rather than linked, so the static kernels can be timed on their own. */
+#include "pacman_game.c"
+#include "pacman_ghost_dirs.h"
+#include "pacman_render.h"
+
+/*
+ * Microbenchmarks for the engine kernels (POSIX only). Every benchmark times
+ * BENCH_SAMPLES samples of a fixed number of calls and reports the min,
+ * median and p99 of the ns per call as one JSON document on stdout. Kernels
+ * are calibrated once so that a sample takes about BENCH_SAMPLE_NS; ticks
+ * always play the first BENCH_SCENARIO_TICKS ticks of the scripted scenario
+ * from the same snapshot. Inputs come from a fixed seed, so runs of two engine
+ * versions can be diffed benchmark by benchmark.
+ *
+ * Frames are flushed to /dev/null: stdout is kept for the report. With -c it
+ * checks every direction kernel against the scalar one instead.
+ */
+#define BENCH_SAMPLES 101
+#define BENCH_SAMPLE_NS 200000LL
+#define BENCH_WARMUP_SAMPLES 5
+#define BENCH_NUM_INPUTS 1024
+#define BENCH_SCRIPT "aawwddssddwwaass"
+#define BENCH_HOLD_TICKS 8
+#define BENCH_SCENARIO_TICKS 2000
+#define BENCH_CHECK_CHOICES 1000000
+
+typedef struct {
+	game_ctx_t game;
+	game_snapshot_t start;
+	long long tick_idx;
+	term_renderer_t renderer;
+
+	vector_2d_t positions[BENCH_NUM_INPUTS];
+	vector_2d_t walkable[BENCH_NUM_INPUTS];
+	int num_walkable;
+	int ghost;
+
+	select_ghost_dirs_t select;
+	vector_2d_t dir_candidates[DIR_NONE][BENCH_NUM_INPUTS];
+	vector_2d_t dir_targets[BENCH_NUM_INPUTS];
+	int32_t dir_masks[BENCH_NUM_INPUTS];
+	uint8_t dirs[BENCH_NUM_INPUTS];
+} bench_ctx_t;
+
+typedef struct {
+	const char* name;
+	void (*setup)(bench_ctx_t* bench);
+	uint64_t (*run)(bench_ctx_t* bench, long long num_calls);
+	long long num_calls;
+} benchmark_t;
+
+static FILE* report;
+static volatile uint64_t sink;
+static int bench_xorshift = 0x2545f491;
+
+static int bench_xorshift32(void) {
+	int x = bench_xorshift;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return bench_xorshift = x;
+}
+
+static uint64_t run_clamp_vector_2d(bench_ctx_t* bench, long long num_calls) {
+	const level_t* level = bench->game.def_vals.level;
+	uint64_t sum = 0;
+	for (long long i = 0; i < num_calls; i++) {
+		vector_2d_t pos = clamp_vector_2d(bench->positions[i % BENCH_NUM_INPUTS], 0, level->width - 1, 0, level->height - 1);
+		sum += pos.x + pos.y;
+	}
+	return sum;
+}
+
+static uint64_t run_euclidean_distance(bench_ctx_t* bench, long long num_calls) {
+	uint64_t sum = 0;
+	for (long long i = 0; i < num_calls; i++) {
+		sum += vector_2d_euclidean_distance(bench->positions[i % BENCH_NUM_INPUTS], bench->positions[(i + 1) % BENCH_NUM_INPUTS]);
+	}
+	return sum;
+}
+
+/* What check_ghost_collisions became once ghost moves were split from their resolution. */
+static uint64_t run_test_ghost_move(bench_ctx_t* bench, long long num_calls) {
+	uint64_t sum = 0;
+	for (long long i = 0; i < num_calls; i++) {
+		sum += test_ghost_move(&bench->game, (int)(i % NUM_GHOSTS), bench->walkable[i % bench->num_walkable]);
+	}
+	return sum;
+}
+
+/* Chasing ghosts outside the house, so the personality's own targeting runs. */
+static void setup_ghost_target(bench_ctx_t* bench) {
+	restore_game_snapshot(&bench->game, &bench->start);
+	for (int i = 0; i < bench->game.state.ghosts.count; i++) bench->game.state.ghosts.state[i] = STATE_CHASE;
+}
+
+static uint64_t run_ghost_target(bench_ctx_t* bench, long long num_calls) {
+	ghosts_t* ghosts = &bench->game.state.ghosts;
+	uint64_t sum = 0;
+	for (long long i = 0; i < num_calls; i++) {
+		ghosts->pos[bench->ghost] = bench->walkable[i % bench->num_walkable];
+		update_ghost_target(&bench->game, bench->ghost);
+		sum += ghosts->target[bench->ghost].x;
+	}
+	return sum;
+}
+
+static void setup_blinky_target(bench_ctx_t* bench) {
+	setup_ghost_target(bench);
+	bench->ghost = GHOST_BLINKY;
+}
+
+static void setup_pinky_target(bench_ctx_t* bench) {
+	setup_ghost_target(bench);
+	bench->ghost = GHOST_PINKY;
+}
+
+static void setup_inky_target(bench_ctx_t* bench) {
+	setup_ghost_target(bench);
+	bench->ghost = GHOST_INKY;
+}
+
+static void setup_clyde_target(bench_ctx_t* bench) {
+	setup_ghost_target(bench);
+	bench->ghost = GHOST_CLYDE;
+}
+
+static uint64_t run_reset_tiles(bench_ctx_t* bench, long long num_calls) {
+	for (long long i = 0; i < num_calls; i++) reset_tiles(&bench->game);
+	return bench->game.state.active_points[1];
+}
+
+static uint64_t run_get_tile_repr(bench_ctx_t* bench, long long num_calls) {
+	const level_t* level = bench->game.def_vals.level;
+	const int num_tiles = level->width * level->height;
+	uint64_t sum = 0;
+	for (long long i = 0; i < num_calls; i++) {
+		int tile = (int)(i % num_tiles);
+		sum += get_tile_repr(&bench->game, (vector_2d_t){ .x = (short)(tile % level->width), .y = (short)(tile / level->width) });
+	}
+	return sum;
+}
+
+/* The scripted scenario: the headless default script, restarting when a game ends. */
+static void setup_scenario(bench_ctx_t* bench) {
+	restore_game_snapshot(&bench->game, &bench->start);
+	bench->tick_idx = 0;
+}
+
+static void step_scenario(bench_ctx_t* bench) {
+	game_ctx_t* game = &bench->game;
+	if (bench->tick_idx % BENCH_HOLD_TICKS == 0) {
+		char key = BENCH_SCRIPT[(bench->tick_idx / BENCH_HOLD_TICKS) % (sizeof(BENCH_SCRIPT) - 1)];
+		dir_t dir = key == 'w' ? DIR_UP : key == 's' ? DIR_DOWN : key == 'a' ? DIR_LEFT : DIR_RIGHT;
+		game->state.pacman.entity_state.dir = game->def_vals.dirs[dir];
+	}
+	bench->tick_idx++;
+
+	step_game_tick(game);
+	if (!game->is_running) restart_game(game);
+}
+
+static uint64_t run_game_tick(bench_ctx_t* bench, long long num_calls) {
+	for (long long i = 0; i < num_calls; i++) {
+		step_scenario(bench);
+		bench->game.state.num_pending_tile_updates = 0;
+		bench->game.state.is_redraw_pending = 0;
+	}
+	return bench->game.state.score;
+}
+
+/* The frame on_frame_render() draws after each tick, minus the terminal. */
+static void render_frame(bench_ctx_t* bench) {
+	game_ctx_t* game = &bench->game;
+	for (int i = 0; i < game->state.num_pending_tile_updates; i++) {
+		vector_2d_t pos = game->state.pending_tile_updates[i];
+		set_term_cell(&bench->renderer, pos, get_tile_repr(game, pos), 0);
+	}
+	game->state.num_pending_tile_updates = 0;
+	game->state.is_redraw_pending = 0;
+	flush_term_frame(&bench->renderer);
+}
+
+static uint64_t run_game_tick_and_frame(bench_ctx_t* bench, long long num_calls) {
+	for (long long i = 0; i < num_calls; i++) {
+		step_scenario(bench);
+		render_frame(bench);
+	}
+	return bench->renderer.num_bytes;
+}
+
+static uint64_t run_full_redraw(bench_ctx_t* bench, long long num_calls) {
+	game_ctx_t* game = &bench->game;
+	for (long long i = 0; i < num_calls; i++) {
+		clear_term_screen(&bench->renderer);
+		for (short y = 0; y < game->def_vals.window_height; y++) {
+			for (short x = 0; x < game->def_vals.window_width; x++) {
+				vector_2d_t pos = { .x = x, .y = y };
+				set_term_cell(&bench->renderer, pos, get_tile_repr(game, pos), 0);
+			}
+		}
+		flush_term_frame(&bench->renderer);
+	}
+	return bench->renderer.num_bytes;
+}
+
+/* A call is one ghost's choice, made BENCH_NUM_INPUTS at a time. */
+static uint64_t run_select_ghost_dirs(bench_ctx_t* bench, long long num_calls) {
+	const vector_2d_t* const candidates[DIR_NONE] = { bench->dir_candidates[DIR_UP], bench->dir_candidates[DIR_DOWN], bench->dir_candidates[DIR_LEFT], bench->dir_candidates[DIR_RIGHT] };
+	uint64_t sum = 0;
+	for (long long i = 0; i < num_calls; i += BENCH_NUM_INPUTS) {
+		int count = num_calls - i < BENCH_NUM_INPUTS ? (int)(num_calls - i) : BENCH_NUM_INPUTS;
+		bench->select(candidates, bench->dir_targets, bench->dir_masks, bench->dirs, count);
+		sum += bench->dirs[count - 1];
+	}
+	return sum;
+}
+
+static void setup_select_scalar(bench_ctx_t* bench) {
+	bench->select = get_ghost_dirs_kernel(GHOST_DIRS_SCALAR);
+}
+
+static void setup_select_sse2(bench_ctx_t* bench) {
+	bench->select = get_ghost_dirs_kernel(GHOST_DIRS_SSE2);
+}
+
+static void setup_select_avx2(bench_ctx_t* bench) {
+	bench->select = get_ghost_dirs_kernel(GHOST_DIRS_AVX2);
+}
+
+static const benchmark_t benchmarks[] = {
+	{ "clamp_vector_2d", NULL, run_clamp_vector_2d, 0 },
+	{ "vector_2d_euclidean_distance", NULL, run_euclidean_distance, 0 },
+	{ "test_ghost_move", setup_scenario, run_test_ghost_move, 0 },
+	{ "update_ghost_target/blinky", setup_blinky_target, run_ghost_target, 0 },
+	{ "update_ghost_target/pinky", setup_pinky_target, run_ghost_target, 0 },
+	{ "update_ghost_target/inky", setup_inky_target, run_ghost_target, 0 },
+	{ "update_ghost_target/clyde", setup_clyde_target, run_ghost_target, 0 },
+	{ "reset_tiles", setup_scenario, run_reset_tiles, 0 },
+	{ "get_tile_repr", setup_scenario, run_get_tile_repr, 0 },
+	{ "select_ghost_dirs/scalar", setup_select_scalar, run_select_ghost_dirs, 0 },
+	{ "select_ghost_dirs/sse2", setup_select_sse2, run_select_ghost_dirs, 0 },
+	{ "select_ghost_dirs/avx2", setup_select_avx2, run_select_ghost_dirs, 0 },
+	{ "on_frame_render/full_redraw", setup_scenario, run_full_redraw, 0 },
+	{ "on_game_tick", setup_scenario, run_game_tick, BENCH_SCENARIO_TICKS },
+	{ "on_game_tick+on_frame_render", setup_scenario, run_game_tick_and_frame, BENCH_SCENARIO_TICKS }
+};
+
+static int compare_doubles(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static long long time_sample(bench_ctx_t* bench, const benchmark_t* benchmark, long long num_calls) {
+	if (benchmark->setup != NULL) benchmark->setup(bench);
+	long long start_ns = get_time_ns();
+	sink += benchmark->run(bench, num_calls);
+	return get_time_ns() - start_ns;
+}
+
+static long long calibrate(bench_ctx_t* bench, const benchmark_t* benchmark) {
+	if (benchmark->num_calls > 0) return benchmark->num_calls;
+
+	long long num_calls = 1;
+	while (time_sample(bench, benchmark, num_calls) < BENCH_SAMPLE_NS) num_calls *= 2;
+	return num_calls;
+}
+
+/* Kernels the CPU lacks are left out of the report. */
+static short is_benchmark_supported(bench_ctx_t* bench, const benchmark_t* benchmark) {
+	if (benchmark->run != run_select_ghost_dirs) return 1;
+
+	benchmark->setup(bench);
+	return bench->select != NULL;
+}
+
+static void run_benchmark(bench_ctx_t* bench, const benchmark_t* benchmark, short is_first) {
+	double ns_per_call[BENCH_SAMPLES];
+	long long num_calls = calibrate(bench, benchmark);
+
+	for (int i = 0; i < BENCH_WARMUP_SAMPLES; i++) time_sample(bench, benchmark, num_calls);
+	for (int i = 0; i < BENCH_SAMPLES; i++) ns_per_call[i] = (double)time_sample(bench, benchmark, num_calls) / num_calls;
+	qsort(ns_per_call, BENCH_SAMPLES, sizeof(double), compare_doubles);
+
+	fprintf(report, "%s\n    {\"name\": \"%s\", \"calls_per_sample\": %lld, \"samples\": %d, \"min_ns\": %.2f, \"median_ns\": %.2f, \"p99_ns\": %.2f}",
+		is_first ? "" : ",", benchmark->name, num_calls, BENCH_SAMPLES,
+		ns_per_call[0], ns_per_call[BENCH_SAMPLES / 2], ns_per_call[(BENCH_SAMPLES * 99) / 100]);
+	fflush(report);
+}
+
+static void init_bench(bench_ctx_t* bench) {
+	memset(bench, 0, sizeof(bench_ctx_t));
+	init_level(&bench->game, 0);
+
+	const level_t* level = bench->game.def_vals.level;
+	if (init_term_renderer(&bench->renderer, level->width, level->height, 0, 0) != 0) {
+		cleanup(&bench->game);
+		exit(-1);
+	}
+
+	/* One tile past each edge too, so clamp_vector_2d takes all of its branches. */
+	for (int i = 0; i < BENCH_NUM_INPUTS; i++) {
+		bench->positions[i].x = (short)((unsigned int)bench_xorshift32() % (level->width + 2) - 1);
+		bench->positions[i].y = (short)((unsigned int)bench_xorshift32() % (level->height + 2) - 1);
+	}
+	for (short y = 0; y < level->height && bench->num_walkable < BENCH_NUM_INPUTS; y++) {
+		for (short x = 0; x < level->width && bench->num_walkable < BENCH_NUM_INPUTS; x++) {
+			vector_2d_t pos = { .x = x, .y = y };
+			if (test_tile_bit(level->points, pos)) bench->walkable[bench->num_walkable++] = pos;
+		}
+	}
+
+	/* Choices like the game's: neighbours of a walkable tile, targets anywhere on the board, any exits. */
+	for (int i = 0; i < BENCH_NUM_INPUTS; i++) {
+		vector_2d_t pos = bench->walkable[(unsigned int)bench_xorshift32() % bench->num_walkable];
+		for (dir_t d = 0; d < DIR_NONE; d++) bench->dir_candidates[d][i] = get_neighbour_tile(&bench->game, pos, d);
+		bench->dir_targets[i] = bench->positions[i];
+		bench->dir_masks[i] = bench_xorshift32() & 0xf;
+	}
+
+	save_game_snapshot(&bench->game, &bench->start);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+		int num_mismatches = check_ghost_dirs_kernels(BENCH_CHECK_CHOICES, 0x2545f491);
+		for (int k = 0; k < NUM_GHOST_DIRS_KERNELS; k++) printf("%s: %s\n", ghost_dirs_kernel_names[k], get_ghost_dirs_kernel(k) != NULL ? "checked" : "not supported");
+		printf("mismatches: %d\n", num_mismatches);
+		return num_mismatches == 0 ? 0 : 1;
+	}
+
+	const char* filter = argc > 1 ? argv[1] : NULL;
+
+	int report_fd = dup(STDOUT_FILENO);
+	int null_fd = open("/dev/null", O_WRONLY);
+	if (report_fd < 0 || null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0 || (report = fdopen(report_fd, "w")) == NULL) {
+		fprintf(stderr, "Error redirecting stdout\n");
+		return 1;
+	}
+	close(null_fd);
+
+	bench_ctx_t bench;
+	init_bench(&bench);
+
+	fprintf(report, "{\n  \"samples\": %d,\n  \"benchmarks\": [", BENCH_SAMPLES);
+	short is_first = 1;
+	for (int i = 0; i < (int)(sizeof(benchmarks) / sizeof(benchmarks[0])); i++) {
+		if (filter != NULL && strstr(benchmarks[i].name, filter) == NULL) continue;
+		if (!is_benchmark_supported(&bench, &benchmarks[i])) continue;
+		run_benchmark(&bench, &benchmarks[i], is_first);
+		is_first = 0;
+	}
+	fprintf(report, "\n  ]\n}\n");
+	fclose(report);
+
+	free_term_renderer(&bench.renderer);
+	free_game_snapshot(&bench.start);
+	cleanup(&bench.game);
+	return 0;
+}
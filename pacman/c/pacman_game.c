@@ -0,0 +1,1327 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pacman_game.h"
+#include "pacman_ghost_dirs.h"
+#include "pacman_paths.h"
+#include "pacman_platform.h"
+#include "pacman_trace.h"
+
+static int xorshift32(game_ctx_t* ctx) {
+	int x = ctx->state.xorshift;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return ctx->state.xorshift = x;
+}
+
+static vector_2d_t vector_2d_add(vector_2d_t a, vector_2d_t b) {
+	return (vector_2d_t) { .x = a.x + b.x, .y = a.y + b.y };
+}
+
+static vector_2d_t vector_2d_sub(vector_2d_t a, vector_2d_t b) {
+	return (vector_2d_t) { .x = a.x - b.x, .y = a.y - b.y };
+}
+
+static short vector_2d_eq(vector_2d_t a, vector_2d_t b) {
+	return a.x == b.x && a.y == b.y;
+}
+
+static int vector_2d_euclidean_distance(vector_2d_t a, vector_2d_t b) {
+	return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
+}
+
+static vector_2d_t vector_2d_mul_scalar(vector_2d_t a, short scalar) {
+	return (vector_2d_t) { .x = a.x * scalar, .y = a.y * scalar };
+}
+
+static vector_2d_t reverse_dir(vector_2d_t dir) {
+	return vector_2d_mul_scalar(dir, -1);
+}
+
+static vector_2d_t clamp_vector_2d(vector_2d_t a, int min_val_x, int max_val_x, int min_val_y, int max_val_y) {
+	return (vector_2d_t) { .x = a.x < min_val_x ? max_val_x : a.x > max_val_x ? min_val_x : a.x, .y = a.y < min_val_y ? max_val_y : a.y > max_val_y ? min_val_y : a.y };
+}
+
+/*
+ * Ghosts do not draw from the game's RNG, as its sequence would then depend
+ * on the order they update in. Each one hashes the RNG state of the tick with
+ * its index and the number of the draw instead.
+ */
+static uint32_t get_ghost_random(game_ctx_t* ctx, int ghost, int draw) {
+	uint32_t x = (uint32_t)ctx->state.xorshift ^ ((uint32_t)ghost * 2 + draw) * 0x9e3779b9u;
+	x ^= x >> 16;
+	x *= 0x85ebca6bu;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35u;
+	x ^= x >> 16;
+	return x;
+}
+
+static vector_2d_t gen_random_target(game_ctx_t* ctx, int ghost) {
+	return (vector_2d_t) {
+		.x = (int)get_ghost_random(ctx, ghost, 0) % ctx->def_vals.window_width, .y = (int)get_ghost_random(ctx, ghost, 1) % ctx->def_vals.window_height
+	};
+}
+
+static short test_tile_bit(const uint32_t* layer, vector_2d_t pos) {
+	return (layer[pos.y] >> pos.x) & 1;
+}
+
+static void set_tile_bit(uint32_t* layer, vector_2d_t pos) {
+	layer[pos.y] |= 1u << pos.x;
+}
+
+static void clear_tile_bit(uint32_t* layer, vector_2d_t pos) {
+	layer[pos.y] &= ~(1u << pos.x);
+}
+
+static int count_tile_bits(const uint32_t* layer, short height) {
+	int count = 0;
+	for (int i = 0; i < height; i++) {
+		uint32_t row = layer[i];
+		row = row - ((row >> 1) & 0x55555555u);
+		row = (row & 0x33333333u) + ((row >> 2) & 0x33333333u);
+		count += (((row + (row >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24;
+	}
+	return count;
+}
+
+static short count_remaining_point_tiles(game_ctx_t* ctx) {
+	return count_tile_bits(ctx->state.active_points, ctx->def_vals.window_height) + count_tile_bits(ctx->state.active_energizers, ctx->def_vals.window_height);
+}
+
+static int get_tile_index(vector_2d_t pos) {
+	return pos.y * MAX_BOARD_WIDTH + pos.x;
+}
+
+static ghost_type_t get_ghost_type(int ghost) {
+	return (ghost_type_t)(ghost % NUM_GHOSTS);
+}
+
+/* Frontends empty the list by zeroing its count, so the first tile added after that resets the dedup bits. */
+static void add_pending_tile_update(game_ctx_t* ctx, vector_2d_t pos) {
+	if (ctx->state.num_pending_tile_updates == 0) memset(ctx->state.pending_tiles, 0, sizeof(bitboard_t));
+	else if (test_tile_bit(ctx->state.pending_tiles, pos)) return;
+
+	set_tile_bit(ctx->state.pending_tiles, pos);
+	ctx->state.pending_tile_updates[ctx->state.num_pending_tile_updates++] = pos;
+}
+
+static void link_ghost(ghosts_t* ghosts, int ghost) {
+	int tile = get_tile_index(ghosts->pos[ghost]);
+	short head = ghosts->tile_ghosts[tile];
+
+	ghosts->prev_ghost[ghost] = -1;
+	ghosts->next_ghost[ghost] = head;
+	if (head >= 0) ghosts->prev_ghost[head] = ghost;
+	ghosts->tile_ghosts[tile] = ghost;
+	set_tile_bit(ghosts->occupied, ghosts->pos[ghost]);
+}
+
+static void unlink_ghost(ghosts_t* ghosts, int ghost) {
+	short prev = ghosts->prev_ghost[ghost];
+	short next = ghosts->next_ghost[ghost];
+
+	if (next >= 0) ghosts->prev_ghost[next] = prev;
+	if (prev >= 0) ghosts->next_ghost[prev] = next;
+	else {
+		ghosts->tile_ghosts[get_tile_index(ghosts->pos[ghost])] = next;
+		if (next < 0) clear_tile_bit(ghosts->occupied, ghosts->pos[ghost]);
+	}
+}
+
+/* The only way a ghost changes tiles, so the occupancy layer and the renderer always hear about it. */
+static void move_ghost(game_ctx_t* ctx, int ghost, vector_2d_t pos) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	if (vector_2d_eq(ghosts->pos[ghost], pos)) return;
+
+	unlink_ghost(ghosts, ghost);
+	add_pending_tile_update(ctx, ghosts->pos[ghost]);
+
+	ghosts->pos[ghost] = pos;
+	link_ghost(ghosts, ghost);
+	add_pending_tile_update(ctx, pos);
+}
+
+/* Pacman is drawn over ghosts, and of several ghosts the one that arrived last. */
+tile_type_t get_tile_type(game_ctx_t* ctx, vector_2d_t pos) {
+	if (vector_2d_eq(ctx->state.pacman.entity_state.pos, pos)) return TILE_PACMAN;
+	if (test_tile_bit(ctx->state.ghosts.occupied, pos)) return TILE_GHOST_BLINKY + get_ghost_type(ctx->state.ghosts.tile_ghosts[get_tile_index(pos)]);
+
+	if (test_tile_bit(ctx->def_vals.level->walls, pos)) return TILE_WALL;
+	if (test_tile_bit(ctx->def_vals.level->points, pos)) return TILE_POINT;
+	if (test_tile_bit(ctx->def_vals.level->energizers, pos)) return TILE_ENERGIZER;
+	if (test_tile_bit(ctx->def_vals.level->hearts, pos)) return TILE_HEART;
+	return TILE_EMPTY;
+}
+
+static void free_game_buffers(game_ctx_t* ctx) {
+	free(ctx->state.pending_tile_updates);
+	ctx->state.pending_tile_updates = NULL;
+	free(ctx->state.ghosts.arena);
+	memset(&ctx->state.ghosts, 0, sizeof(ghosts_t));
+}
+
+void cleanup(game_ctx_t* ctx) {
+	free_game_buffers(ctx);
+	free_ghost_paths(&ctx->def_vals.paths);
+}
+
+static float calculate_level_multiplier(short level) {
+	return 1 + level * 0.1;
+}
+
+static short is_redzone(game_ctx_t* ctx, vector_2d_t pos) {
+	return test_tile_bit(ctx->def_vals.level->redzone, pos);
+}
+
+static vector_2d_t get_neighbour_tile(game_ctx_t* ctx, vector_2d_t pos, dir_t dir) {
+	return clamp_vector_2d(vector_2d_add(pos, ctx->def_vals.dirs[dir]), 0, ctx->def_vals.window_width - 1, 0, ctx->def_vals.window_height - 1);
+}
+
+static uint8_t get_exit_mask(game_ctx_t* ctx, vector_2d_t pos) {
+	const nav_graph_t* nav = &ctx->def_vals.level->nav;
+	return ((nav->exits[DIR_UP][pos.y] >> pos.x) & 1) << DIR_UP
+		| ((nav->exits[DIR_DOWN][pos.y] >> pos.x) & 1) << DIR_DOWN
+		| ((nav->exits[DIR_LEFT][pos.y] >> pos.x) & 1) << DIR_LEFT
+		| ((nav->exits[DIR_RIGHT][pos.y] >> pos.x) & 1) << DIR_RIGHT;
+}
+
+static short count_exits(uint8_t exits) {
+	return (exits & 1) + ((exits >> 1) & 1) + ((exits >> 2) & 1) + ((exits >> 3) & 1);
+}
+
+static dir_t get_dir_index(game_ctx_t* ctx, vector_2d_t dir) {
+	for (dir_t i = 0; i < DIR_NONE; i++) {
+		if (vector_2d_eq(ctx->def_vals.dirs[i], dir)) return i;
+	}
+	return DIR_NONE;
+}
+
+static dir_t get_reverse_dir_index(dir_t dir) {
+	switch (dir)
+	{
+	case DIR_UP:
+		return DIR_DOWN;
+	case DIR_DOWN:
+		return DIR_UP;
+	case DIR_LEFT:
+		return DIR_RIGHT;
+	case DIR_RIGHT:
+		return DIR_LEFT;
+	default:
+		return DIR_NONE;
+	}
+}
+
+/* Grows reached to every tile a ghost can get to from it by the moves in nav->exits. */
+static void flood_nav(const nav_graph_t* nav, short width, short height, bitboard_t reached) {
+	const uint32_t row_mask = width >= 32 ? 0xffffffffu : (1u << width) - 1;
+	const uint32_t last_col = 1u << (width - 1);
+
+	short changed = 1;
+	while (changed) {
+		changed = 0;
+		for (short y = 0; y < height; y++) {
+			uint32_t left = reached[y] & nav->exits[DIR_LEFT][y];
+			uint32_t right = reached[y] & nav->exits[DIR_RIGHT][y];
+			short below = y < height - 1 ? y + 1 : 0;
+			short above = y > 0 ? y - 1 : height - 1;
+
+			uint32_t row = reached[y];
+			row |= (left >> 1) | ((left & 1u) << (width - 1));
+			row |= ((right << 1) & row_mask) | ((right & last_col) >> (width - 1));
+			row |= reached[below] & nav->exits[DIR_UP][below];
+			row |= reached[above] & nav->exits[DIR_DOWN][above];
+
+			if (row != reached[y]) {
+				reached[y] = row;
+				changed = 1;
+			}
+		}
+	}
+}
+
+/* Fills in level->nav; ctx only has to have level, window size and dirs set. */
+static void build_nav_graph(game_ctx_t* ctx, level_t* level) {
+	nav_graph_t* nav = &level->nav;
+	const short width = level->width;
+	const short height = level->height;
+	const uint32_t row_mask = width >= 32 ? 0xffffffffu : (1u << width) - 1;
+
+	memset(nav, 0, sizeof(nav_graph_t));
+
+	/* Moves off the edge of the map wrap round to the far side, so edge tiles lead wherever that tile is open. */
+	for (short y = 0; y < height; y++) {
+		uint32_t open = ~level->walls[y] & row_mask;
+		uint32_t open_up = ~level->walls[y > 0 ? y - 1 : height - 1] & row_mask;
+		uint32_t open_down = ~level->walls[y < height - 1 ? y + 1 : 0] & row_mask;
+
+		nav->exits[DIR_UP][y] = open & open_up & ~level->redzone[y];
+		nav->exits[DIR_DOWN][y] = open & open_down;
+		nav->exits[DIR_LEFT][y] = open & ((open << 1) | ((open >> (width - 1)) & 1u));
+		nav->exits[DIR_RIGHT][y] = open & ((open >> 1) | ((open & 1u) << (width - 1)));
+	}
+
+	/* Only the part of the map reachable from the spawn points becomes part of the graph. */
+	bitboard_t reachable = { 0 };
+	set_tile_bit(reachable, level->pacman_start_pos);
+	for (ghost_type_t type = GHOST_BLINKY; type < NUM_GHOSTS; type++) {
+		set_tile_bit(reachable, level->ghost_spawn_pos[type]);
+		set_tile_bit(reachable, level->ghost_home_pos[type]);
+	}
+
+	flood_nav(nav, width, height, reachable);
+	memcpy(nav->reachable, reachable, sizeof(bitboard_t));
+}
+
+static void init_def_vals(game_ctx_t* ctx) {
+	ctx->def_vals.ticks_per_second = 60;
+	ctx->def_vals.skip_ticks = 16;
+	ctx->def_vals.max_catchup_ticks = 4;
+
+	ctx->def_vals.dirs[DIR_NONE] = (vector_2d_t){ .x = 0, .y = 0 };
+	ctx->def_vals.dirs[DIR_UP] = (vector_2d_t){ .x = 0, .y = -1 };
+	ctx->def_vals.dirs[DIR_DOWN] = (vector_2d_t){ .x = 0, .y = 1 };
+	ctx->def_vals.dirs[DIR_LEFT] = (vector_2d_t){ .x = -1, .y = 0 };
+	ctx->def_vals.dirs[DIR_RIGHT] = (vector_2d_t){ .x = 1, .y = 0 };
+
+	/*
+	 * Resolves the direction kernel. Only the first call, made from the main
+	 * thread before any worker runs game code, picks one; the calls from
+	 * restart_game on batch and server workers find it set and only read it.
+	 */
+	get_active_ghost_dirs_kernel();
+}
+
+static int get_ghost_release_threshold(game_ctx_t* ctx, ghost_type_t type) {
+	switch (type)
+	{
+	case GHOST_INKY:
+		return 30 / ctx->state.level_multiplier + ctx->state.score;
+	case GHOST_CLYDE:
+		return 60 / ctx->state.level_multiplier + ctx->state.score;
+	default:
+		return ctx->state.score;
+	}
+}
+
+static void init_ghosts(game_ctx_t* ctx) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	const level_t* level = ctx->def_vals.level;
+
+	memset(ghosts->occupied, 0, sizeof(bitboard_t));
+	memset(ghosts->tile_ghosts, 0xff, MAX_BOARD_WIDTH * MAX_BOARD_HEIGHT * sizeof(short));
+
+	for (int i = 0; i < ghosts->count; i++) {
+		ghost_type_t type = get_ghost_type(i);
+
+		ghosts->pos[i] = level->ghost_spawn_pos[type];
+		ghosts->next_pos[i] = ghosts->pos[i];
+		ghosts->dir[i] = ctx->def_vals.dirs[type == GHOST_BLINKY ? DIR_LEFT : DIR_NONE];
+		ghosts->target[i] = level->ghost_scatter_target_pos[type];
+		ghosts->state[i] = STATE_NONE;
+		ghosts->release_threshold[i] = get_ghost_release_threshold(ctx, type);
+		ghosts->last_frightened[i].tick = -1;
+		ghosts->frightened_expired[i].tick = -1;
+		ghosts->last_eaten[i].tick = -1;
+		ghosts->last_chase[i].tick = -1;
+		ghosts->last_scatter[i].tick = -1;
+		ghosts->state_cycles_completed[i] = 0;
+
+		link_ghost(ghosts, i);
+	}
+
+	/* All of them start in the house, waiting on the score alone. */
+	init_timer_wheel(&ctx->state.timer_wheel, ghosts->timers, ghosts->count, ctx->time.current_tick);
+	ctx->state.release_score = ctx->state.score;
+}
+
+static void init_pacman(game_ctx_t* ctx) {
+	ctx->state.pacman = (pacman_t){
+		.entity_state = (entity_state_t) {.pos = ctx->def_vals.level->pacman_start_pos, .dir = ctx->def_vals.dirs[DIR_NONE] }
+	};
+}
+
+static void set_tile(level_t* level, char c, vector_2d_t pos) {
+	switch (c)
+	{
+	case '#':
+		set_tile_bit(level->walls, pos);
+		break;
+	case '.':
+		set_tile_bit(level->points, pos);
+		break;
+	case '@':
+		set_tile_bit(level->energizers, pos);
+		break;
+	case 'o':
+		if (level->num_hearts >= MAX_PACMAN_LIVES) break;
+		set_tile_bit(level->hearts, pos);
+		level->heart_tiles_pos[level->num_hearts++] = pos;
+		break;
+	default:
+		break;
+	}
+}
+
+static short is_inside_level(const level_source_t* source, vector_2d_t pos) {
+	return pos.x >= 0 && pos.x < source->width && pos.y >= 0 && pos.y < source->height;
+}
+
+int compile_level(level_t* level, const level_source_t* source) {
+	if (source->width < 1 || source->width > MAX_BOARD_WIDTH || source->height < 1 || source->height > MAX_BOARD_HEIGHT) return -1;
+	if (source->num_redzones < 0 || source->num_redzones > MAX_LEVEL_REDZONES) return -1;
+
+	short is_valid = is_inside_level(source, source->pacman_start_pos) && is_inside_level(source, source->ghost_house_exit);
+	for (ghost_type_t type = GHOST_BLINKY; type < NUM_GHOSTS; type++) {
+		is_valid &= is_inside_level(source, source->ghost_spawn_pos[type]) && is_inside_level(source, source->ghost_home_pos[type]);
+	}
+	if (!is_valid) return -1;
+
+	memset(level, 0, sizeof(level_t));
+	level->width = source->width;
+	level->height = source->height;
+	level->pacman_start_pos = source->pacman_start_pos;
+	memcpy(level->ghost_spawn_pos, source->ghost_spawn_pos, sizeof(level->ghost_spawn_pos));
+	memcpy(level->ghost_home_pos, source->ghost_home_pos, sizeof(level->ghost_home_pos));
+	memcpy(level->ghost_scatter_target_pos, source->ghost_scatter_target_pos, sizeof(level->ghost_scatter_target_pos));
+	level->ghost_house_min = source->ghost_house_min;
+	level->ghost_house_max = source->ghost_house_max;
+	level->ghost_house_exit = source->ghost_house_exit;
+
+	for (short y = 0; y < level->height; y++) {
+		for (short x = 0; x < level->width; x++) set_tile(level, source->tiles[y * level->width + x], (vector_2d_t){ .x = x, .y = y });
+	}
+
+	for (short i = 0; i < source->num_redzones; i++) {
+		short y = source->redzones[i].y;
+		if (y < 0 || y >= level->height) return -1;
+		for (short x = source->redzones[i].min_x; x <= source->redzones[i].max_x; x++) {
+			if (x >= 0 && x < level->width) set_tile_bit(level->redzone, (vector_2d_t){ .x = x, .y = y });
+		}
+	}
+
+	level->total_point_tiles = count_tile_bits(level->points, level->height) + count_tile_bits(level->energizers, level->height);
+
+	game_ctx_t ctx;
+	memset(&ctx, 0, sizeof(game_ctx_t));
+	init_def_vals(&ctx);
+	ctx.def_vals.level = level;
+	ctx.def_vals.window_width = level->width;
+	ctx.def_vals.window_height = level->height;
+	build_nav_graph(&ctx, level);
+
+	/* Redzones must leave ghosts a way from the house exit out to the maze, or they never leave the house. */
+	bitboard_t from_exit = { 0 };
+	set_tile_bit(from_exit, level->ghost_house_exit);
+	flood_nav(&level->nav, level->width, level->height, from_exit);
+	if (!test_tile_bit(from_exit, level->pacman_start_pos)) return -2;
+	return 0;
+}
+
+static const level_source_t builtin_level_source = {
+	.width = 28,
+	.height = 36,
+	.tiles =
+		"                            "
+		"                            "
+		"                            "
+		"############################"
+		"#............##............#"
+		"#.####.#####.##.#####.####.#"
+		"#@#  #.#   #.##.#   #.#  #@#"
+		"#.####.#####.##.#####.####.#"
+		"#..........................#"
+		"#.####.##.########.##.####.#"
+		"#.####.##.########.##.####.#"
+		"#......##....##....##......#"
+		"######.##### ## #####.######"
+		"     #.##### ## #####.#     "
+		"     #.##          ##.#     "
+		"     #.## ###  ### ##.#     "
+		"######.## #      # ##.######"
+		"      .   #      #   .      "
+		"######.## #      # ##.######"
+		"     #.## ######## ##.#     "
+		"     #.##          ##.#     "
+		"     #.## ######## ##.#     "
+		"######.## ######## ##.######"
+		"#............##............#"
+		"#.####.#####.##.#####.####.#"
+		"#.####.#####.##.#####.####.#"
+		"#@..##.......  .......##..@#"
+		"###.##.##.########.##.##.###"
+		"###.##.##.########.##.##.###"
+		"#......##....##....##......#"
+		"#.##########.##.##########.#"
+		"#.##########.##.##########.#"
+		"#..........................#"
+		"############################"
+		" ooo                        "
+		"                            ",
+
+	.pacman_start_pos = { .x = 13, .y = 26 },
+	.ghost_spawn_pos = { [GHOST_BLINKY] = { .x = 13, .y = 14 }, [GHOST_PINKY] = { .x = 13, .y = 17 }, [GHOST_INKY] = { .x = 11, .y = 17 }, [GHOST_CLYDE] = { .x = 15, .y = 17 } },
+	.ghost_home_pos = { [GHOST_BLINKY] = { .x = 13, .y = 16 }, [GHOST_PINKY] = { .x = 13, .y = 17 }, [GHOST_INKY] = { .x = 11, .y = 17 }, [GHOST_CLYDE] = { .x = 15, .y = 17 } },
+	.ghost_scatter_target_pos = { [GHOST_BLINKY] = { .x = 25, .y = 0 }, [GHOST_PINKY] = { .x = 2, .y = 0 }, [GHOST_INKY] = { .x = 27, .y = 34 }, [GHOST_CLYDE] = { .x = 0, .y = 34 } },
+
+	.ghost_house_min = { .x = 13, .y = 16 },
+	.ghost_house_max = { .x = 14, .y = 18 },
+	.ghost_house_exit = { .x = 13, .y = 15 },
+
+	.num_redzones = 2,
+	.redzones = { { .y = 14, .min_x = 10, .max_x = 17 }, { .y = 26, .min_x = 10, .max_x = 17 } }
+};
+
+const level_source_t* get_builtin_level_source(void) {
+	return &builtin_level_source;
+}
+
+/* Carves every ghost array out of one block, the most strictly aligned first. */
+static int alloc_ghosts(ghosts_t* ghosts, int count) {
+	const size_t num_tiles = MAX_BOARD_WIDTH * MAX_BOARD_HEIGHT;
+	const size_t size = sizeof(bitboard_t)
+		+ count * (sizeof(int) + 5 * sizeof(event_t) + sizeof(game_timer_t) + 4 * sizeof(vector_2d_t) + 3 * sizeof(short) + sizeof(uint8_t))
+		+ num_tiles * sizeof(short);
+
+	uint8_t* arena = (uint8_t*)calloc(1, size);
+	if (arena == NULL) return -1;
+
+	ghosts->count = count;
+	ghosts->arena_size = size;
+	ghosts->arena = arena;
+
+	ghosts->occupied = (uint32_t*)arena;
+	arena += sizeof(bitboard_t);
+	ghosts->release_threshold = (int*)arena;
+	arena += count * sizeof(int);
+	ghosts->last_frightened = (event_t*)arena;
+	arena += count * sizeof(event_t);
+	ghosts->frightened_expired = (event_t*)arena;
+	arena += count * sizeof(event_t);
+	ghosts->last_eaten = (event_t*)arena;
+	arena += count * sizeof(event_t);
+	ghosts->last_chase = (event_t*)arena;
+	arena += count * sizeof(event_t);
+	ghosts->last_scatter = (event_t*)arena;
+	arena += count * sizeof(event_t);
+	ghosts->timers = (game_timer_t*)arena;
+	arena += count * sizeof(game_timer_t);
+	ghosts->pos = (vector_2d_t*)arena;
+	arena += count * sizeof(vector_2d_t);
+	ghosts->next_pos = (vector_2d_t*)arena;
+	arena += count * sizeof(vector_2d_t);
+	ghosts->dir = (vector_2d_t*)arena;
+	arena += count * sizeof(vector_2d_t);
+	ghosts->target = (vector_2d_t*)arena;
+	arena += count * sizeof(vector_2d_t);
+	ghosts->state_cycles_completed = (short*)arena;
+	arena += count * sizeof(short);
+	ghosts->next_ghost = (short*)arena;
+	arena += count * sizeof(short);
+	ghosts->prev_ghost = (short*)arena;
+	arena += count * sizeof(short);
+	ghosts->tile_ghosts = (short*)arena;
+	arena += num_tiles * sizeof(short);
+	ghosts->state = arena;
+	return 0;
+}
+
+/* Compiled on the first init_level() that finds no levels set, which happens before any game threads start. */
+static level_t builtin_level;
+static short is_builtin_level_compiled = 0;
+
+/* A restart keeps the buffers of the game before when it has as many ghosts, and only clears them. */
+static void init_tiles(game_ctx_t* ctx, short has_buffers) {
+	if (ctx->def_vals.level_set.levels == NULL) {
+		if (!is_builtin_level_compiled) {
+			compile_level(&builtin_level, &builtin_level_source);
+			is_builtin_level_compiled = 1;
+		}
+		ctx->def_vals.level_set = (level_set_t){ .levels = &builtin_level, .num_levels = 1, .max_width = builtin_level.width, .max_height = builtin_level.height };
+	}
+
+	int num_ghosts = ctx->def_vals.num_ghosts > 0 ? ctx->def_vals.num_ghosts : NUM_GHOSTS;
+	if (num_ghosts > MAX_GHOSTS) num_ghosts = MAX_GHOSTS;
+
+	if (has_buffers) {
+		if (ctx->state.ghosts.count == num_ghosts) {
+			memset(ctx->state.ghosts.arena, 0, ctx->state.ghosts.arena_size);
+			return;
+		}
+		free_game_buffers(ctx);
+	}
+
+	/* Sized for the largest board, so switching levels never reallocates. */
+	ctx->state.pending_tile_updates = (vector_2d_t*)malloc(MAX_BOARD_WIDTH * MAX_BOARD_HEIGHT * sizeof(vector_2d_t));
+
+	if (ctx->state.pending_tile_updates == NULL || alloc_ghosts(&ctx->state.ghosts, num_ghosts) != 0) {
+		cleanup(ctx);
+		exit(-1);
+	}
+}
+
+/* Levels are used in place, so switching is a pointer swap; the ghost paths are built once per map and then shared. */
+static void select_level(game_ctx_t* ctx, short level) {
+	const level_set_t* level_set = &ctx->def_vals.level_set;
+	ctx->def_vals.level = &level_set->levels[level % level_set->num_levels];
+	ctx->def_vals.window_width = ctx->def_vals.level->width;
+	ctx->def_vals.window_height = ctx->def_vals.level->height;
+
+	if (ctx->def_vals.ghost_targeting != GHOST_TARGETING_GREEDY && (ctx->def_vals.paths.graph == NULL || ctx->def_vals.paths.graph->nav != &ctx->def_vals.level->nav)) {
+		if (build_ghost_paths(&ctx->def_vals.paths, &ctx->def_vals.level->nav, ctx->def_vals.window_width, ctx->def_vals.window_height, ctx->def_vals.ghost_targeting) != 0) {
+			cleanup(ctx);
+			exit(-1);
+		}
+	}
+}
+
+static void reset_tiles(game_ctx_t* ctx) {
+	ctx->state.num_pending_tile_updates = 0;
+
+	memcpy(ctx->state.active_points, ctx->def_vals.level->points, sizeof(bitboard_t));
+	memcpy(ctx->state.active_energizers, ctx->def_vals.level->energizers, sizeof(bitboard_t));
+	memcpy(ctx->state.active_hearts, ctx->def_vals.level->hearts, sizeof(bitboard_t));
+}
+
+static void load_level(game_ctx_t* ctx, short level, short has_buffers) {
+	ctx->state.level = level;
+	ctx->state.level_multiplier = calculate_level_multiplier(ctx->state.level);
+
+	if (level == 0) {
+		init_def_vals(ctx);
+
+		ctx->time.current_tick = 0;
+		ctx->time.next_tick.tick = 0;
+		ctx->time.late_ticks = 0;
+		ctx->time.dropped_ticks = 0;
+		ctx->state.score = 0;
+		ctx->state.xorshift = 0x12345678;
+		ctx->is_running = 1;
+
+		init_tiles(ctx, has_buffers);
+	}
+
+	select_level(ctx, level);
+	if (level == 0) ctx->state.num_lives = ctx->def_vals.level->num_hearts;
+
+	reset_tiles(ctx);
+
+	ctx->state.remaining_point_tiles = ctx->def_vals.level->total_point_tiles;
+
+	init_ghosts(ctx);
+	init_pacman(ctx);
+}
+
+void init_level(game_ctx_t* ctx, short level) {
+	TRACE_SPAN_ARG("init_level", "level", level, load_level(ctx, level, 0));
+}
+
+/* Starts a new game in the buffers of the last one while carrying over the RNG, so consecutive games differ. */
+void restart_game(game_ctx_t* ctx) {
+	int xorshift = ctx->state.xorshift;
+
+	TRACE_SPAN_ARG("init_level", "level", 0, load_level(ctx, 0, 1));
+
+	ctx->state.xorshift = xorshift;
+}
+
+char get_tile_repr(game_ctx_t* ctx, vector_2d_t pos) {
+	switch (get_tile_type(ctx, pos))
+	{
+	case TILE_EMPTY:
+		return ' ';
+		break;
+	case TILE_GHOST_BLINKY:
+		return 'B';
+		break;
+	case TILE_GHOST_PINKY:
+		return 'P';
+		break;
+	case TILE_GHOST_INKY:
+		return 'I';
+		break;
+	case TILE_GHOST_CLYDE:
+		return 'C';
+		break;
+	case TILE_PACMAN:
+		return 'O';
+		break;
+	case TILE_WALL:
+		return '#';
+		break;
+	case TILE_POINT:
+		if (test_tile_bit(ctx->state.active_points, pos)) return '.';
+		else return ' ';
+		break;
+	case TILE_ENERGIZER:
+		if (test_tile_bit(ctx->state.active_energizers, pos)) return '@';
+		else return ' ';
+		break;
+	case TILE_HEART:
+		if (test_tile_bit(ctx->state.active_hearts, pos)) return 'o';
+		else return ' ';
+		break;
+	default:
+		return ' ';
+		break;
+	}
+}
+
+int get_observation_size(game_ctx_t* ctx) {
+	return ctx->def_vals.level_set.max_width * ctx->def_vals.level_set.max_height;
+}
+
+/*
+ * One byte per tile holding the tile_type_t currently shown; collected pickups
+ * read as TILE_EMPTY. Rows are max_width apart, so every level of the set fits.
+ */
+void write_observation(game_ctx_t* ctx, uint8_t* observation) {
+	const short width = ctx->def_vals.level_set.max_width;
+
+	if (ctx->def_vals.window_width != width || ctx->def_vals.window_height != ctx->def_vals.level_set.max_height) {
+		memset(observation, TILE_EMPTY, get_observation_size(ctx));
+	}
+
+	for (int i = 0; i < ctx->def_vals.window_height; i++) {
+		uint8_t* row = observation + i * width;
+		uint32_t walls = ctx->def_vals.level->walls[i];
+		uint32_t points = ctx->state.active_points[i];
+		uint32_t energizers = ctx->state.active_energizers[i];
+		uint32_t hearts = ctx->state.active_hearts[i];
+
+		for (int j = 0; j < ctx->def_vals.window_width; j++) {
+			row[j] = (walls >> j) & 1 ? TILE_WALL
+				: (points >> j) & 1 ? TILE_POINT
+				: (energizers >> j) & 1 ? TILE_ENERGIZER
+				: (hearts >> j) & 1 ? TILE_HEART
+				: TILE_EMPTY;
+		}
+	}
+
+	for (int i = 0; i < ctx->def_vals.window_height; i++) {
+		for (uint32_t row = ctx->state.ghosts.occupied[i]; row != 0; row &= row - 1) {
+			short x = 0;
+			while (!((row >> x) & 1)) x++;
+			observation[i * width + x] = get_tile_type(ctx, (vector_2d_t){ .x = x, .y = i });
+		}
+	}
+
+	vector_2d_t pacman_pos = ctx->state.pacman.entity_state.pos;
+	observation[pacman_pos.y * width + pacman_pos.x] = TILE_PACMAN;
+}
+
+void save_game_snapshot(game_ctx_t* ctx, game_snapshot_t* snapshot) {
+	const ghosts_t* ghosts = &ctx->state.ghosts;
+
+	if (snapshot->ghost_arena_size != ghosts->arena_size) {
+		free(snapshot->ghost_arena);
+		snapshot->ghost_arena = malloc(ghosts->arena_size);
+		snapshot->ghost_arena_size = ghosts->arena_size;
+
+		if (snapshot->ghost_arena == NULL) {
+			cleanup(ctx);
+			exit(-1);
+		}
+	}
+
+	snapshot->current_tick = ctx->time.current_tick;
+	snapshot->next_tick = ctx->time.next_tick;
+	snapshot->is_running = ctx->is_running;
+	memcpy(&snapshot->state, &ctx->state, sizeof(game_state_t));
+	memcpy(snapshot->ghost_arena, ghosts->arena, ghosts->arena_size);
+}
+
+void restore_game_snapshot(game_ctx_t* ctx, const game_snapshot_t* snapshot) {
+	vector_2d_t* pending_tile_updates = ctx->state.pending_tile_updates;
+	ghosts_t ghosts = ctx->state.ghosts;
+
+	ctx->time.current_tick = snapshot->current_tick;
+	ctx->time.next_tick = snapshot->next_tick;
+	ctx->is_running = snapshot->is_running;
+	memcpy(&ctx->state, &snapshot->state, sizeof(game_state_t));
+	memcpy(ghosts.arena, snapshot->ghost_arena, ghosts.arena_size);
+
+	ctx->state.pending_tile_updates = pending_tile_updates;
+	ctx->state.ghosts = ghosts;
+	ctx->state.num_pending_tile_updates = 0;
+	ctx->state.is_redraw_pending = 1;
+
+	/* The snapshot may be from another level of the set. */
+	select_level(ctx, ctx->state.level);
+}
+
+void free_game_snapshot(game_snapshot_t* snapshot) {
+	free(snapshot->ghost_arena);
+	snapshot->ghost_arena = NULL;
+	snapshot->ghost_arena_size = 0;
+}
+
+/*
+ * A ghost's state ends on its timer: the house 6 s after it was eaten, scatter
+ * and chase after durations set by the cycles completed and the level, and
+ * frightened time after 6 s. A state that lasts for good leaves no timer.
+ */
+#define GHOST_EATEN_SECONDS 6
+#define GHOST_FRIGHTENED_SECONDS 6
+
+static short get_scatter_duration_s(game_ctx_t* ctx, short cycles_completed) {
+	switch (cycles_completed)
+	{
+	case 0:
+	case 1:
+		return 7 / ctx->state.level_multiplier;
+	case 2:
+	case 3:
+		return 5 / ctx->state.level_multiplier;
+	default:
+		return 0;
+	}
+}
+
+static short get_chase_duration_s(short cycles_completed) {
+	return cycles_completed <= 2 ? 20 : 0;
+}
+
+/*
+ * Frightened time running out does not end frightened: the ghost stays so
+ * until eaten or frightened again, and on every tick from then on its scatter
+ * and chase times move back by how long it has been frightened. Rather than
+ * adding that on each tick, this is the sum over the ticks from
+ * frightened_expired to now, wrapping as the additions would.
+ */
+static int get_frightened_overrun(game_ctx_t* ctx, int ghost) {
+	const ghosts_t* ghosts = &ctx->state.ghosts;
+	if (ghosts->frightened_expired[ghost].tick == -1) return 0;
+
+	uint64_t num_ticks = (uint64_t)((ctx->time.current_tick - ghosts->frightened_expired[ghost].tick) / ctx->def_vals.skip_ticks + 1);
+	uint32_t first = (uint32_t)(ghosts->frightened_expired[ghost].tick - ghosts->last_frightened[ghost].tick);
+	return (int)(uint32_t)(num_ticks * first + ctx->def_vals.skip_ticks * (num_ticks * (num_ticks - 1) / 2));
+}
+
+static int add_ticks(int tick, int ticks) {
+	return (int)((uint32_t)tick + (uint32_t)ticks);
+}
+
+static void settle_frightened_overrun(game_ctx_t* ctx, int ghost) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	int overrun = get_frightened_overrun(ctx, ghost);
+
+	ghosts->last_scatter[ghost].tick = add_ticks(ghosts->last_scatter[ghost].tick, overrun);
+	ghosts->last_chase[ghost].tick = add_ticks(ghosts->last_chase[ghost].tick, overrun);
+	ghosts->frightened_expired[ghost].tick = -1;
+}
+
+/* Called whenever a ghost enters a state; replaces the timer for the one it left. */
+static void schedule_ghost_state_end(game_ctx_t* ctx, int ghost) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	const short cycles_completed = ghosts->state_cycles_completed[ghost];
+	const int ticks_per_second = ctx->def_vals.ticks_per_second;
+	int due = -1;
+
+	switch (ghosts->state[ghost])
+	{
+	case STATE_NONE:
+		if (ghosts->last_eaten[ghost].tick != -1) due = ghosts->last_eaten[ghost].tick + GHOST_EATEN_SECONDS * ticks_per_second + 1;
+		break;
+	case STATE_SCATTER:
+		if (get_scatter_duration_s(ctx, cycles_completed) > 0) due = ghosts->last_scatter[ghost].tick + get_scatter_duration_s(ctx, cycles_completed) * ticks_per_second;
+		break;
+	case STATE_CHASE:
+		if (get_chase_duration_s(cycles_completed) > 0) due = ghosts->last_chase[ghost].tick + get_chase_duration_s(cycles_completed) * ticks_per_second;
+		break;
+	case STATE_FRIGHTENED:
+		due = ghosts->last_frightened[ghost].tick + GHOST_FRIGHTENED_SECONDS * ticks_per_second + 1;
+		break;
+	default:
+		break;
+	}
+
+	if (due == -1) cancel_timer(&ctx->state.timer_wheel, ghosts->timers, ghost);
+	else schedule_timer(&ctx->state.timer_wheel, ghosts->timers, ghost, due);
+}
+
+static void release_ghost(game_ctx_t* ctx, int ghost) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	ghosts->state[ghost] = STATE_SCATTER;
+	ghosts->last_scatter[ghost].tick = ctx->time.current_tick;
+	schedule_ghost_state_end(ctx, ghost);
+}
+
+/* Fired by the timer wheel; leaving scatter or chase turns the ghost around. */
+static void end_ghost_state(void* arg, int ghost) {
+	game_ctx_t* ctx = (game_ctx_t*)arg;
+	ghosts_t* ghosts = &ctx->state.ghosts;
+
+	switch (ghosts->state[ghost])
+	{
+	case STATE_NONE:
+		release_ghost(ctx, ghost);
+		break;
+	case STATE_SCATTER:
+		ghosts->state[ghost] = STATE_CHASE;
+		ghosts->last_chase[ghost].tick = ctx->time.current_tick;
+		ghosts->dir[ghost] = reverse_dir(ghosts->dir[ghost]);
+		schedule_ghost_state_end(ctx, ghost);
+		break;
+	case STATE_CHASE:
+		ghosts->state[ghost] = STATE_SCATTER;
+		ghosts->last_scatter[ghost].tick = ctx->time.current_tick;
+		ghosts->state_cycles_completed[ghost]++;
+		ghosts->dir[ghost] = reverse_dir(ghosts->dir[ghost]);
+		schedule_ghost_state_end(ctx, ghost);
+		break;
+	case STATE_FRIGHTENED:
+		ghosts->frightened_expired[ghost].tick = ctx->time.current_tick;
+		break;
+	default:
+		break;
+	}
+}
+
+/* The ghosts never let out since the level began; release_score becomes the lowest threshold left. */
+static void release_waiting_ghosts(game_ctx_t* ctx) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	int release_score = INT_MAX;
+
+	for (int i = 0; i < ghosts->count; i++) {
+		if (ghosts->state[i] != STATE_NONE || ghosts->last_eaten[i].tick != -1) continue;
+
+		if (ghosts->release_threshold[i] <= ctx->state.score) release_ghost(ctx, i);
+		else if (ghosts->release_threshold[i] < release_score) release_score = ghosts->release_threshold[i];
+	}
+	ctx->state.release_score = release_score;
+}
+
+/* Only ghosts whose state ends on this tick are touched. */
+static void update_ghost_states(game_ctx_t* ctx) {
+	advance_timer_wheel(&ctx->state.timer_wheel, ctx->state.ghosts.timers, ctx->time.current_tick, end_ghost_state, ctx);
+	if (ctx->state.score >= ctx->state.release_score) release_waiting_ghosts(ctx);
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+#define HASH_FIELD(hash, field) hash = hash_bytes(hash, &(field), sizeof(field))
+
+uint64_t get_state_hash(game_ctx_t* ctx) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	HASH_FIELD(hash, ctx->time.next_tick.tick);
+	HASH_FIELD(hash, ctx->state.score);
+	HASH_FIELD(hash, ctx->state.num_lives);
+	HASH_FIELD(hash, ctx->state.level);
+	HASH_FIELD(hash, ctx->state.xorshift);
+	HASH_FIELD(hash, ctx->state.remaining_point_tiles);
+	HASH_FIELD(hash, ctx->state.pacman.entity_state.pos);
+	HASH_FIELD(hash, ctx->state.pacman.entity_state.dir);
+
+	const ghosts_t* ghosts = &ctx->state.ghosts;
+	for (int i = 0; i < ghosts->count; i++) {
+		HASH_FIELD(hash, ghosts->pos[i]);
+		HASH_FIELD(hash, ghosts->dir[i]);
+		HASH_FIELD(hash, ghosts->state[i]);
+		HASH_FIELD(hash, ghosts->target[i]);
+		HASH_FIELD(hash, ghosts->release_threshold[i]);
+		HASH_FIELD(hash, ghosts->last_frightened[i].tick);
+		HASH_FIELD(hash, ghosts->last_eaten[i].tick);
+
+		int overrun = get_frightened_overrun(ctx, i);
+		int last_chase = add_ticks(ghosts->last_chase[i].tick, overrun);
+		int last_scatter = add_ticks(ghosts->last_scatter[i].tick, overrun);
+		HASH_FIELD(hash, last_chase);
+		HASH_FIELD(hash, last_scatter);
+		HASH_FIELD(hash, ghosts->state_cycles_completed[i]);
+	}
+
+	for (short y = 0; y < ctx->def_vals.window_height; y++) {
+		HASH_FIELD(hash, ctx->state.active_points[y]);
+		HASH_FIELD(hash, ctx->state.active_energizers[y]);
+		HASH_FIELD(hash, ctx->state.active_hearts[y]);
+	}
+	return hash;
+}
+
+uint64_t get_level_set_hash(const level_set_t* level_set) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (int i = 0; i < level_set->num_levels; i++) HASH_FIELD(hash, level_set->levels[i]);
+	return hash;
+}
+
+static void frighten_ghosts(game_ctx_t* ctx) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	for (int i = 0; i < ghosts->count; i++) {
+		if (ghosts->state[i] == STATE_NONE) continue;
+		if (ghosts->state[i] == STATE_SCATTER || ghosts->state[i] == STATE_CHASE)
+			ghosts->dir[i] = reverse_dir(ghosts->dir[i]);
+
+		settle_frightened_overrun(ctx, i);
+		ghosts->state[i] = STATE_FRIGHTENED;
+		ghosts->last_frightened[i].tick = ctx->time.current_tick;
+		schedule_ghost_state_end(ctx, i);
+	}
+}
+
+static void eat_ghost(game_ctx_t* ctx, int ghost) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	settle_frightened_overrun(ctx, ghost);
+	ghosts->state[ghost] = STATE_NONE;
+	ghosts->dir[ghost] = ctx->def_vals.dirs[DIR_NONE];
+	move_ghost(ctx, ghost, ctx->def_vals.level->ghost_home_pos[get_ghost_type(ghost)]);
+	ghosts->last_eaten[ghost].tick = ctx->time.current_tick;
+	schedule_ghost_state_end(ctx, ghost);
+	ctx->state.score += 10;
+}
+
+/* Pacman meets every ghost on the tile: any one that is not frightened costs a life, otherwise all are eaten. */
+static short check_pacman_ghost_collisions(game_ctx_t* ctx, vector_2d_t new_pos) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	short ghost = ghosts->tile_ghosts[get_tile_index(new_pos)];
+
+	for (short i = ghost; i >= 0; i = ghosts->next_ghost[i]) {
+		if (ghosts->state[i] != STATE_FRIGHTENED) return -1;
+	}
+
+	while (ghost >= 0) {
+		short next = ghosts->next_ghost[ghost];
+		eat_ghost(ctx, ghost);
+		ghost = next;
+	}
+	return 1;
+}
+
+static short check_pacman_collisions(game_ctx_t* ctx, vector_2d_t new_pos) {
+	if (test_tile_bit(ctx->state.ghosts.occupied, new_pos)) return check_pacman_ghost_collisions(ctx, new_pos);
+
+	switch (get_tile_type(ctx, new_pos))
+	{
+	case TILE_WALL:
+		return 2;
+		break;
+	case TILE_POINT:
+		if (test_tile_bit(ctx->state.active_points, new_pos)) {
+			clear_tile_bit(ctx->state.active_points, new_pos);
+			return 1;
+		}
+		break;
+	case TILE_ENERGIZER:
+		if (test_tile_bit(ctx->state.active_energizers, new_pos)) {
+			clear_tile_bit(ctx->state.active_energizers, new_pos);
+			frighten_ghosts(ctx);
+			return 1;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static void update_pacman_pos(game_ctx_t* ctx, vector_2d_t new_pos) {
+	add_pending_tile_update(ctx, ctx->state.pacman.entity_state.pos);
+	ctx->state.pacman.entity_state.pos = new_pos;
+	add_pending_tile_update(ctx, new_pos);
+}
+
+static void pacman_lose_life(game_ctx_t* ctx) {
+	if (ctx->state.num_lives == 0) {
+		ctx->is_running = 0;
+		return;
+	}
+
+	ctx->state.num_lives--;
+	vector_2d_t tile_pos = ctx->def_vals.level->heart_tiles_pos[ctx->state.num_lives];
+	clear_tile_bit(ctx->state.active_hearts, tile_pos);
+	add_pending_tile_update(ctx, tile_pos);
+
+	if (ctx->state.num_lives == 0) {
+		ctx->is_running = 0;
+		return;
+	}
+
+	update_pacman_pos(ctx, ctx->def_vals.level->pacman_start_pos);
+}
+
+void update_pacman(game_ctx_t* ctx) {
+	vector_2d_t new_pos = vector_2d_add(ctx->state.pacman.entity_state.pos, ctx->state.pacman.entity_state.dir);
+	new_pos = clamp_vector_2d(new_pos, 0, ctx->def_vals.window_width - 1, 0, ctx->def_vals.window_height - 1);
+
+	short collision_result = check_pacman_collisions(ctx, new_pos);
+
+	if (collision_result == 2) {
+		return;
+	}
+	else if (collision_result == 1) {
+		ctx->state.score++;
+		ctx->state.remaining_point_tiles = count_remaining_point_tiles(ctx);
+
+		if (ctx->state.remaining_point_tiles == 0) {
+			init_level(ctx, ctx->state.level + 1);
+			ctx->state.is_redraw_pending = 1;
+			return;
+		}
+	}
+	else if (collision_result == -1) {
+		pacman_lose_life(ctx);
+		return;
+	}
+	
+	update_pacman_pos(ctx, new_pos);
+}
+
+static void update_ghost_target(game_ctx_t* ctx, int ghost) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	entity_state_t pacman_state = ctx->state.pacman.entity_state;
+
+	vector_2d_t curr_pos = ghosts->pos[ghost];
+
+	const level_t* level = ctx->def_vals.level;
+	if (curr_pos.x >= level->ghost_house_min.x && curr_pos.x <= level->ghost_house_max.x && curr_pos.y >= level->ghost_house_min.y && curr_pos.y <= level->ghost_house_max.y) {
+		ghosts->target[ghost] = level->ghost_house_exit;
+		return;
+	}
+
+	switch (ghosts->state[ghost])
+	{
+	case STATE_SCATTER:
+		ghosts->target[ghost] = ctx->def_vals.level->ghost_scatter_target_pos[get_ghost_type(ghost)];
+		break;
+	case STATE_CHASE:
+		switch (get_ghost_type(ghost)) {
+		case GHOST_BLINKY:
+			ghosts->target[ghost] = pacman_state.pos;
+			break;
+		case GHOST_PINKY:
+			ghosts->target[ghost] = vector_2d_add(pacman_state.pos, vector_2d_mul_scalar(pacman_state.dir, 4));
+			break;
+		case GHOST_INKY:
+		{
+			/* Inky works off the Blinky of its own group of four. */
+			vector_2d_t blinky_pos = ghosts->pos[ghost - GHOST_INKY + GHOST_BLINKY];
+			vector_2d_t p = vector_2d_add(pacman_state.pos, vector_2d_mul_scalar(pacman_state.dir, 2));
+			vector_2d_t d = vector_2d_sub(p, blinky_pos);
+			ghosts->target[ghost] = vector_2d_add(blinky_pos, vector_2d_mul_scalar(d, 4));
+		}
+		break;
+		case GHOST_CLYDE:
+			if (vector_2d_euclidean_distance(ghosts->pos[ghost], pacman_state.pos) > 64)
+				ghosts->target[ghost] = pacman_state.pos;
+			else
+				ghosts->target[ghost] = ctx->def_vals.level->ghost_scatter_target_pos[GHOST_CLYDE];
+		default:
+			break;
+		}
+	case STATE_FRIGHTENED:
+		ghosts->target[ghost] = gen_random_target(ctx, ghost);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Runs no collision: hitting pacman is only resolved once every ghost has stepped. */
+static short test_ghost_move(game_ctx_t* ctx, int ghost, vector_2d_t new_pos) {
+	if (test_tile_bit(ctx->def_vals.level->walls, new_pos)) return 2;
+
+	if (vector_2d_eq(ctx->state.pacman.entity_state.pos, new_pos)) {
+		return ctx->state.ghosts.state[ghost] == STATE_FRIGHTENED ? -1 : 1;
+	}
+	return 0;
+}
+
+/*
+ * Targets stay within a few board lengths of the board, far inside
+ * GHOST_DIR_MAX_COORD, so any kernel picks what the scalar loop would.
+ */
+static void queue_ghost_dir_choice(ghost_dir_block_t* block, int ghost, vector_2d_t target, int32_t mask) {
+	block->ghosts[block->count] = ghost;
+	block->targets[block->count] = target;
+	block->masks[block->count] = mask;
+	block->count++;
+}
+
+/* Ghosts only turn once a block is full or their range is done, which no other ghost's step can tell. */
+static void apply_ghost_dir_choices(game_ctx_t* ctx, ghost_dir_block_t* block) {
+	if (block->count == 0) return;
+
+	select_ghost_dirs(block);
+	for (int i = 0; i < block->count; i++) {
+		if (block->dirs[i] != DIR_NONE) ctx->state.ghosts.dir[block->ghosts[i]] = ctx->def_vals.dirs[block->dirs[i]];
+	}
+	block->count = 0;
+}
+
+static void choose_ghost_dir(game_ctx_t* ctx, ghost_dir_block_t* block, int ghost, vector_2d_t pos) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	vector_2d_t original_dir_reverse = reverse_dir(ghosts->dir[ghost]);
+	int32_t mask = 0;
+	int32_t reverse_mask = 0;
+
+	for (dir_t i = 0; i < DIR_NONE; i++) {
+		vector_2d_t dir = ctx->def_vals.dirs[i];
+		vector_2d_t test_pos = vector_2d_add(pos, vector_2d_mul_scalar(dir, ctx->state.level_multiplier));
+		test_pos = clamp_vector_2d(test_pos, 0, ctx->def_vals.window_width - 1, 0, ctx->def_vals.window_height - 1);
+		block->candidates[i][block->count] = test_pos;
+
+		if (is_redzone(ctx, pos) && (i == DIR_UP)) continue;
+
+		short test_move_result = test_ghost_move(ctx, ghost, test_pos);
+		if (test_move_result == -1 || test_move_result == 2) continue;
+
+		if (vector_2d_eq(original_dir_reverse, dir)) reverse_mask = 1 << i;
+		else mask |= 1 << i;
+	}
+
+	/* A dead end is the one place a ghost turns back. */
+	if (mask == 0) mask = reverse_mask;
+
+	queue_ghost_dir_choice(block, ghost, ghosts->target[ghost], mask);
+}
+
+/*
+ * Single-tile steps can read the candidate moves straight off the nav graph:
+ * inside a corridor there is only one way on and no distance to compare.
+ * Returns 0 when the generic path has to decide instead, i.e. when a candidate
+ * tile holds pacman, which frightened ghosts must steer around.
+ */
+static short choose_ghost_dir_nav(game_ctx_t* ctx, ghost_dir_block_t* block, int ghost, vector_2d_t pos) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	uint8_t exits = get_exit_mask(ctx, pos);
+	uint8_t candidates = exits & ~(1u << get_reverse_dir_index(get_dir_index(ctx, ghosts->dir[ghost])));
+	if (candidates == 0) candidates = exits;
+
+	for (dir_t d = 0; d < DIR_NONE; d++) {
+		if ((candidates >> d) & 1 && vector_2d_eq(ctx->state.pacman.entity_state.pos, get_neighbour_tile(ctx, pos, d))) return 0;
+	}
+
+	if (candidates == 0) return 1;
+
+	if (count_exits(candidates) == 1) {
+		dir_t d = 0;
+		while (!((candidates >> d) & 1)) d++;
+		ghosts->dir[ghost] = ctx->def_vals.dirs[d];
+		return 1;
+	}
+
+	if (ctx->def_vals.paths.mode != GHOST_TARGETING_GREEDY) {
+		dir_t d = get_ghost_path_dir(&ctx->def_vals.paths, pos, ghosts->target[ghost], candidates);
+		if (d != DIR_NONE) {
+			ghosts->dir[ghost] = ctx->def_vals.dirs[d];
+			return 1;
+		}
+	}
+
+	for (dir_t d = 0; d < DIR_NONE; d++) block->candidates[d][block->count] = get_neighbour_tile(ctx, pos, d);
+	queue_ghost_dir_choice(block, ghost, ghosts->target[ghost], candidates);
+	return 1;
+}
+
+static void update_ghost_pos(game_ctx_t* ctx, ghost_dir_block_t* block, int ghost) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	ghosts->next_pos[ghost] = ghosts->pos[ghost];
+	if (ghosts->state[ghost] == STATE_NONE) return;
+
+	update_ghost_target(ctx, ghost);
+
+	vector_2d_t new_pos = vector_2d_add(ghosts->pos[ghost], vector_2d_mul_scalar(ghosts->dir[ghost], ctx->state.level_multiplier));
+	new_pos = clamp_vector_2d(new_pos, 0, ctx->def_vals.window_width - 1, 0, ctx->def_vals.window_height - 1);
+
+	short move_result = test_ghost_move(ctx, ghost, new_pos);
+
+	/* A ghost that turned on this tile and then reversed faces a wall; it picks a way on where it stands. */
+	if (move_result == 2) new_pos = ghosts->pos[ghost];
+	else ghosts->next_pos[ghost] = new_pos;
+	if (move_result == -1) return;
+
+	if ((short)ctx->state.level_multiplier == 1 && choose_ghost_dir_nav(ctx, block, ghost, new_pos)) return;
+
+	choose_ghost_dir(ctx, block, ghost, new_pos);
+}
+
+static void step_ghosts(game_ctx_t* ctx, int begin, int end) {
+	ghost_dir_block_t block;
+	block.count = 0;
+
+	for (int i = begin; i < end; i++) {
+		TRACE_SPAN_ARG("update_ghost_pos", "ghost", i, update_ghost_pos(ctx, &block, i));
+		if (block.count == GHOST_DIR_BLOCK) apply_ghost_dir_choices(ctx, &block);
+	}
+	apply_ghost_dir_choices(ctx, &block);
+}
+
+/* Pacman is wherever the ghosts before this one left it, so the first ghost to reach it decides. */
+static void resolve_ghost_move(game_ctx_t* ctx, int ghost) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+	vector_2d_t new_pos = ghosts->next_pos[ghost];
+
+	if (ghosts->state[ghost] != STATE_NONE && vector_2d_eq(ctx->state.pacman.entity_state.pos, new_pos)) {
+		if (ghosts->state[ghost] == STATE_FRIGHTENED) {
+			eat_ghost(ctx, ghost);
+			return;
+		}
+
+		move_ghost(ctx, ghost, new_pos);
+		pacman_lose_life(ctx);
+		return;
+	}
+
+	move_ghost(ctx, ghost, new_pos);
+}
+
+/*
+ * Ghosts whose state ends on this tick change it first, as their timers fire.
+ * Then two phases, so the outcome does not depend on the order ghosts are
+ * handled in. First each ghost steps on its own: it updates its own fields and writes
+ * where it is headed to next_pos, seeing the other ghosts only through pos,
+ * which holds where they stood when the tick began. With a parallel runner set
+ * and enough ghosts, the steps are spread over its threads; distance fields
+ * are built into a shared cache on demand, so that mode always steps on one
+ * thread. Then, one ghost after another in index order, the moves are
+ * committed and whatever runs into pacman is resolved. Each ghost costs the
+ * same whatever the others do, so a tick is linear in the number of ghosts.
+ */
+void update_ghosts(game_ctx_t* ctx) {
+	ghosts_t* ghosts = &ctx->state.ghosts;
+
+	TRACE_SPAN("update_ghost_states", update_ghost_states(ctx));
+
+	if (ctx->def_vals.run_parallel != NULL && ghosts->count >= MIN_PARALLEL_GHOSTS && ctx->def_vals.paths.mode != GHOST_TARGETING_DISTANCE_FIELD) {
+		ctx->def_vals.run_parallel(ctx->def_vals.parallel_pool, ctx, step_ghosts, ghosts->count);
+	}
+	else step_ghosts(ctx, 0, ghosts->count);
+
+	TRACE_SPAN("resolve_ghost_moves", for (int i = 0; i < ghosts->count; i++) resolve_ghost_move(ctx, i));
+
+	xorshift32(ctx);
+}
+
+#define PROFILE_PHASE(ctx, phase, call) do { \
+	if ((ctx)->profile.is_sampling) { \
+		long long phase_start_ns = get_time_ns(); \
+		call; \
+		(ctx)->profile.ns[phase] += get_time_ns() - phase_start_ns; \
+	} \
+	else call; \
+} while (0)
+
+void on_game_tick(game_ctx_t* ctx) {
+	PROFILE_PHASE(ctx, PHASE_UPDATE_GHOSTS, TRACE_SPAN("update_ghosts", update_ghosts(ctx)));
+	PROFILE_PHASE(ctx, PHASE_UPDATE_PACMAN, TRACE_SPAN("update_pacman", update_pacman(ctx)));
+}
+
+void step_game_tick(game_ctx_t* ctx) {
+	ctx->time.current_tick = ctx->time.next_tick.tick;
+	TRACE_SPAN_ARG("on_game_tick", "tick", ctx->time.current_tick, on_game_tick(ctx));
+	ctx->time.next_tick.tick += ctx->def_vals.skip_ticks;
+}
@@ -0,0 +1,396 @@
+#ifndef PACMAN_GAME_H
+#define PACMAN_GAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pacman_timers.h"
+
+typedef enum {
+	DIR_UP,
+	DIR_DOWN,
+	DIR_LEFT,
+	DIR_RIGHT,
+	DIR_NONE,
+	NUM_DIRS
+} dir_t;
+
+typedef enum {
+	GHOST_BLINKY,
+	GHOST_PINKY,
+	GHOST_INKY,
+	GHOST_CLYDE,
+	NUM_GHOSTS
+} ghost_type_t;
+
+typedef enum {
+	STATE_NONE,
+	STATE_CHASE,
+	STATE_SCATTER,
+	STATE_FRIGHTENED,
+	NUM_STATES
+} ghost_state_t;
+
+typedef enum {
+	TILE_EMPTY,
+	TILE_GHOST_BLINKY,
+	TILE_GHOST_PINKY,
+	TILE_GHOST_INKY,
+	TILE_GHOST_CLYDE,
+	TILE_PACMAN,
+	TILE_WALL,
+	TILE_POINT,
+	TILE_ENERGIZER,
+	TILE_HEART
+} tile_type_t;
+
+typedef enum {
+	GHOST_TARGETING_GREEDY,
+	GHOST_TARGETING_PATH_TABLE,
+	GHOST_TARGETING_DISTANCE_FIELD
+} ghost_targeting_t;
+
+typedef struct {
+	int tick;
+} event_t;
+
+typedef struct {
+	short x;
+	short y;
+} vector_2d_t;
+
+#define MAX_BOARD_WIDTH 32
+#define MAX_BOARD_HEIGHT 36
+#define MAX_PACMAN_LIVES 8
+
+/* Ghost indices are shorts, with -1 ending the per-tile lists. */
+#define MAX_GHOSTS 8192
+/* Below this, handing ghosts to other threads costs more than it saves. */
+#define MIN_PARALLEL_GHOSTS 256
+
+/* One bit per tile, bit x of word y; boards are at most 32 tiles wide. */
+typedef uint32_t bitboard_t[MAX_BOARD_HEIGHT];
+
+/*
+ * Built once per map, when the level is compiled. exits[dir] marks the tiles a
+ * ghost may leave in that direction, with the no-up redzones applied, so a
+ * ghost in a corridor reads its one way on straight off the masks and only
+ * compares distances where it has a choice.
+ */
+typedef struct {
+	bitboard_t exits[DIR_NONE];
+	bitboard_t reachable;
+} nav_graph_t;
+
+/* A next-hop table of N nodes takes N * N / 4 bytes plus N * N / 8 for its no-path bits, so this caps it at 1.5 MB. */
+#define MAX_PATH_TABLE_NODES 2048
+#define NUM_DISTANCE_FIELDS 64
+
+/*
+ * Shortest paths between the reachable tiles of the nav graph, for the
+ * non-greedy ghost targeting modes. The path table keeps the first step from
+ * every node toward every other node, 2 bits each, and a bit for each pair
+ * with no path at all, where ghosts fall back to greedy; maps with more than
+ * MAX_PATH_TABLE_NODES nodes fall back to distance fields, computed per
+ * target tile on demand and kept in a small round-robin cache.
+ *
+ * A ghost_path_graph_t is built once per map and mode and shared read-only by
+ * every game on that map; only the distance-field cache, which lookups fill
+ * in, is kept per game in its ghost_paths_t.
+ */
+typedef struct {
+	ghost_targeting_t targeting;
+	ghost_targeting_t mode;
+	const nav_graph_t* nav;
+	short num_nodes;
+	short width;
+	short height;
+
+	short* tile_nodes;
+	vector_2d_t* node_pos;
+	short (*node_exits)[DIR_NONE];
+	short (*node_entries)[DIR_NONE];
+	uint8_t* next_hops;
+	uint8_t* no_paths;
+
+	long long build_ns;
+} ghost_path_graph_t;
+
+typedef struct {
+	ghost_targeting_t mode;
+	const ghost_path_graph_t* graph;
+
+	short* queue;
+	uint16_t* fields;
+	short* node_fields;
+	short field_targets[NUM_DISTANCE_FIELDS];
+	int next_field;
+	long long num_field_lookups;
+	long long num_field_builds;
+} ghost_paths_t;
+
+#define MAX_LEVEL_REDZONES 8
+
+/*
+ * A level as written by hand: width * height tile characters ('#' wall,
+ * '.' point, '@' energizer, 'o' heart, anything else empty) plus where
+ * everything starts. Ghosts begin at their spawn and go back home when eaten;
+ * while inside the house bounds they head for its exit. Ghosts may not turn
+ * up on redzone rows, between min_x and max_x.
+ */
+typedef struct {
+	short width;
+	short height;
+	const char* tiles;
+
+	vector_2d_t pacman_start_pos;
+	vector_2d_t ghost_spawn_pos[NUM_GHOSTS];
+	vector_2d_t ghost_home_pos[NUM_GHOSTS];
+	vector_2d_t ghost_scatter_target_pos[NUM_GHOSTS];
+
+	vector_2d_t ghost_house_min;
+	vector_2d_t ghost_house_max;
+	vector_2d_t ghost_house_exit;
+
+	short num_redzones;
+	struct {
+		short y;
+		short min_x;
+		short max_x;
+	} redzones[MAX_LEVEL_REDZONES];
+} level_source_t;
+
+/*
+ * A compiled level: the source's positions, the tile layers as bitboards,
+ * the point count and the nav graph with its legal-move masks. It holds no
+ * pointers, so level packs store it as is and the game uses it in place.
+ */
+typedef struct {
+	short width;
+	short height;
+	short total_point_tiles;
+	short num_hearts;
+
+	vector_2d_t pacman_start_pos;
+	vector_2d_t ghost_spawn_pos[NUM_GHOSTS];
+	vector_2d_t ghost_home_pos[NUM_GHOSTS];
+	vector_2d_t ghost_scatter_target_pos[NUM_GHOSTS];
+	vector_2d_t ghost_house_min;
+	vector_2d_t ghost_house_max;
+	vector_2d_t ghost_house_exit;
+	vector_2d_t heart_tiles_pos[MAX_PACMAN_LIVES];
+
+	bitboard_t walls;
+	bitboard_t points;
+	bitboard_t energizers;
+	bitboard_t hearts;
+	bitboard_t redzone;
+
+	nav_graph_t nav;
+} level_t;
+
+/* The levels a game plays in order, wrapping around; max_* bound all of them. */
+typedef struct {
+	const level_t* levels;
+	int num_levels;
+	short max_width;
+	short max_height;
+} level_set_t;
+
+typedef struct {
+	vector_2d_t dir;
+	vector_2d_t pos;
+} entity_state_t;
+
+/*
+ * The ghosts as parallel arrays, one entry per ghost; ghost i has the
+ * personality (ghost_type_t)(i % NUM_GHOSTS). Every array lives in one
+ * allocation of arena_size bytes, so copying the arena copies all ghosts.
+ *
+ * Occupancy is a layer of its own rather than part of the board: the ghosts
+ * on a tile form a list headed by tile_ghosts[y * MAX_BOARD_WIDTH + x] and
+ * linked through next_ghost/prev_ghost, and occupied marks the tiles whose
+ * list is not empty. Any number of ghosts can share a tile, and moving one is
+ * an unlink and a link whatever the number of ghosts.
+ *
+ * next_pos is the second buffer for pos during update_ghosts(), so that ghosts
+ * read where the others stood at the start of the tick.
+ *
+ * timers[i] is ghost i's in the game's timer wheel, pending for the end of
+ * whatever state the ghost is in; frightened_expired is when a frightened
+ * ghost's time ran out, or -1.
+ */
+typedef struct {
+	int count;
+	size_t arena_size;
+	void* arena;
+
+	vector_2d_t* pos;
+	vector_2d_t* next_pos;
+	vector_2d_t* dir;
+	vector_2d_t* target;
+	uint8_t* state;
+
+	int* release_threshold;
+
+	event_t* last_frightened;
+	event_t* frightened_expired;
+	event_t* last_eaten;
+
+	event_t* last_chase;
+	event_t* last_scatter;
+
+	short* state_cycles_completed;
+
+	game_timer_t* timers;
+
+	uint32_t* occupied;
+	short* tile_ghosts;
+	short* next_ghost;
+	short* prev_ghost;
+} ghosts_t;
+
+typedef struct {
+	entity_state_t entity_state;
+} pacman_t;
+
+typedef enum {
+	PHASE_UPDATE_GHOSTS,
+	PHASE_UPDATE_PACMAN,
+	NUM_PHASES
+} game_phase_t;
+
+/*
+ * Everything a tick changes. Apart from the ghosts, whose arrays sit in their
+ * own arena, it is flat, so a plain copy of it and of that arena is a save
+ * state; pending_tile_updates is a scratch buffer for the renderer that
+ * snapshots leave alone.
+ */
+typedef struct {
+	int score;
+	short num_lives;
+	short level;
+	float level_multiplier;
+
+	ghosts_t ghosts;
+	pacman_t pacman;
+
+	/* Ghosts leave states when their timer fires, except the house at level start, which waits for release_score. */
+	timer_wheel_t timer_wheel;
+	int release_score;
+
+	bitboard_t active_points;
+	bitboard_t active_energizers;
+	bitboard_t active_hearts;
+
+	/* Each tile is listed once; pending_tiles is only valid while the count is not 0. */
+	vector_2d_t* pending_tile_updates;
+	int num_pending_tile_updates;
+	bitboard_t pending_tiles;
+
+	short remaining_point_tiles;
+	short is_redraw_pending;
+
+	int xorshift;
+} game_state_t;
+
+typedef struct game_ctx {
+	struct {
+		int current_tick;
+		event_t next_tick;
+
+		int late_ticks;
+		int dropped_ticks;
+	} time;
+
+	game_state_t state;
+
+	struct {
+		/* The current level, and its size. */
+		const level_t* level;
+		short window_width;
+		short window_height;
+
+		short ticks_per_second;
+		short skip_ticks;
+		short max_catchup_ticks;
+
+		vector_2d_t dirs[NUM_DIRS];
+
+		/* Chosen before init_level() and kept across levels and restarts; no levels means the built-in one. */
+		level_set_t level_set;
+		ghost_targeting_t ghost_targeting;
+		ghost_paths_t paths;
+		/* 0 means NUM_GHOSTS, one of each. */
+		int num_ghosts;
+
+		/*
+		 * Optional: runs step(ctx, begin, end) over disjoint ranges covering
+		 * [0, count), possibly at once on other threads, and returns when all
+		 * are done. update_ghosts() hands it the per-ghost steps; the result
+		 * is the same however the ranges are cut.
+		 */
+		void (*run_parallel)(void* pool, struct game_ctx* ctx, void (*step)(struct game_ctx* ctx, int begin, int end), int count);
+		void* parallel_pool;
+	} def_vals;
+
+	struct {
+		short is_sampling;
+		long long num_samples;
+		long long ns[NUM_PHASES];
+	} profile;
+
+	struct {
+		uint8_t* observation;
+		short is_done;
+		int num_episodes;
+	} env;
+
+	volatile short is_running;
+} game_ctx_t;
+
+/* Returns -1 when the source has positions outside the map and -2 when ghosts cannot get from the house exit to pacman's start. */
+int compile_level(level_t* level, const level_source_t* source);
+const level_source_t* get_builtin_level_source(void);
+
+void init_level(game_ctx_t* ctx, short level);
+void restart_game(game_ctx_t* ctx);
+void cleanup(game_ctx_t* ctx);
+
+void update_ghosts(game_ctx_t* ctx);
+void update_pacman(game_ctx_t* ctx);
+void on_game_tick(game_ctx_t* ctx);
+void step_game_tick(game_ctx_t* ctx);
+
+tile_type_t get_tile_type(game_ctx_t* ctx, vector_2d_t pos);
+char get_tile_repr(game_ctx_t* ctx, vector_2d_t pos);
+int get_observation_size(game_ctx_t* ctx);
+void write_observation(game_ctx_t* ctx, uint8_t* observation);
+
+/*
+ * Save states for rollback: a snapshot is the game state, a copy of the ghost
+ * arena and the tick it was taken on. The copy is allocated on the first save,
+ * so a zeroed snapshot is ready to use. It can be restored into any game
+ * with the same level set and number of ghosts, e.g. into clones of the game
+ * for search. Restoring one also asks for a full redraw,
+ * since any tile may have changed since.
+ */
+typedef struct {
+	int current_tick;
+	event_t next_tick;
+	short is_running;
+	game_state_t state;
+	void* ghost_arena;
+	size_t ghost_arena_size;
+} game_snapshot_t;
+
+void save_game_snapshot(game_ctx_t* ctx, game_snapshot_t* snapshot);
+void restore_game_snapshot(game_ctx_t* ctx, const game_snapshot_t* snapshot);
+void free_game_snapshot(game_snapshot_t* snapshot);
+
+/* FNV-1a over everything a tick can change, for checking that two runs ended up in the same state. */
+uint64_t get_state_hash(game_ctx_t* ctx);
+/* FNV-1a over the compiled levels, which hold no pointers, so the same set hashes the same wherever it was loaded from. */
+uint64_t get_level_set_hash(const level_set_t* level_set);
+
+#endif
@@ -0,0 +1,196 @@
+#include <stdlib.h>
+
+#include "pacman_ghost_dirs.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+const char* const ghost_dirs_kernel_names[NUM_GHOST_DIRS_KERNELS] = { "scalar", "sse2", "avx2" };
+
+static int active_kernel = -1;
+static select_ghost_dirs_t active_select = NULL;
+
+static void select_ghost_dirs_range(const vector_2d_t* const candidates[DIR_NONE], const vector_2d_t* targets, const int32_t* masks, uint8_t* dirs, int begin, int end) {
+	for (int i = begin; i < end; i++) {
+		int min_dist = GHOST_DIR_MAX_DIST;
+		dirs[i] = DIR_NONE;
+		for (dir_t d = 0; d < DIR_NONE; d++) {
+			if (!((masks[i] >> d) & 1)) continue;
+
+			int dx = candidates[d][i].x - targets[i].x;
+			int dy = candidates[d][i].y - targets[i].y;
+			if (dx * dx + dy * dy < min_dist) {
+				min_dist = dx * dx + dy * dy;
+				dirs[i] = (uint8_t)d;
+			}
+		}
+	}
+}
+
+void select_ghost_dirs_scalar(const vector_2d_t* const candidates[DIR_NONE], const vector_2d_t* targets, const int32_t* masks, uint8_t* dirs, int count) {
+	select_ghost_dirs_range(candidates, targets, masks, dirs, 0, count);
+}
+
+#ifdef HAS_X86_KERNELS
+/* Strictly smaller only, so that the first of equally close directions stays, as in the scalar loop. */
+__attribute__((target("sse2")))
+static void select_ghost_dirs_sse2(const vector_2d_t* const candidates[DIR_NONE], const vector_2d_t* targets, const int32_t* masks, uint8_t* dirs, int count) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128i target = _mm_loadu_si128((const __m128i*)(targets + i));
+		const __m128i mask = _mm_loadu_si128((const __m128i*)(masks + i));
+		__m128i best_dist = _mm_set1_epi32(GHOST_DIR_MAX_DIST);
+		__m128i best_dir = _mm_set1_epi32(DIR_NONE);
+
+		for (dir_t d = 0; d < DIR_NONE; d++) {
+			const __m128i bit = _mm_set1_epi32(1 << d);
+			__m128i diff = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(candidates[d] + i)), target);
+			__m128i dist = _mm_madd_epi16(diff, diff);
+			__m128i is_better = _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(mask, bit), bit), _mm_cmplt_epi32(dist, best_dist));
+
+			best_dist = _mm_or_si128(_mm_and_si128(is_better, dist), _mm_andnot_si128(is_better, best_dist));
+			best_dir = _mm_or_si128(_mm_and_si128(is_better, _mm_set1_epi32(d)), _mm_andnot_si128(is_better, best_dir));
+		}
+
+		int32_t lanes[4];
+		_mm_storeu_si128((__m128i*)lanes, best_dir);
+		for (int j = 0; j < 4; j++) dirs[i + j] = (uint8_t)lanes[j];
+	}
+	select_ghost_dirs_range(candidates, targets, masks, dirs, i, count);
+}
+
+__attribute__((target("avx2")))
+static void select_ghost_dirs_avx2(const vector_2d_t* const candidates[DIR_NONE], const vector_2d_t* targets, const int32_t* masks, uint8_t* dirs, int count) {
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i target = _mm256_loadu_si256((const __m256i*)(targets + i));
+		const __m256i mask = _mm256_loadu_si256((const __m256i*)(masks + i));
+		__m256i best_dist = _mm256_set1_epi32(GHOST_DIR_MAX_DIST);
+		__m256i best_dir = _mm256_set1_epi32(DIR_NONE);
+
+		for (dir_t d = 0; d < DIR_NONE; d++) {
+			const __m256i bit = _mm256_set1_epi32(1 << d);
+			__m256i diff = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(candidates[d] + i)), target);
+			__m256i dist = _mm256_madd_epi16(diff, diff);
+			__m256i is_better = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(mask, bit), bit), _mm256_cmpgt_epi32(best_dist, dist));
+
+			best_dist = _mm256_blendv_epi8(best_dist, dist, is_better);
+			best_dir = _mm256_blendv_epi8(best_dir, _mm256_set1_epi32(d), is_better);
+		}
+
+		/* Each 32-bit lane holds a direction below 256, so two packs leave them in the low 8 bytes of each half. */
+		__m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(best_dir, best_dir), _mm256_setzero_si256());
+		uint32_t low = (uint32_t)_mm256_extract_epi32(packed, 0), high = (uint32_t)_mm256_extract_epi32(packed, 4);
+		for (int j = 0; j < 4; j++) {
+			dirs[i + j] = (uint8_t)(low >> (8 * j));
+			dirs[i + 4 + j] = (uint8_t)(high >> (8 * j));
+		}
+	}
+	select_ghost_dirs_range(candidates, targets, masks, dirs, i, count);
+}
+#endif
+
+select_ghost_dirs_t get_ghost_dirs_kernel(ghost_dirs_kernel_t kernel) {
+	switch (kernel)
+	{
+	case GHOST_DIRS_SCALAR:
+		return select_ghost_dirs_scalar;
+#ifdef HAS_X86_KERNELS
+	case GHOST_DIRS_SSE2:
+		return __builtin_cpu_supports("sse2") ? select_ghost_dirs_sse2 : NULL;
+	case GHOST_DIRS_AVX2:
+		return __builtin_cpu_supports("avx2") ? select_ghost_dirs_avx2 : NULL;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+/* Resolved by the first init_level(), before any game threads start. */
+ghost_dirs_kernel_t get_active_ghost_dirs_kernel(void) {
+	if (active_kernel < 0) {
+		ghost_dirs_kernel_t kernel = NUM_GHOST_DIRS_KERNELS - 1;
+		while (get_ghost_dirs_kernel(kernel) == NULL) kernel--;
+		set_ghost_dirs_kernel(kernel);
+	}
+	return (ghost_dirs_kernel_t)active_kernel;
+}
+
+int set_ghost_dirs_kernel(ghost_dirs_kernel_t kernel) {
+	select_ghost_dirs_t select = get_ghost_dirs_kernel(kernel);
+	if (select == NULL) return -1;
+
+	active_kernel = kernel;
+	active_select = select;
+	return 0;
+}
+
+void select_ghost_dirs(ghost_dir_block_t* block) {
+	if (active_select == NULL) get_active_ghost_dirs_kernel();
+
+	const vector_2d_t* const candidates[DIR_NONE] = { block->candidates[DIR_UP], block->candidates[DIR_DOWN], block->candidates[DIR_LEFT], block->candidates[DIR_RIGHT] };
+	active_select(candidates, block->targets, block->masks, block->dirs, block->count);
+}
+
+static int check_xorshift32(int* state) {
+	int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/* Small coordinates make ties common; every eighth choice spans the whole allowed range instead. */
+static short gen_check_coord(int* state, int choice) {
+	int range = choice % 8 == 0 ? GHOST_DIR_MAX_COORD : 40;
+	return (short)((int)((unsigned int)check_xorshift32(state) % (2 * range + 1)) - range);
+}
+
+int check_ghost_dirs_kernels(int num_choices, int seed) {
+	vector_2d_t* coords = (vector_2d_t*)malloc((size_t)num_choices * (DIR_NONE + 1) * sizeof(vector_2d_t));
+	int32_t* masks = (int32_t*)malloc(num_choices * sizeof(int32_t));
+	uint8_t* expected = (uint8_t*)malloc(num_choices);
+	uint8_t* actual = (uint8_t*)malloc(num_choices);
+	if (coords == NULL || masks == NULL || expected == NULL || actual == NULL) {
+		free(coords);
+		free(masks);
+		free(expected);
+		free(actual);
+		return -1;
+	}
+
+	const vector_2d_t* candidates[DIR_NONE];
+	for (dir_t d = 0; d < DIR_NONE; d++) candidates[d] = coords + (size_t)d * num_choices;
+	vector_2d_t* targets = coords + (size_t)DIR_NONE * num_choices;
+
+	int state = seed != 0 ? seed : 1;
+	for (int i = 0; i < num_choices; i++) {
+		for (dir_t d = 0; d <= DIR_NONE; d++) {
+			coords[(size_t)d * num_choices + i] = (vector_2d_t){ .x = gen_check_coord(&state, i), .y = gen_check_coord(&state, i) };
+		}
+		masks[i] = check_xorshift32(&state) & 0xf;
+	}
+	select_ghost_dirs_scalar(candidates, targets, masks, expected, num_choices);
+
+	int num_mismatches = 0;
+	for (ghost_dirs_kernel_t kernel = GHOST_DIRS_SCALAR + 1; kernel < NUM_GHOST_DIRS_KERNELS; kernel++) {
+		select_ghost_dirs_t select = get_ghost_dirs_kernel(kernel);
+		if (select == NULL) continue;
+
+		/* Every count up to a few vectors, to cover the scalar tails, then all of them at once. */
+		for (int count = 1; count <= 24 && count <= num_choices; count++) {
+			select(candidates, targets, masks, actual, count);
+			for (int i = 0; i < count; i++) num_mismatches += actual[i] != expected[i];
+		}
+		select(candidates, targets, masks, actual, num_choices);
+		for (int i = 0; i < num_choices; i++) num_mismatches += actual[i] != expected[i];
+	}
+
+	free(coords);
+	free(masks);
+	free(expected);
+	free(actual);
+	return num_mismatches;
+}
@@ -0,0 +1,67 @@
+#ifndef PACMAN_GHOST_DIRS_H
+#define PACMAN_GHOST_DIRS_H
+
+#include <stdint.h>
+
+#include "pacman_game.h"
+
+/*
+ * The last step of a ghost's move: out of the candidate tiles it may turn to,
+ * pick the one closest to its target in a straight line. Choice i offers the
+ * tiles candidates[d][i] for the directions d set in masks[i], and dirs[i] gets
+ * the first direction, in dir_t order, with the smallest squared distance to
+ * targets[i] below GHOST_DIR_MAX_DIST, or DIR_NONE if there is none.
+ *
+ * The choices of many ghosts, from one game or from many, are laid out
+ * direction by direction so that the SSE2 and AVX2 kernels read four or eight
+ * of them per instruction: a vector_2d_t is a pair of 16-bit lanes, and one
+ * multiply-add of the differences gives each squared distance in a 32-bit
+ * lane. The kernel is picked once at runtime from what the CPU supports;
+ * every kernel returns exactly what the scalar one does, as long as all
+ * coordinates are within GHOST_DIR_MAX_COORD so that differences fit in 16
+ * bits.
+ */
+#define GHOST_DIR_MAX_DIST 100000
+#define GHOST_DIR_MAX_COORD 16383
+#define GHOST_DIR_BLOCK 64
+
+typedef enum {
+	GHOST_DIRS_SCALAR,
+	GHOST_DIRS_SSE2,
+	GHOST_DIRS_AVX2,
+	NUM_GHOST_DIRS_KERNELS
+} ghost_dirs_kernel_t;
+
+/* A block of choices for one call; ghosts[i] is whoever choice i belongs to. */
+typedef struct {
+	vector_2d_t candidates[DIR_NONE][GHOST_DIR_BLOCK];
+	vector_2d_t targets[GHOST_DIR_BLOCK];
+	int32_t masks[GHOST_DIR_BLOCK];
+	uint8_t dirs[GHOST_DIR_BLOCK];
+	int ghosts[GHOST_DIR_BLOCK];
+	int count;
+} ghost_dir_block_t;
+
+typedef void (*select_ghost_dirs_t)(const vector_2d_t* const candidates[DIR_NONE], const vector_2d_t* targets, const int32_t* masks, uint8_t* dirs, int count);
+
+extern const char* const ghost_dirs_kernel_names[NUM_GHOST_DIRS_KERNELS];
+
+void select_ghost_dirs_scalar(const vector_2d_t* const candidates[DIR_NONE], const vector_2d_t* targets, const int32_t* masks, uint8_t* dirs, int count);
+
+/* NULL if the kernel is not built for this target or the CPU lacks it. */
+select_ghost_dirs_t get_ghost_dirs_kernel(ghost_dirs_kernel_t kernel);
+
+/* The best kernel the CPU supports, unless set_ghost_dirs_kernel() asked for another. */
+ghost_dirs_kernel_t get_active_ghost_dirs_kernel(void);
+int set_ghost_dirs_kernel(ghost_dirs_kernel_t kernel);
+
+void select_ghost_dirs(ghost_dir_block_t* block);
+
+/*
+ * Runs every available kernel against the scalar one on num_choices random
+ * choices, ties and out-of-range distances included. Returns the number of
+ * mismatching choices.
+ */
+int check_ghost_dirs_kernels(int num_choices, int seed);
+
+#endif
@@ -0,0 +1,56 @@
+#include "pacman_input.h"
+
+int push_input_event(input_queue_t* queue, input_event_t event) {
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+	if (head - tail >= INPUT_QUEUE_SIZE) {
+		atomic_fetch_add_explicit(&queue->num_dropped, 1, memory_order_relaxed);
+		return -1;
+	}
+
+	queue->events[head % INPUT_QUEUE_SIZE] = event;
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	return 0;
+}
+
+static int peek_input_event(input_queue_t* queue, input_event_t* event) {
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+	if (head == tail) return 0;
+
+	*event = queue->events[tail % INPUT_QUEUE_SIZE];
+	return 1;
+}
+
+int pop_input_event(input_queue_t* queue, input_event_t* event) {
+	if (!peek_input_event(queue, event)) return 0;
+
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+	return 1;
+}
+
+void record_latency(latency_histogram_t* histogram, long long ns) {
+	long long us = ns > 0 ? ns / 1000 : 0;
+	int bucket = 0;
+	while (bucket < NUM_LATENCY_BUCKETS - 1 && us >= (1LL << bucket)) bucket++;
+
+	histogram->counts[bucket]++;
+	histogram->num_samples++;
+	if (ns > histogram->max_ns) histogram->max_ns = ns;
+}
+
+long long get_latency_percentile_us(const latency_histogram_t* histogram, double percentile) {
+	long long target = (long long)(percentile * histogram->num_samples);
+	long long seen = 0;
+
+	const long long max_us = histogram->max_ns / 1000;
+
+	for (int i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+		seen += histogram->counts[i];
+		if (seen > target) return (1LL << i) < max_us ? 1LL << i : max_us;
+	}
+	return max_us;
+}
@@ -0,0 +1,45 @@
+#ifndef PACMAN_INPUT_H
+#define PACMAN_INPUT_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define INPUT_QUEUE_SIZE 64
+#define INPUT_CACHE_LINE_SIZE 64
+#define NUM_LATENCY_BUCKETS 32
+
+typedef struct {
+	int key;
+	long long read_ns;
+	long long applied_ns;
+} input_event_t;
+
+/*
+ * Single-producer/single-consumer ring: the input thread pushes, the game
+ * loop pops at tick boundaries. head and tail live on separate cache lines so
+ * the two threads never write to the same one.
+ */
+typedef struct {
+	_Alignas(INPUT_CACHE_LINE_SIZE) atomic_uint head;
+	_Alignas(INPUT_CACHE_LINE_SIZE) atomic_uint tail;
+	_Alignas(INPUT_CACHE_LINE_SIZE) input_event_t events[INPUT_QUEUE_SIZE];
+	atomic_uint num_dropped;
+} input_queue_t;
+
+/* Power-of-two microsecond buckets: bucket i holds samples below 2^i us. */
+typedef struct {
+	long long counts[NUM_LATENCY_BUCKETS];
+	long long num_samples;
+	long long max_ns;
+} latency_histogram_t;
+
+/* Returns -1 (and counts the event as dropped) when the queue is full. */
+int push_input_event(input_queue_t* queue, input_event_t event);
+/* Returns 0 when the queue is empty. */
+int pop_input_event(input_queue_t* queue, input_event_t* event);
+
+void record_latency(latency_histogram_t* histogram, long long ns);
+/* Upper bound of the bucket holding the given percentile, in microseconds, but never above the largest sample. */
+long long get_latency_percentile_us(const latency_histogram_t* histogram, double percentile);
+
+#endif
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "pacman_level.h"
+#include "pacman_platform.h"
+
+static short is_inside(const level_t* level, vector_2d_t pos) {
+	return pos.x >= 0 && pos.x < level->width && pos.y >= 0 && pos.y < level->height;
+}
+
+/* Checks what the game indexes with: the size, the positions it puts things at and the tiles paths are built from. */
+static short is_valid_level(const level_t* level, const level_pack_header_t* header) {
+	if (level->width < 1 || level->width > header->max_width || level->height < 1 || level->height > header->max_height) return 0;
+	if (level->num_hearts < 0 || level->num_hearts > MAX_PACMAN_LIVES) return 0;
+
+	short is_valid = is_inside(level, level->pacman_start_pos) && is_inside(level, level->ghost_house_exit);
+	for (ghost_type_t type = GHOST_BLINKY; type < NUM_GHOSTS; type++) {
+		is_valid &= is_inside(level, level->ghost_spawn_pos[type]) && is_inside(level, level->ghost_home_pos[type]);
+	}
+	for (short i = 0; i < level->num_hearts; i++) is_valid &= is_inside(level, level->heart_tiles_pos[i]);
+
+	const uint32_t row_mask = level->width >= 32 ? 0xffffffffu : (1u << level->width) - 1;
+	for (short y = 0; y < level->height; y++) is_valid &= (level->nav.reachable[y] & ~row_mask) == 0;
+	return is_valid;
+}
+
+int open_level_pack(level_pack_t* pack, const char* path) {
+	memset(pack, 0, sizeof(level_pack_t));
+
+	size_t size = 0;
+	const void* data = map_file(path, &size);
+	if (data == NULL) return -1;
+
+	const level_pack_header_t* header = (const level_pack_header_t*)data;
+	short is_valid = size >= LEVEL_PACK_HEADER_SIZE
+		&& memcmp(header->magic, LEVEL_PACK_MAGIC, 4) == 0
+		&& header->version == LEVEL_PACK_VERSION
+		&& header->byte_order == LEVEL_PACK_BYTE_ORDER
+		&& header->level_size == sizeof(level_t)
+		&& header->num_levels > 0
+		&& header->levels_offset >= LEVEL_PACK_HEADER_SIZE
+		&& header->levels_offset % sizeof(uint32_t) == 0
+		&& header->levels_offset <= size
+		&& (size - header->levels_offset) / sizeof(level_t) >= header->num_levels
+		&& header->max_width > 0 && header->max_width <= MAX_BOARD_WIDTH
+		&& header->max_height > 0 && header->max_height <= MAX_BOARD_HEIGHT;
+
+	const level_t* levels = (const level_t*)((const char*)data + header->levels_offset);
+	for (uint32_t i = 0; is_valid && i < header->num_levels; i++) is_valid = is_valid_level(&levels[i], header);
+
+	if (!is_valid) {
+		unmap_file(data, size);
+		return -1;
+	}
+
+	pack->data = data;
+	pack->size = size;
+	pack->level_set = (level_set_t){
+		.levels = levels,
+		.num_levels = (int)header->num_levels,
+		.max_width = header->max_width,
+		.max_height = header->max_height
+	};
+	return 0;
+}
+
+void close_level_pack(level_pack_t* pack) {
+	if (pack->data != NULL) unmap_file(pack->data, pack->size);
+	memset(pack, 0, sizeof(level_pack_t));
+}
+
+int write_level_pack(const char* path, const level_t* levels, int num_levels) {
+	uint8_t header_bytes[LEVEL_PACK_HEADER_SIZE] = { 0 };
+	level_pack_header_t header = {
+		.version = LEVEL_PACK_VERSION,
+		.byte_order = LEVEL_PACK_BYTE_ORDER,
+		.level_size = sizeof(level_t),
+		.num_levels = (uint32_t)num_levels,
+		.levels_offset = LEVEL_PACK_HEADER_SIZE
+	};
+	memcpy(header.magic, LEVEL_PACK_MAGIC, 4);
+
+	for (int i = 0; i < num_levels; i++) {
+		if (levels[i].width > header.max_width) header.max_width = levels[i].width;
+		if (levels[i].height > header.max_height) header.max_height = levels[i].height;
+	}
+	memcpy(header_bytes, &header, sizeof(level_pack_header_t));
+
+	FILE* file = fopen(path, "wb");
+	if (file == NULL) return -1;
+
+	int result = fwrite(header_bytes, 1, LEVEL_PACK_HEADER_SIZE, file) == LEVEL_PACK_HEADER_SIZE
+		&& fwrite(levels, sizeof(level_t), num_levels, file) == (size_t)num_levels ? 0 : -1;
+	if (fclose(file) != 0) result = -1;
+	return result;
+}
@@ -0,0 +1,46 @@
+#ifndef PACMAN_LEVEL_H
+#define PACMAN_LEVEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pacman_game.h"
+
+/*
+ * Level pack: a header padded to LEVEL_PACK_HEADER_SIZE bytes, then
+ * num_levels level_t records back to back. Records are stored in the byte
+ * order and struct layout of the machine that compiled them, which the
+ * header records and open_level_pack() checks, along with each level's size
+ * and positions. As a level_t holds no pointers, the game plays straight out
+ * of the mapped file: opening a pack reads a few words per level and
+ * switching levels takes the same time whatever their number or size.
+ */
+#define LEVEL_PACK_MAGIC "PMLV"
+#define LEVEL_PACK_VERSION 2
+#define LEVEL_PACK_BYTE_ORDER 0x01020304u
+#define LEVEL_PACK_HEADER_SIZE 64
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t level_size;
+	uint32_t num_levels;
+	uint32_t levels_offset;
+	int16_t max_width;
+	int16_t max_height;
+} level_pack_header_t;
+
+typedef struct {
+	level_set_t level_set;
+	const void* data;
+	size_t size;
+} level_pack_t;
+
+/* Returns -1 if the file cannot be mapped or is not a valid pack built for this machine. */
+int open_level_pack(level_pack_t* pack, const char* path);
+void close_level_pack(level_pack_t* pack);
+
+int write_level_pack(const char* path, const level_t* levels, int num_levels);
+
+#endif
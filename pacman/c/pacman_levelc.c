@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pacman_game.h"
+#include "pacman_level.h"
+
+/*
+ * Compiles text level files into a level pack. A file holds any number of
+ * levels, each written as:
+ *
+ *   level <width> <height>
+ *   pacman <x> <y>
+ *   ghost <blinky|pinky|inky|clyde> spawn <x> <y> home <x> <y> scatter <x> <y>
+ *   house <min_x> <min_y> <max_x> <max_y> exit <x> <y>
+ *   redzone <y> <min_x> <max_x>       (optional, up to MAX_LEVEL_REDZONES)
+ *   map
+ *   <height lines of tiles, shorter ones padded with spaces>
+ *   end
+ *
+ * Lines starting with ';' outside a map are comments.
+ */
+
+static const char* ghost_names[NUM_GHOSTS] = { "blinky", "pinky", "inky", "clyde" };
+
+typedef struct {
+	const char* path;
+	int line_num;
+	char* text;
+	char* next_line;
+} level_file_t;
+
+static char* read_line(level_file_t* file) {
+	char* line = file->next_line;
+	if (line == NULL || *line == '\0') return NULL;
+
+	char* end = strchr(line, '\n');
+	if (end != NULL) {
+		*end = '\0';
+		file->next_line = end + 1;
+	}
+	else file->next_line = NULL;
+
+	size_t len = strlen(line);
+	if (len > 0 && line[len - 1] == '\r') line[len - 1] = '\0';
+
+	file->line_num++;
+	return line;
+}
+
+static int fail(level_file_t* file, const char* message) {
+	fprintf(stderr, "%s:%d: %s\n", file->path, file->line_num, message);
+	return -1;
+}
+
+static int parse_ghost(level_file_t* file, const char* line, level_source_t* source, short* has_ghost) {
+	char name[16];
+	vector_2d_t spawn, home, scatter;
+	if (sscanf(line, "ghost %15s spawn %hd %hd home %hd %hd scatter %hd %hd", name, &spawn.x, &spawn.y, &home.x, &home.y, &scatter.x, &scatter.y) != 7) {
+		return fail(file, "expected: ghost <name> spawn <x> <y> home <x> <y> scatter <x> <y>");
+	}
+
+	for (ghost_type_t type = GHOST_BLINKY; type < NUM_GHOSTS; type++) {
+		if (strcmp(name, ghost_names[type]) != 0) continue;
+		source->ghost_spawn_pos[type] = spawn;
+		source->ghost_home_pos[type] = home;
+		source->ghost_scatter_target_pos[type] = scatter;
+		has_ghost[type] = 1;
+		return 0;
+	}
+	return fail(file, "unknown ghost");
+}
+
+static int read_map(level_file_t* file, level_source_t* source, char* tiles) {
+	for (short y = 0; y < source->height; y++) {
+		char* line = read_line(file);
+		if (line == NULL) return fail(file, "map ended early");
+
+		size_t len = strlen(line);
+		if (len > (size_t)source->width) return fail(file, "map row is wider than the level");
+
+		memset(tiles + y * source->width, ' ', source->width);
+		memcpy(tiles + y * source->width, line, len);
+	}
+	return 0;
+}
+
+/* Reads the level that starts at `line`, which holds its "level" directive. */
+static int read_level(level_file_t* file, char* line, level_t* level) {
+	level_source_t source;
+	char tiles[MAX_BOARD_WIDTH * MAX_BOARD_HEIGHT];
+	short has_pacman = 0, has_house = 0, has_map = 0;
+	short has_ghost[NUM_GHOSTS] = { 0 };
+
+	memset(&source, 0, sizeof(level_source_t));
+	source.tiles = tiles;
+
+	if (sscanf(line, "level %hd %hd", &source.width, &source.height) != 2) return fail(file, "expected: level <width> <height>");
+	if (source.width < 1 || source.width > MAX_BOARD_WIDTH || source.height < 1 || source.height > MAX_BOARD_HEIGHT) return fail(file, "level size out of range");
+
+	while ((line = read_line(file)) != NULL) {
+		if (line[0] == ';' || strspn(line, " \t") == strlen(line)) continue;
+
+		if (strncmp(line, "pacman ", 7) == 0) {
+			if (sscanf(line, "pacman %hd %hd", &source.pacman_start_pos.x, &source.pacman_start_pos.y) != 2) return fail(file, "expected: pacman <x> <y>");
+			has_pacman = 1;
+		}
+		else if (strncmp(line, "ghost ", 6) == 0) {
+			if (parse_ghost(file, line, &source, has_ghost) != 0) return -1;
+		}
+		else if (strncmp(line, "house ", 6) == 0) {
+			if (sscanf(line, "house %hd %hd %hd %hd exit %hd %hd", &source.ghost_house_min.x, &source.ghost_house_min.y,
+				&source.ghost_house_max.x, &source.ghost_house_max.y, &source.ghost_house_exit.x, &source.ghost_house_exit.y) != 6) {
+				return fail(file, "expected: house <min_x> <min_y> <max_x> <max_y> exit <x> <y>");
+			}
+			has_house = 1;
+		}
+		else if (strncmp(line, "redzone ", 8) == 0) {
+			if (source.num_redzones >= MAX_LEVEL_REDZONES) return fail(file, "too many redzones");
+			if (sscanf(line, "redzone %hd %hd %hd", &source.redzones[source.num_redzones].y, &source.redzones[source.num_redzones].min_x, &source.redzones[source.num_redzones].max_x) != 3) {
+				return fail(file, "expected: redzone <y> <min_x> <max_x>");
+			}
+			source.num_redzones++;
+		}
+		else if (strcmp(line, "map") == 0) {
+			if (read_map(file, &source, tiles) != 0) return -1;
+			has_map = 1;
+		}
+		else if (strcmp(line, "end") == 0) {
+			if (!has_pacman || !has_house || !has_map) return fail(file, "level needs pacman, house and map");
+			for (ghost_type_t type = GHOST_BLINKY; type < NUM_GHOSTS; type++) {
+				if (!has_ghost[type]) return fail(file, "level needs all four ghosts");
+			}
+			int result = compile_level(level, &source);
+			if (result == -1) return fail(file, "level has positions outside the map");
+			if (result == -2) return fail(file, "redzones cut the ghost house exit off from the maze");
+			return 0;
+		}
+		else return fail(file, "unknown directive");
+	}
+	return fail(file, "level has no end");
+}
+
+static int read_level_file(const char* path, level_t** levels, int* num_levels, int* capacity) {
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) {
+		fprintf(stderr, "Error opening %s\n", path);
+		return -1;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	level_file_t file = { .path = path, .text = (char*)malloc(size + 1) };
+	if (file.text == NULL || fread(file.text, 1, size, f) != (size_t)size) {
+		fclose(f);
+		free(file.text);
+		return -1;
+	}
+	fclose(f);
+	file.text[size] = '\0';
+	file.next_line = file.text;
+
+	int result = 0;
+	char* line;
+	while (result == 0 && (line = read_line(&file)) != NULL) {
+		if (line[0] == ';' || strspn(line, " \t") == strlen(line)) continue;
+		if (strncmp(line, "level ", 6) != 0) {
+			result = fail(&file, "expected a level");
+			break;
+		}
+
+		if (*num_levels == *capacity) {
+			int new_capacity = *capacity > 0 ? *capacity * 2 : 16;
+			level_t* new_levels = (level_t*)realloc(*levels, new_capacity * sizeof(level_t));
+			if (new_levels == NULL) {
+				result = -1;
+				break;
+			}
+			*levels = new_levels;
+			*capacity = new_capacity;
+		}
+
+		result = read_level(&file, line, &(*levels)[*num_levels]);
+		if (result == 0) (*num_levels)++;
+	}
+
+	free(file.text);
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 4 || strcmp(argv[1], "-o") != 0) {
+		fprintf(stderr, "usage: %s -o <pack> <level file>...\n", argv[0]);
+		return 1;
+	}
+
+	level_t* levels = NULL;
+	int num_levels = 0;
+	int capacity = 0;
+
+	for (int i = 3; i < argc; i++) {
+		if (read_level_file(argv[i], &levels, &num_levels, &capacity) != 0) {
+			free(levels);
+			return 1;
+		}
+	}
+
+	if (num_levels == 0 || write_level_pack(argv[2], levels, num_levels) != 0) {
+		fprintf(stderr, "Error writing %s\n", argv[2]);
+		free(levels);
+		return 1;
+	}
+
+	for (int i = 0; i < num_levels; i++) {
+		printf("level %d: %dx%d, %d point tiles, %d hearts\n", i, levels[i].width, levels[i].height, levels[i].total_point_tiles, levels[i].num_hearts);
+	}
+	printf("%s: %d levels, %d bytes each\n", argv[2], num_levels, (int)sizeof(level_t));
+
+	free(levels);
+	return 0;
+}
@@ -0,0 +1,340 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "pacman_input.h"
+#include "pacman_platform.h"
+#include "pacman_server.h"
+
+/*
+ * Load generator for pacman-server (Linux only). Opens sessions in batches of
+ * CONNECT_BATCH, reading whatever has arrived in between, and once all are
+ * open measures for a fixed time: every session turns a random way every
+ * hold_frames frames, and the arrival time of each frame is compared with
+ * the one before it to get the tick jitter as the clients see it. The server
+ * sends its pid in the hello, so its CPU time is read from /proc, which gives
+ * the cores it used and the sessions per core.
+ */
+#define CONNECT_BATCH 64
+#define MAX_EPOLL_EVENTS 256
+#define CLIENT_BUFFER_SIZE (2 * MAX_SERVER_FRAME_SIZE)
+
+typedef struct {
+	int fd;
+	int in_len;
+	uint8_t in[CLIENT_BUFFER_SIZE];
+
+	long long last_frame_ns;
+	int num_frames;
+} client_t;
+
+static struct {
+	const char* socket_path;
+	int port;
+	int num_sessions;
+	int duration_s;
+	int hold_frames;
+	int xorshift;
+
+	client_t* clients;
+	int epoll_fd;
+	int num_connected;
+	int num_closed;
+
+	int server_pid;
+	long long tick_period_us;
+
+	short is_measuring;
+	long long measure_start_ns;
+	long long num_frames;
+	long long num_full_frames;
+	long long num_bytes;
+	long long num_inputs;
+	latency_histogram_t jitter;
+} loadgen = {
+	.socket_path = DEFAULT_SERVER_SOCKET_PATH,
+	.num_sessions = 1000,
+	.duration_s = 10,
+	.hold_frames = 8,
+	.xorshift = 0x2545f491,
+	.epoll_fd = -1
+};
+
+static int loadgen_xorshift32(void) {
+	int x = loadgen.xorshift;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return loadgen.xorshift = x;
+}
+
+static unsigned int get_u16(const uint8_t* data) {
+	return data[0] | (unsigned int)data[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t* data) {
+	return get_u16(data) | (uint32_t)get_u16(data + 2) << 16;
+}
+
+/* User plus system time of a process in seconds, or -1 if it cannot be read. */
+static double read_process_cpu_s(int pid) {
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+	FILE* file = fopen(path, "r");
+	if (file == NULL) return -1;
+	char stat[1024];
+	size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+	fclose(file);
+	stat[len] = '\0';
+
+	/* The command name may hold spaces and parentheses, so fields are counted from the last ')'. */
+	char* fields = strrchr(stat, ')');
+	unsigned long long utime, stime;
+	if (fields == NULL || sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) return -1;
+	return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static int connect_client(void) {
+	int fd;
+	if (loadgen.port > 0) {
+		struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)loadgen.port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+		int on = 1;
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+			if (fd >= 0) close(fd);
+			return -1;
+		}
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	}
+	else {
+		struct sockaddr_un addr = { .sun_family = AF_UNIX };
+		if (strlen(loadgen.socket_path) >= sizeof(addr.sun_path)) return -1;
+		strcpy(addr.sun_path, loadgen.socket_path);
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+			if (fd >= 0) close(fd);
+			return -1;
+		}
+	}
+
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void close_client(client_t* client) {
+	close(client->fd);
+	client->fd = -1;
+	loadgen.num_closed++;
+}
+
+static void on_frame(client_t* client, const uint8_t* frame, long long now_ns) {
+	if (frame[0] == SERVER_FRAME_HELLO) {
+		loadgen.tick_period_us = get_u32(frame + 4);
+		loadgen.server_pid = (int)get_u32(frame + 8);
+		return;
+	}
+
+	if (loadgen.is_measuring) {
+		if (client->last_frame_ns >= loadgen.measure_start_ns) {
+			long long interval_ns = now_ns - client->last_frame_ns;
+			long long period_ns = loadgen.tick_period_us * 1000;
+			record_latency(&loadgen.jitter, interval_ns > period_ns ? interval_ns - period_ns : period_ns - interval_ns);
+		}
+		loadgen.num_frames++;
+		if (frame[0] == SERVER_FRAME_FULL) loadgen.num_full_frames++;
+	}
+	client->last_frame_ns = now_ns;
+
+	if (++client->num_frames % loadgen.hold_frames == 0) {
+		uint8_t dir = (uint8_t)((unsigned int)loadgen_xorshift32() % DIR_NONE);
+		if (send(client->fd, &dir, 1, MSG_NOSIGNAL | MSG_DONTWAIT) == 1) loadgen.num_inputs++;
+	}
+}
+
+/* Reads everything there is and hands each complete frame to on_frame(). */
+static void read_client(client_t* client) {
+	const long long now_ns = get_time_ns();
+
+	while (client->fd >= 0) {
+		ssize_t num_read = recv(client->fd, client->in + client->in_len, CLIENT_BUFFER_SIZE - client->in_len, 0);
+		if (num_read < 0 && errno == EINTR) continue;
+		if (num_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+		if (num_read <= 0) {
+			close_client(client);
+			return;
+		}
+		if (loadgen.is_measuring) loadgen.num_bytes += num_read;
+		client->in_len += (int)num_read;
+
+		int offset = 0;
+		while (client->in_len - offset >= SERVER_FRAME_HEADER_SIZE) {
+			const uint8_t* frame = client->in + offset;
+			int size = SERVER_FRAME_HEADER_SIZE + (frame[0] == SERVER_FRAME_HELLO ? 0 : 2 * (int)get_u16(frame + 2));
+			if (size > MAX_SERVER_FRAME_SIZE) {
+				close_client(client);
+				return;
+			}
+			if (client->in_len - offset < size) break;
+
+			on_frame(client, frame, now_ns);
+			offset += size;
+		}
+		memmove(client->in, client->in + offset, client->in_len - offset);
+		client->in_len -= offset;
+	}
+}
+
+static void poll_clients(int timeout_ms) {
+	struct epoll_event events[MAX_EPOLL_EVENTS];
+	int num_events = epoll_wait(loadgen.epoll_fd, events, MAX_EPOLL_EVENTS, timeout_ms);
+	for (int i = 0; i < num_events; i++) read_client(&loadgen.clients[events[i].data.u32]);
+}
+
+static void raise_open_file_limit(void) {
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+}
+
+static int run_loadgen(void) {
+	raise_open_file_limit();
+
+	loadgen.clients = (client_t*)calloc(loadgen.num_sessions, sizeof(client_t));
+	loadgen.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (loadgen.clients == NULL || loadgen.epoll_fd < 0) {
+		fprintf(stderr, "Error allocating %d sessions\n", loadgen.num_sessions);
+		free(loadgen.clients);
+		return 1;
+	}
+
+	const long long connect_start_ns = get_time_ns();
+	for (int i = 0; i < loadgen.num_sessions; i++) {
+		client_t* client = &loadgen.clients[i];
+		struct epoll_event event = { .events = EPOLLIN, .data.u32 = (uint32_t)i };
+
+		client->fd = connect_client();
+		if (client->fd < 0 || epoll_ctl(loadgen.epoll_fd, EPOLL_CTL_ADD, client->fd, &event) != 0) {
+			perror("Error opening session");
+			if (client->fd >= 0) close(client->fd);
+			client->fd = -1;
+			break;
+		}
+		client->last_frame_ns = -1;
+		loadgen.num_connected++;
+
+		if (loadgen.num_connected % CONNECT_BATCH == 0) poll_clients(0);
+	}
+	const long long connect_ns = get_time_ns() - connect_start_ns;
+
+	/* Whatever the connects left queued is drained before measuring starts. */
+	poll_clients(0);
+	loadgen.is_measuring = 1;
+	loadgen.measure_start_ns = get_time_ns();
+	const double server_cpu_start_s = loadgen.server_pid > 0 ? read_process_cpu_s(loadgen.server_pid) : -1;
+
+	const long long end_ns = loadgen.measure_start_ns + loadgen.duration_s * 1000000000LL;
+	long long now_ns;
+	while ((now_ns = get_time_ns()) < end_ns && loadgen.num_closed < loadgen.num_connected) {
+		int timeout_ms = (int)((end_ns - now_ns) / 1000000) + 1;
+		poll_clients(timeout_ms);
+	}
+
+	const double elapsed_s = (get_time_ns() - loadgen.measure_start_ns) / 1e9;
+	const double server_cpu_s = server_cpu_start_s >= 0 ? read_process_cpu_s(loadgen.server_pid) - server_cpu_start_s : -1;
+	const int num_open = loadgen.num_connected - loadgen.num_closed;
+
+	printf("sessions: %d\n", loadgen.num_connected);
+	printf("sessions_closed_by_server: %d\n", loadgen.num_closed);
+	printf("connect_ms: %.1f\n", connect_ns / 1e6);
+	printf("elapsed_s: %.3f\n", elapsed_s);
+	printf("tick_period_us: %lld\n", loadgen.tick_period_us);
+	printf("frames: %lld\n", loadgen.num_frames);
+	printf("full_frames: %lld\n", loadgen.num_full_frames);
+	printf("inputs_sent: %lld\n", loadgen.num_inputs);
+	printf("tick_jitter_us: p50 %lld, p99 %lld, max %lld\n", get_latency_percentile_us(&loadgen.jitter, 0.5),
+		get_latency_percentile_us(&loadgen.jitter, 0.99), loadgen.jitter.max_ns / 1000);
+	printf("bytes_per_session_per_s: %.1f\n", num_open > 0 ? loadgen.num_bytes / elapsed_s / num_open : 0);
+	if (server_cpu_s >= 0) {
+		printf("server_cpu_s: %.3f\n", server_cpu_s);
+		printf("server_cores: %.3f\n", server_cpu_s / elapsed_s);
+		printf("sessions_per_core: %.1f\n", server_cpu_s > 0 ? num_open / (server_cpu_s / elapsed_s) : 0);
+	}
+	else printf("sessions_per_core: unknown, the server's /proc/<pid>/stat cannot be read\n");
+
+	for (int i = 0; i < loadgen.num_sessions; i++) {
+		if (loadgen.clients[i].fd >= 0) close(loadgen.clients[i].fd);
+	}
+	close(loadgen.epoll_fd);
+	free(loadgen.clients);
+	return loadgen.num_connected == loadgen.num_sessions ? 0 : 1;
+}
+
+static void print_usage(const char* program) {
+	fprintf(stderr,
+		"usage: %s [-u socket_path | -p port] [-n sessions] [-d seconds] [-h hold_frames] [-s seed]\n"
+		"  -u  connect to pacman-server on this Unix domain socket (default " DEFAULT_SERVER_SOCKET_PATH ")\n"
+		"  -p  connect to this TCP port of 127.0.0.1 instead\n"
+		"  -n  sessions to open (default 1000)\n"
+		"  -d  seconds to measure for once every session is open (default 10)\n"
+		"  -h  each session turns a random way every this many frames (default 8)\n"
+		"  -s  seed of the RNG picking the sessions' turns; must not be 0\n",
+		program);
+}
+
+static int parse_loadgen_args(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 >= argc || argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0') return -1;
+
+		const char* val = argv[++i];
+		switch (argv[i - 1][1])
+		{
+		case 'u':
+			loadgen.socket_path = val;
+			break;
+		case 'p':
+			loadgen.port = atoi(val);
+			break;
+		case 'n':
+			loadgen.num_sessions = atoi(val);
+			break;
+		case 'd':
+			loadgen.duration_s = atoi(val);
+			break;
+		case 'h':
+			loadgen.hold_frames = atoi(val);
+			break;
+		case 's':
+			loadgen.xorshift = (int)strtoul(val, NULL, 0);
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	if (loadgen.port < 0 || loadgen.port > 65535 || loadgen.num_sessions < 1 || loadgen.duration_s < 1 || loadgen.hold_frames < 1 || loadgen.xorshift == 0) return -1;
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (parse_loadgen_args(argc, argv) != 0) {
+		print_usage(argv[0]);
+		return 1;
+	}
+	return run_loadgen();
+}
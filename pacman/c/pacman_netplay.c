@@ -0,0 +1,174 @@
+#include <string.h>
+
+#include "pacman_netplay.h"
+#include "pacman_platform.h"
+
+static int link_xorshift32(loopback_link_t* link) {
+	int x = link->xorshift;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return link->xorshift = x;
+}
+
+void init_loopback_link(loopback_link_t* link, int delay, int loss_percent, int seed) {
+	memset(link, 0, sizeof(loopback_link_t));
+	link->delay = delay;
+	link->loss_percent = loss_percent;
+	link->xorshift = seed;
+}
+
+void send_loopback_packet(loopback_link_t* link, const netplay_packet_t* packet, int frame) {
+	link->num_sent++;
+
+	if ((int)((unsigned int)link_xorshift32(link) % 100) < link->loss_percent || link->head - link->tail >= LOOPBACK_LINK_CAPACITY) {
+		link->num_lost++;
+		return;
+	}
+
+	link->packets[link->head % LOOPBACK_LINK_CAPACITY] = *packet;
+	link->deliver_frames[link->head % LOOPBACK_LINK_CAPACITY] = frame + link->delay;
+	link->head++;
+}
+
+int receive_loopback_packet(loopback_link_t* link, netplay_packet_t* packet, int frame) {
+	if (link->head == link->tail || link->deliver_frames[link->tail % LOOPBACK_LINK_CAPACITY] > frame) return 0;
+
+	*packet = link->packets[link->tail % LOOPBACK_LINK_CAPACITY];
+	link->tail++;
+	return 1;
+}
+
+void init_netplay_session(netplay_session_t* session, int local_player, loopback_link_t* tx, loopback_link_t* rx) {
+	memset(session, 0, sizeof(netplay_session_t));
+	session->local_player = local_player;
+	session->tx = tx;
+	session->rx = rx;
+
+	session->remote_confirmed_tick = -1;
+	session->remote_ack_tick = -1;
+	session->rollback_tick = -1;
+	for (int i = 0; i < NETPLAY_INPUT_HISTORY; i++) session->remote_input_ticks[i] = -1;
+}
+
+void free_netplay_session(netplay_session_t* session) {
+	for (int i = 0; i < NETPLAY_NUM_SNAPSHOTS; i++) free_game_snapshot(&session->snapshots[i]);
+}
+
+static void save_session_snapshot(netplay_session_t* session, game_ctx_t* ctx, int tick) {
+	long long start_ns = get_time_ns();
+	save_game_snapshot(ctx, &session->snapshots[tick % NETPLAY_NUM_SNAPSHOTS]);
+	session->save_ns += get_time_ns() - start_ns;
+	session->num_saves++;
+}
+
+/* Stepping stops at game over, on both peers and while re-simulating alike. */
+static void simulate_tick(netplay_session_t* session, game_ctx_t* ctx, int tick) {
+	int slot = tick % NETPLAY_INPUT_HISTORY;
+	uint8_t inputs[NUM_NETPLAY_PLAYERS];
+
+	session->used_remote_inputs[slot] = session->remote_input_ticks[slot] == tick ? session->remote_inputs[slot] : DIR_NONE;
+	inputs[session->local_player] = session->local_inputs[slot];
+	inputs[1 - session->local_player] = session->used_remote_inputs[slot];
+
+	for (int i = 0; i < NUM_NETPLAY_PLAYERS; i++) {
+		if (inputs[i] != DIR_NONE) ctx->state.pacman.entity_state.dir = ctx->def_vals.dirs[inputs[i]];
+	}
+
+	if (ctx->is_running) step_game_tick(ctx);
+}
+
+static void roll_back(netplay_session_t* session, game_ctx_t* ctx) {
+	int from_tick = session->rollback_tick;
+	session->rollback_tick = -1;
+
+	long long start_ns = get_time_ns();
+	restore_game_snapshot(ctx, &session->snapshots[from_tick % NETPLAY_NUM_SNAPSHOTS]);
+	session->restore_ns += get_time_ns() - start_ns;
+	session->num_restores++;
+
+	for (int tick = from_tick; tick < session->tick; tick++) {
+		if (tick > from_tick) save_session_snapshot(session, ctx, tick);
+		simulate_tick(session, ctx, tick);
+	}
+
+	long long elapsed_ns = get_time_ns() - start_ns;
+	int num_ticks = session->tick - from_tick;
+
+	session->num_rollbacks++;
+	session->num_resimulated_ticks += num_ticks;
+	session->rollback_ns += elapsed_ns;
+	if (num_ticks > session->max_rollback_ticks) session->max_rollback_ticks = num_ticks;
+	if (elapsed_ns > session->max_rollback_ns) session->max_rollback_ns = elapsed_ns;
+}
+
+static void receive_remote_inputs(netplay_session_t* session, int frame) {
+	netplay_packet_t packet;
+
+	while (receive_loopback_packet(session->rx, &packet, frame)) {
+		if (packet.ack_tick > session->remote_ack_tick) session->remote_ack_tick = packet.ack_tick;
+
+		for (int i = 0; i < packet.num_inputs; i++) {
+			int tick = packet.first_tick + i;
+			int slot = tick % NETPLAY_INPUT_HISTORY;
+			if (tick <= session->remote_confirmed_tick || session->remote_input_ticks[slot] == tick) continue;
+
+			session->remote_inputs[slot] = packet.inputs[i];
+			session->remote_input_ticks[slot] = tick;
+
+			/* Already simulated with a different guess: redo it from there. */
+			if (tick < session->tick && packet.inputs[i] != session->used_remote_inputs[slot]) {
+				if (session->rollback_tick < 0 || tick < session->rollback_tick) session->rollback_tick = tick;
+			}
+		}
+	}
+
+	while (session->remote_input_ticks[(session->remote_confirmed_tick + 1) % NETPLAY_INPUT_HISTORY] == session->remote_confirmed_tick + 1) {
+		session->remote_confirmed_tick++;
+	}
+}
+
+static void send_local_inputs(netplay_session_t* session, int frame) {
+	netplay_packet_t packet;
+	int last_tick = session->tick - 1;
+
+	packet.ack_tick = session->remote_confirmed_tick;
+	packet.first_tick = session->remote_ack_tick + 1;
+	if (packet.first_tick < last_tick - NETPLAY_PACKET_INPUTS + 1) packet.first_tick = last_tick - NETPLAY_PACKET_INPUTS + 1;
+	packet.num_inputs = packet.first_tick <= last_tick ? last_tick - packet.first_tick + 1 : 0;
+
+	for (int i = 0; i < packet.num_inputs; i++) {
+		packet.inputs[i] = session->local_inputs[(packet.first_tick + i) % NETPLAY_INPUT_HISTORY];
+	}
+
+	send_loopback_packet(session->tx, &packet, frame);
+}
+
+void poll_netplay(netplay_session_t* session, game_ctx_t* ctx, int frame) {
+	receive_remote_inputs(session, frame);
+	if (session->rollback_tick >= 0) roll_back(session, ctx);
+	send_local_inputs(session, frame);
+}
+
+int advance_netplay(netplay_session_t* session, game_ctx_t* ctx, dir_t local_dir, int frame) {
+	receive_remote_inputs(session, frame);
+	if (session->rollback_tick >= 0) roll_back(session, ctx);
+
+	if (session->tick - session->remote_confirmed_tick > NETPLAY_MAX_ROLLBACK_TICKS) {
+		session->num_stalls++;
+		send_local_inputs(session, frame);
+		return 0;
+	}
+
+	int tick = session->tick++;
+	session->local_inputs[tick % NETPLAY_INPUT_HISTORY] = local_dir;
+	save_session_snapshot(session, ctx, tick);
+	simulate_tick(session, ctx, tick);
+
+	send_local_inputs(session, frame);
+	return 1;
+}
+
+short is_netplay_confirmed(const netplay_session_t* session) {
+	return session->rollback_tick < 0 && session->remote_confirmed_tick >= session->tick - 1;
+}
@@ -0,0 +1,101 @@
+#ifndef PACMAN_NETPLAY_H
+#define PACMAN_NETPLAY_H
+
+#include <stdint.h>
+
+#include "pacman_game.h"
+
+#define NUM_NETPLAY_PLAYERS 2
+#define NETPLAY_NUM_SNAPSHOTS 16
+#define NETPLAY_MAX_ROLLBACK_TICKS (NETPLAY_NUM_SNAPSHOTS - 1)
+#define NETPLAY_INPUT_HISTORY 64
+#define NETPLAY_PACKET_INPUTS 32
+#define LOOPBACK_LINK_CAPACITY 256
+
+/*
+ * Every packet carries all of the sender's inputs the receiver has not
+ * acknowledged yet, so a lost packet is covered by the next one that arrives.
+ */
+typedef struct {
+	int ack_tick;
+	int first_tick;
+	uint8_t num_inputs;
+	uint8_t inputs[NETPLAY_PACKET_INPUTS];
+} netplay_packet_t;
+
+/*
+ * One direction of a simulated connection within the process: a packet comes
+ * out delay frames after it was sent, unless it is dropped, which happens to
+ * loss_percent of them (and to anything sent while the link is full).
+ */
+typedef struct {
+	int delay;
+	int loss_percent;
+	int xorshift;
+
+	netplay_packet_t packets[LOOPBACK_LINK_CAPACITY];
+	int deliver_frames[LOOPBACK_LINK_CAPACITY];
+	unsigned int head;
+	unsigned int tail;
+
+	long long num_sent;
+	long long num_lost;
+} loopback_link_t;
+
+void init_loopback_link(loopback_link_t* link, int delay, int loss_percent, int seed);
+void send_loopback_packet(loopback_link_t* link, const netplay_packet_t* packet, int frame);
+/* Returns 0 when no packet is due yet. */
+int receive_loopback_packet(loopback_link_t* link, netplay_packet_t* packet, int frame);
+
+/*
+ * Rollback session for one peer. Each player's input for a tick is a
+ * direction (or DIR_NONE) and both steer pacman, applied in player order.
+ * Remote inputs that have not arrived are predicted as DIR_NONE; when one
+ * arrives that differs from the prediction, the game is restored to the
+ * snapshot of that tick and re-simulated up to the present in the same frame.
+ * A peer more than NETPLAY_MAX_ROLLBACK_TICKS ahead of the other's inputs
+ * waits for them, so the snapshot it may need is always still in the ring.
+ */
+typedef struct {
+	int local_player;
+	loopback_link_t* tx;
+	loopback_link_t* rx;
+
+	int tick;
+	int remote_confirmed_tick;
+	int remote_ack_tick;
+	int rollback_tick;
+
+	uint8_t local_inputs[NETPLAY_INPUT_HISTORY];
+	uint8_t remote_inputs[NETPLAY_INPUT_HISTORY];
+	int remote_input_ticks[NETPLAY_INPUT_HISTORY];
+	uint8_t used_remote_inputs[NETPLAY_INPUT_HISTORY];
+
+	game_snapshot_t snapshots[NETPLAY_NUM_SNAPSHOTS];
+
+	long long num_stalls;
+	long long num_rollbacks;
+	long long num_resimulated_ticks;
+	int max_rollback_ticks;
+
+	long long num_saves;
+	long long save_ns;
+	long long num_restores;
+	long long restore_ns;
+	long long rollback_ns;
+	long long max_rollback_ns;
+} netplay_session_t;
+
+/* Call right after init_level(ctx, 0) on both peers, with the same seed. */
+void init_netplay_session(netplay_session_t* session, int local_player, loopback_link_t* tx, loopback_link_t* rx);
+void free_netplay_session(netplay_session_t* session);
+
+/* Takes in remote inputs, rolls back if needed and sends local inputs, without advancing. */
+void poll_netplay(netplay_session_t* session, game_ctx_t* ctx, int frame);
+/* Like poll_netplay(), then runs the next tick with the given local input. Returns 0 while waiting on the remote peer. */
+int advance_netplay(netplay_session_t* session, game_ctx_t* ctx, dir_t local_dir, int frame);
+
+/* Every tick run so far used the remote peer's real input. */
+short is_netplay_confirmed(const netplay_session_t* session);
+
+#endif
@@ -0,0 +1,294 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pacman_paths.h"
+#include "pacman_platform.h"
+
+#define UNREACHABLE 0xffff
+
+typedef struct cached_graph {
+	ghost_path_graph_t graph;
+	struct cached_graph* next;
+} cached_graph_t;
+
+/* Every graph built so far, kept for the life of the process as the level sets they are built from are. */
+static cached_graph_t* cached_graphs = NULL;
+static mutex_t cache_lock = MUTEX_INITIALIZER;
+
+static const vector_2d_t dir_steps[DIR_NONE] = {
+	{ .x = 0, .y = -1 },
+	{ .x = 0, .y = 1 },
+	{ .x = -1, .y = 0 },
+	{ .x = 1, .y = 0 }
+};
+
+static short get_tile_node(const ghost_path_graph_t* graph, vector_2d_t pos) {
+	if (pos.x < 0) pos.x = 0;
+	if (pos.x > graph->width - 1) pos.x = graph->width - 1;
+	if (pos.y < 0) pos.y = 0;
+	if (pos.y > graph->height - 1) pos.y = graph->height - 1;
+	return graph->tile_nodes[pos.y * graph->width + pos.x];
+}
+
+/* Breadth-first search against the edge direction, so dist[n] is the number of steps from n to target. */
+static void fill_distance_field(const ghost_path_graph_t* graph, short* queue, short target, uint16_t* dist) {
+	int head = 0;
+	int tail = 0;
+
+	memset(dist, 0xff, graph->num_nodes * sizeof(uint16_t));
+	dist[target] = 0;
+	queue[tail++] = target;
+
+	while (head < tail) {
+		short node = queue[head++];
+		for (dir_t d = 0; d < DIR_NONE; d++) {
+			short prev = graph->node_entries[node][d];
+			if (prev == -1 || dist[prev] != UNREACHABLE) continue;
+			dist[prev] = dist[node] + 1;
+			queue[tail++] = prev;
+		}
+	}
+}
+
+static int build_nodes(ghost_path_graph_t* graph, const nav_graph_t* nav, short* queue) {
+	const int num_tiles = graph->width * graph->height;
+
+	int num_nodes = 0;
+	for (short y = 0; y < graph->height; y++) {
+		for (uint32_t row = nav->reachable[y]; row != 0; row &= row - 1) num_nodes++;
+	}
+
+	graph->num_nodes = (short)num_nodes;
+	graph->tile_nodes = (short*)malloc(num_tiles * sizeof(short));
+	graph->node_pos = (vector_2d_t*)malloc((num_nodes + 1) * sizeof(vector_2d_t));
+	graph->node_exits = malloc((num_nodes + 1) * sizeof(*graph->node_exits));
+	graph->node_entries = malloc((num_nodes + 1) * sizeof(*graph->node_entries));
+
+	if (graph->tile_nodes == NULL || graph->node_pos == NULL || graph->node_exits == NULL || graph->node_entries == NULL) return -1;
+
+	memset(graph->tile_nodes, 0xff, num_tiles * sizeof(short));
+
+	short node = 0;
+	for (short y = 0; y < graph->height; y++) {
+		for (short x = 0; x < graph->width; x++) {
+			if (!((nav->reachable[y] >> x) & 1)) continue;
+			graph->node_pos[node] = (vector_2d_t){ .x = x, .y = y };
+			graph->tile_nodes[y * graph->width + x] = node++;
+		}
+	}
+
+	for (short i = 0; i < graph->num_nodes; i++) {
+		for (dir_t d = 0; d < DIR_NONE; d++) graph->node_entries[i][d] = -1;
+	}
+
+	/* Moves off the map edge wrap round to the far side, so tunnels are edges like any other. */
+	for (short i = 0; i < graph->num_nodes; i++) {
+		vector_2d_t pos = graph->node_pos[i];
+		for (dir_t d = 0; d < DIR_NONE; d++) {
+			vector_2d_t next = (vector_2d_t){
+				.x = (pos.x + dir_steps[d].x + graph->width) % graph->width,
+				.y = (pos.y + dir_steps[d].y + graph->height) % graph->height
+			};
+
+			graph->node_exits[i][d] = -1;
+			if (!((nav->exits[d][pos.y] >> pos.x) & 1)) continue;
+
+			short next_node = graph->tile_nodes[next.y * graph->width + next.x];
+			graph->node_exits[i][d] = next_node;
+			if (next_node != -1) graph->node_entries[next_node][d] = i;
+		}
+	}
+
+	/* Every other tile maps to the nearest node, so targets off the walkable maze still resolve. */
+	int head = 0;
+	int tail = 0;
+	for (int i = 0; i < num_tiles; i++) {
+		if (graph->tile_nodes[i] != -1) queue[tail++] = (short)i;
+	}
+	while (head < tail) {
+		int tile = queue[head++];
+		vector_2d_t pos = (vector_2d_t){ .x = tile % graph->width, .y = tile / graph->width };
+		for (dir_t d = 0; d < DIR_NONE; d++) {
+			vector_2d_t next = (vector_2d_t){ .x = pos.x + dir_steps[d].x, .y = pos.y + dir_steps[d].y };
+			if (next.x < 0 || next.x >= graph->width || next.y < 0 || next.y >= graph->height) continue;
+
+			int next_tile = next.y * graph->width + next.x;
+			if (graph->tile_nodes[next_tile] != -1) continue;
+			graph->tile_nodes[next_tile] = graph->tile_nodes[tile];
+			queue[tail++] = (short)next_tile;
+		}
+	}
+	return 0;
+}
+
+/* One reverse search per target node, then the best exit of every node toward it. */
+static int build_next_hops(ghost_path_graph_t* graph, short* queue) {
+	const int num_nodes = graph->num_nodes;
+	uint16_t* dist = (uint16_t*)malloc((num_nodes + 1) * sizeof(uint16_t));
+
+	graph->next_hops = (uint8_t*)calloc(((size_t)num_nodes * num_nodes + 3) / 4, 1);
+	graph->no_paths = (uint8_t*)calloc(((size_t)num_nodes * num_nodes + 7) / 8, 1);
+	if (dist == NULL || graph->next_hops == NULL || graph->no_paths == NULL) {
+		free(dist);
+		return -1;
+	}
+
+	for (short target = 0; target < num_nodes; target++) {
+		fill_distance_field(graph, queue, target, dist);
+
+		for (short node = 0; node < num_nodes; node++) {
+			if (node == target) continue;
+
+			uint16_t best_dist = UNREACHABLE;
+			dir_t best_dir = DIR_UP;
+			for (dir_t d = 0; d < DIR_NONE; d++) {
+				short next = graph->node_exits[node][d];
+				if (next != -1 && dist[next] < best_dist) {
+					best_dist = dist[next];
+					best_dir = d;
+				}
+			}
+
+			size_t idx = (size_t)node * num_nodes + target;
+			if (best_dist == UNREACHABLE) graph->no_paths[idx >> 3] |= (uint8_t)(1u << (idx & 7));
+			else graph->next_hops[idx >> 2] |= (uint8_t)(best_dir << ((idx & 3) * 2));
+		}
+	}
+
+	free(dist);
+	return 0;
+}
+
+static void free_graph(ghost_path_graph_t* graph) {
+	free(graph->tile_nodes);
+	free(graph->node_pos);
+	free(graph->node_exits);
+	free(graph->node_entries);
+	free(graph->next_hops);
+	free(graph->no_paths);
+}
+
+static int build_graph(ghost_path_graph_t* graph, const nav_graph_t* nav, short width, short height, ghost_targeting_t targeting) {
+	const long long start_ns = get_time_ns();
+	short* queue = (short*)malloc((width * height + 1) * sizeof(short));
+	if (queue == NULL) return -1;
+
+	memset(graph, 0, sizeof(ghost_path_graph_t));
+	graph->targeting = targeting;
+	graph->nav = nav;
+	graph->width = width;
+	graph->height = height;
+
+	int result = build_nodes(graph, nav, queue);
+
+	graph->mode = targeting;
+	if (targeting == GHOST_TARGETING_PATH_TABLE && graph->num_nodes > MAX_PATH_TABLE_NODES) graph->mode = GHOST_TARGETING_DISTANCE_FIELD;
+
+	if (result == 0 && graph->mode == GHOST_TARGETING_PATH_TABLE) result = build_next_hops(graph, queue);
+	free(queue);
+
+	if (result != 0) {
+		free_graph(graph);
+		return -1;
+	}
+	graph->build_ns = get_time_ns() - start_ns;
+	return 0;
+}
+
+/* Builds a map's graph on the first call for it and mode; any thread may ask, and concurrent first calls build it once. */
+static const ghost_path_graph_t* get_graph(const nav_graph_t* nav, short width, short height, ghost_targeting_t targeting) {
+	lock_mutex(&cache_lock);
+
+	cached_graph_t* cached = cached_graphs;
+	while (cached != NULL && (cached->graph.nav != nav || cached->graph.width != width || cached->graph.height != height || cached->graph.targeting != targeting)) cached = cached->next;
+
+	if (cached == NULL) {
+		cached = (cached_graph_t*)malloc(sizeof(cached_graph_t));
+		if (cached != NULL && build_graph(&cached->graph, nav, width, height, targeting) == 0) {
+			cached->next = cached_graphs;
+			cached_graphs = cached;
+		}
+		else {
+			free(cached);
+			cached = NULL;
+		}
+	}
+
+	unlock_mutex(&cache_lock);
+	return cached != NULL ? &cached->graph : NULL;
+}
+
+int build_ghost_paths(ghost_paths_t* paths, const nav_graph_t* nav, short width, short height, ghost_targeting_t targeting) {
+	free_ghost_paths(paths);
+
+	paths->graph = get_graph(nav, width, height, targeting);
+	if (paths->graph == NULL) return -1;
+	paths->mode = paths->graph->mode;
+
+	if (paths->mode == GHOST_TARGETING_DISTANCE_FIELD) {
+		const int num_nodes = paths->graph->num_nodes;
+		paths->queue = (short*)malloc((num_nodes + 1) * sizeof(short));
+		paths->fields = (uint16_t*)malloc((size_t)NUM_DISTANCE_FIELDS * num_nodes * sizeof(uint16_t));
+		paths->node_fields = (short*)malloc((num_nodes + 1) * sizeof(short));
+		if (paths->queue == NULL || paths->fields == NULL || paths->node_fields == NULL) return -1;
+
+		memset(paths->node_fields, 0xff, num_nodes * sizeof(short));
+		for (int i = 0; i < NUM_DISTANCE_FIELDS; i++) paths->field_targets[i] = -1;
+	}
+	return 0;
+}
+
+void free_ghost_paths(ghost_paths_t* paths) {
+	free(paths->queue);
+	free(paths->fields);
+	free(paths->node_fields);
+	memset(paths, 0, sizeof(ghost_paths_t));
+}
+
+static const uint16_t* get_distance_field(ghost_paths_t* paths, short target) {
+	const int num_nodes = paths->graph->num_nodes;
+	paths->num_field_lookups++;
+
+	short slot = paths->node_fields[target];
+	if (slot != -1) return paths->fields + (size_t)slot * num_nodes;
+
+	slot = (short)paths->next_field;
+	paths->next_field = (slot + 1) % NUM_DISTANCE_FIELDS;
+	if (paths->field_targets[slot] != -1) paths->node_fields[paths->field_targets[slot]] = -1;
+	paths->field_targets[slot] = target;
+	paths->node_fields[target] = slot;
+	paths->num_field_builds++;
+
+	uint16_t* field = paths->fields + (size_t)slot * num_nodes;
+	fill_distance_field(paths->graph, paths->queue, target, field);
+	return field;
+}
+
+dir_t get_ghost_path_dir(ghost_paths_t* paths, vector_2d_t from, vector_2d_t target, uint8_t candidates) {
+	const ghost_path_graph_t* graph = paths->graph;
+	short from_node = get_tile_node(graph, from);
+	short target_node = get_tile_node(graph, target);
+
+	if (from_node == -1 || target_node == -1 || from_node == target_node || graph->node_pos[from_node].x != from.x || graph->node_pos[from_node].y != from.y) return DIR_NONE;
+
+	if (paths->mode == GHOST_TARGETING_PATH_TABLE) {
+		size_t idx = (size_t)from_node * graph->num_nodes + target_node;
+		if ((graph->no_paths[idx >> 3] >> (idx & 7)) & 1) return DIR_NONE;
+		dir_t dir = (graph->next_hops[idx >> 2] >> ((idx & 3) * 2)) & 3;
+		return (candidates >> dir) & 1 ? dir : DIR_NONE;
+	}
+
+	const uint16_t* field = get_distance_field(paths, target_node);
+	uint16_t best_dist = UNREACHABLE;
+	dir_t best_dir = DIR_NONE;
+
+	for (dir_t d = 0; d < DIR_NONE; d++) {
+		short next = graph->node_exits[from_node][d];
+		if (!((candidates >> d) & 1) || next == -1) continue;
+		if (field[next] < best_dist) {
+			best_dist = field[next];
+			best_dir = d;
+		}
+	}
+	return best_dir;
+}
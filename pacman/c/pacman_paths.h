@@ -0,0 +1,25 @@
+#ifndef PACMAN_PATHS_H
+#define PACMAN_PATHS_H
+
+#include <stdint.h>
+
+#include "pacman_game.h"
+
+/*
+ * Points paths at the shortest-path data for one map, building it from the
+ * nav graph on the first call for that map and mode, from any thread, and
+ * sharing it after that. Asking for the path table on a map with more than
+ * MAX_PATH_TABLE_NODES nodes gives distance fields instead; paths->mode
+ * records what was built. Returns -1 if out of memory.
+ */
+int build_ghost_paths(ghost_paths_t* paths, const nav_graph_t* nav, short width, short height, ghost_targeting_t targeting);
+void free_ghost_paths(ghost_paths_t* paths);
+
+/*
+ * Returns the first step of a shortest path from `from` toward the reachable
+ * tile closest to `target`, restricted to the directions set in `candidates`,
+ * or DIR_NONE when the paths give no answer and the caller should decide.
+ */
+dir_t get_ghost_path_dir(ghost_paths_t* paths, vector_2d_t from, vector_2d_t target, uint8_t candidates);
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdlib.h>
+
+#include "pacman_platform.h"
+
+#ifdef _WIN32
+#include <conio.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+	void (*thread_main)(void*);
+	void* arg;
+} thread_start_t;
+
+#ifdef _WIN32
+long long get_time_ns(void) {
+	static LARGE_INTEGER perf_freq;
+	LARGE_INTEGER now;
+	if (perf_freq.QuadPart == 0) QueryPerformanceFrequency(&perf_freq);
+	QueryPerformanceCounter(&now);
+	return (long long)(now.QuadPart / perf_freq.QuadPart) * 1000000000LL + (now.QuadPart % perf_freq.QuadPart) * 1000000000LL / perf_freq.QuadPart;
+}
+
+void sleep_until_ns(long long deadline_ns) {
+	long long remaining_ns = deadline_ns - get_time_ns();
+	if (remaining_ns > 0) Sleep((DWORD)(remaining_ns / 1000000));
+}
+
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+
+static DWORD original_console_mode;
+static short is_console_mode_set = 0;
+
+/* The renderer speaks escape sequences, which the console only understands once asked to. */
+void init_terminal(void) {
+	HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+	if (!GetConsoleMode(console, &original_console_mode)) return;
+	if (!SetConsoleMode(console, original_console_mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING)) return;
+	is_console_mode_set = 1;
+}
+
+void restore_terminal(void) {
+	if (!is_console_mode_set) return;
+	SetConsoleMode(GetStdHandle(STD_OUTPUT_HANDLE), original_console_mode);
+	is_console_mode_set = 0;
+}
+
+int read_key(void) {
+	return _getch();
+}
+
+int write_output(const char* buf, int len) {
+	HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+	int num_calls = 0;
+	while (len > 0) {
+		DWORD written = 0;
+		num_calls++;
+		if (!WriteFile(console, buf, (DWORD)len, &written, NULL)) return -1;
+		buf += written;
+		len -= (int)written;
+	}
+	return num_calls;
+}
+
+const void* map_file(const char* path, size_t* size) {
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return NULL;
+
+	LARGE_INTEGER file_size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) return NULL;
+
+	const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (data != NULL) *size = (size_t)file_size.QuadPart;
+	return data;
+}
+
+void unmap_file(const void* data, size_t size) {
+	(void)size;
+	UnmapViewOfFile(data);
+}
+
+static DWORD WINAPI thread_entry(LPVOID param) {
+	thread_start_t start = *(thread_start_t*)param;
+	free(param);
+	start.thread_main(start.arg);
+	return 0;
+}
+
+int start_thread(thread_t* thread, void (*thread_main)(void*), void* arg) {
+	thread_start_t* start = (thread_start_t*)malloc(sizeof(thread_start_t));
+	if (start == NULL) return -1;
+	*start = (thread_start_t){ .thread_main = thread_main, .arg = arg };
+
+	*thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL);
+	if (*thread == NULL) {
+		free(start);
+		return (int)GetLastError();
+	}
+	return 0;
+}
+
+void join_thread(thread_t thread) {
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+void lock_mutex(mutex_t* mutex) {
+	AcquireSRWLockExclusive(mutex);
+}
+
+void unlock_mutex(mutex_t* mutex) {
+	ReleaseSRWLockExclusive(mutex);
+}
+
+int get_num_cores(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+#else
+static struct termios original_termios;
+static short is_terminal_raw = 0;
+static struct sigaction original_sigint, original_sigterm;
+
+long long get_time_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void sleep_until_ns(long long deadline_ns) {
+	struct timespec deadline = { .tv_sec = deadline_ns / 1000000000LL, .tv_nsec = deadline_ns % 1000000000LL };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+void restore_terminal(void) {
+	if (!is_terminal_raw) return;
+	tcsetattr(STDIN_FILENO, TCSAFLUSH, &original_termios);
+	sigaction(SIGINT, &original_sigint, NULL);
+	sigaction(SIGTERM, &original_sigterm, NULL);
+	is_terminal_raw = 0;
+}
+
+/* atexit does not run when a signal kills the process, so Ctrl-C and SIGTERM restore the terminal here before dying of the signal as usual. */
+static void restore_terminal_on_signal(int sig) {
+	tcsetattr(STDIN_FILENO, TCSAFLUSH, &original_termios);
+	raise(sig);
+}
+
+void init_terminal(void) {
+	if (tcgetattr(STDIN_FILENO, &original_termios) == -1) return;
+
+	struct termios raw = original_termios;
+	raw.c_lflag &= ~(ECHO | ICANON);
+	/* Wake up every 100ms so the input thread notices the game has ended. */
+	raw.c_cc[VMIN] = 0;
+	raw.c_cc[VTIME] = 1;
+
+	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) return;
+	is_terminal_raw = 1;
+	atexit(restore_terminal);
+
+	/* SA_RESETHAND makes the raise in the handler take the default action. */
+	struct sigaction action = { .sa_handler = restore_terminal_on_signal, .sa_flags = SA_RESETHAND };
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, &original_sigint);
+	sigaction(SIGTERM, &action, &original_sigterm);
+}
+
+int read_key(void) {
+	unsigned char ch;
+	if (read(STDIN_FILENO, &ch, 1) == 1) return ch;
+
+	/* Not a terminal (or closed): back off instead of spinning on EOF. */
+	if (!is_terminal_raw) sleep_until_ns(get_time_ns() + 100000000LL);
+	return -1;
+}
+
+int write_output(const char* buf, int len) {
+	int num_calls = 0;
+	while (len > 0) {
+		num_calls++;
+		ssize_t written = write(STDOUT_FILENO, buf, len);
+		if (written == -1) {
+			if (errno == EINTR || errno == EAGAIN) continue;
+			return -1;
+		}
+		buf += written;
+		len -= (int)written;
+	}
+	return num_calls;
+}
+
+const void* map_file(const char* path, size_t* size) {
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) return NULL;
+
+	struct stat st;
+	void* data = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return NULL;
+
+	*size = (size_t)st.st_size;
+	return data;
+}
+
+void unmap_file(const void* data, size_t size) {
+	munmap((void*)data, size);
+}
+
+static void* thread_entry(void* param) {
+	thread_start_t start = *(thread_start_t*)param;
+	free(param);
+	start.thread_main(start.arg);
+	return NULL;
+}
+
+int start_thread(thread_t* thread, void (*thread_main)(void*), void* arg) {
+	thread_start_t* start = (thread_start_t*)malloc(sizeof(thread_start_t));
+	if (start == NULL) return -1;
+	*start = (thread_start_t){ .thread_main = thread_main, .arg = arg };
+
+	int err = pthread_create(thread, NULL, thread_entry, start);
+	if (err != 0) free(start);
+	return err;
+}
+
+void join_thread(thread_t thread) {
+	pthread_join(thread, NULL);
+}
+
+void lock_mutex(mutex_t* mutex) {
+	pthread_mutex_lock(mutex);
+}
+
+void unlock_mutex(mutex_t* mutex) {
+	pthread_mutex_unlock(mutex);
+}
+
+int get_num_cores(void) {
+	long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return num_cores > 0 ? (int)num_cores : 1;
+}
+#endif
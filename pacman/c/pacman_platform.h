@@ -0,0 +1,39 @@
+#ifndef PACMAN_PLATFORM_H
+#define PACMAN_PLATFORM_H
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE thread_t;
+typedef SRWLOCK mutex_t;
+#define MUTEX_INITIALIZER SRWLOCK_INIT
+#else
+#include <pthread.h>
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+#define MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#endif
+
+long long get_time_ns(void);
+void sleep_until_ns(long long deadline_ns);
+
+void init_terminal(void);
+void restore_terminal(void);
+int read_key(void);
+
+/* Writes all of buf to stdout, returning the number of write calls it took or -1. */
+int write_output(const char* buf, int len);
+
+/* Maps a whole file read-only; returns NULL if it cannot be opened or is empty. */
+const void* map_file(const char* path, size_t* size);
+void unmap_file(const void* data, size_t size);
+
+int start_thread(thread_t* thread, void (*thread_main)(void*), void* arg);
+void join_thread(thread_t thread);
+/* For mutexes set up with MUTEX_INITIALIZER. */
+void lock_mutex(mutex_t* mutex);
+void unlock_mutex(mutex_t* mutex);
+int get_num_cores(void);
+
+#endif
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pacman_render.h"
+#include "pacman_platform.h"
+
+/* A cursor-forward escape costs at least 4 bytes, so shorter gaps are cheaper to rewrite. */
+#define MAX_REWRITE_GAP 3
+#define MAX_CELL_BYTES 32
+#define NO_COLOR 0xffffffffu
+
+static void append_bytes(term_renderer_t* renderer, const char* bytes, int len) {
+	memcpy(renderer->out + renderer->out_len, bytes, len);
+	renderer->out_len += len;
+}
+
+static void append_number(term_renderer_t* renderer, int value) {
+	char digits[12];
+	int num_digits = 0;
+	do {
+		digits[num_digits++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value > 0);
+	while (num_digits > 0) renderer->out[renderer->out_len++] = digits[--num_digits];
+}
+
+static void append_color(term_renderer_t* renderer, const char* sgr, uint32_t color) {
+	append_bytes(renderer, sgr, (int)strlen(sgr));
+	append_number(renderer, (color >> 16) & 0xff);
+	renderer->out[renderer->out_len++] = ';';
+	append_number(renderer, (color >> 8) & 0xff);
+	renderer->out[renderer->out_len++] = ';';
+	append_number(renderer, color & 0xff);
+	renderer->out[renderer->out_len++] = 'm';
+}
+
+/* Spaces only show the background, so their color never matters. */
+static short is_same_cell(char a, uint32_t a_color, char b, uint32_t b_color) {
+	return a == b && (a == ' ' || a_color == b_color);
+}
+
+static void reset_front(term_renderer_t* renderer) {
+	for (short y = 0; y < renderer->height; y++) {
+		memset(renderer->front[y], ' ', renderer->width);
+		for (short x = 0; x < renderer->width; x++) renderer->front_colors[y][x] = renderer->bg_color;
+	}
+}
+
+int init_term_renderer(term_renderer_t* renderer, short width, short height, short use_color, uint32_t bg_color) {
+	memset(renderer, 0, sizeof(term_renderer_t));
+	renderer->width = width;
+	renderer->height = height;
+	renderer->use_color = use_color;
+	renderer->bg_color = bg_color;
+
+	renderer->out_cap = width * height * MAX_CELL_BYTES + 64;
+	renderer->out = (char*)malloc(renderer->out_cap);
+	if (renderer->out == NULL) return -1;
+
+	reset_front(renderer);
+	memcpy(renderer->back, renderer->front, sizeof(renderer->back));
+	memcpy(renderer->back_colors, renderer->front_colors, sizeof(renderer->back_colors));
+	renderer->is_clear_pending = 1;
+	return 0;
+}
+
+void free_term_renderer(term_renderer_t* renderer) {
+	free(renderer->out);
+	renderer->out = NULL;
+}
+
+void set_term_cell(term_renderer_t* renderer, vector_2d_t pos, char c, uint32_t color) {
+	renderer->back[pos.y][pos.x] = c;
+	renderer->back_colors[pos.y][pos.x] = color;
+	renderer->dirty[pos.y] |= 1u << pos.x;
+}
+
+void clear_term_screen(term_renderer_t* renderer) {
+	const uint32_t row_mask = renderer->width >= 32 ? 0xffffffffu : (1u << renderer->width) - 1;
+
+	reset_front(renderer);
+	for (short y = 0; y < renderer->height; y++) renderer->dirty[y] = row_mask;
+	renderer->is_clear_pending = 1;
+}
+
+int flush_term_frame(term_renderer_t* renderer) {
+	short cursor_x = -1;
+	short cursor_y = -1;
+	uint32_t current_color = NO_COLOR;
+
+	renderer->out_len = 0;
+	renderer->num_frames++;
+
+	if (renderer->is_clear_pending) {
+		if (renderer->use_color) append_color(renderer, "\033[48;2;", renderer->bg_color);
+		append_bytes(renderer, "\033[2J\033[H", 7);
+		cursor_x = 0;
+		cursor_y = 0;
+		renderer->is_clear_pending = 0;
+	}
+
+	for (short y = 0; y < renderer->height; y++) {
+		for (uint32_t row = renderer->dirty[y]; row != 0; row &= row - 1) {
+			short x = 0;
+			while (!((row >> x) & 1)) x++;
+
+			char c = renderer->back[y][x];
+			uint32_t color = renderer->back_colors[y][x];
+			if (is_same_cell(c, color, renderer->front[y][x], renderer->front_colors[y][x])) continue;
+
+			short gap = cursor_y == y ? x - cursor_x : -1;
+			short can_rewrite_gap = gap >= 0 && gap <= MAX_REWRITE_GAP;
+			for (short i = cursor_x; can_rewrite_gap && i < x; i++) {
+				if (renderer->use_color && renderer->front[y][i] != ' ' && renderer->front_colors[y][i] != current_color) can_rewrite_gap = 0;
+			}
+
+			if (can_rewrite_gap) {
+				append_bytes(renderer, &renderer->front[y][cursor_x], gap);
+			}
+			else if (gap > 0) {
+				append_bytes(renderer, "\033[", 2);
+				append_number(renderer, gap);
+				renderer->out[renderer->out_len++] = 'C';
+			}
+			else {
+				append_bytes(renderer, "\033[", 2);
+				append_number(renderer, y + 1);
+				renderer->out[renderer->out_len++] = ';';
+				append_number(renderer, x + 1);
+				renderer->out[renderer->out_len++] = 'H';
+			}
+
+			if (renderer->use_color && c != ' ' && color != current_color) {
+				append_color(renderer, "\033[38;2;", color);
+				current_color = color;
+			}
+
+			renderer->out[renderer->out_len++] = c;
+			renderer->front[y][x] = c;
+			renderer->front_colors[y][x] = color;
+			cursor_x = x + 1;
+			cursor_y = y;
+		}
+		renderer->dirty[y] = 0;
+	}
+
+	if (renderer->out_len == 0) return 0;
+
+	int num_syscalls = write_output(renderer->out, renderer->out_len);
+	if (num_syscalls < 0) return -1;
+
+	renderer->num_bytes += renderer->out_len;
+	renderer->num_syscalls += num_syscalls;
+	return 0;
+}
+
+void close_term_renderer(term_renderer_t* renderer) {
+	renderer->out_len = 0;
+	append_bytes(renderer, "\033[0m\033[2J\033[H", 11);
+	write_output(renderer->out, renderer->out_len);
+}
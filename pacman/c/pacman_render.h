@@ -0,0 +1,48 @@
+#ifndef PACMAN_RENDER_H
+#define PACMAN_RENDER_H
+
+#include <stdint.h>
+
+#include "pacman_game.h"
+
+/*
+ * Terminal back-buffer. Cells are set with set_term_cell() as the game
+ * changes them; flush_term_frame() diffs the dirty ones against what is on
+ * screen and sends everything that changed as one byte stream in a single
+ * write: no cursor move between adjacent cells, short gaps rewritten instead
+ * of jumped over, color escapes only when the color actually changes.
+ */
+typedef struct {
+	short width;
+	short height;
+	short use_color;
+	uint32_t bg_color;
+
+	char front[MAX_BOARD_HEIGHT][MAX_BOARD_WIDTH];
+	uint32_t front_colors[MAX_BOARD_HEIGHT][MAX_BOARD_WIDTH];
+	char back[MAX_BOARD_HEIGHT][MAX_BOARD_WIDTH];
+	uint32_t back_colors[MAX_BOARD_HEIGHT][MAX_BOARD_WIDTH];
+	bitboard_t dirty;
+	short is_clear_pending;
+
+	char* out;
+	int out_len;
+	int out_cap;
+
+	long long num_frames;
+	long long num_bytes;
+	long long num_syscalls;
+} term_renderer_t;
+
+/* Colors are 0xRRGGBB and only used when use_color is set. */
+int init_term_renderer(term_renderer_t* renderer, short width, short height, short use_color, uint32_t bg_color);
+void free_term_renderer(term_renderer_t* renderer);
+
+void set_term_cell(term_renderer_t* renderer, vector_2d_t pos, char c, uint32_t color);
+void clear_term_screen(term_renderer_t* renderer);
+int flush_term_frame(term_renderer_t* renderer);
+
+/* Resets colors and clears the screen for whatever is printed after the game. */
+void close_term_renderer(term_renderer_t* renderer);
+
+#endif
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pacman_replay.h"
+
+#define REPLAY_MAGIC "PMRP"
+#define REPLAY_HEADER_SIZE 20
+#define MAX_DROP_PER_EVENT (REPLAY_END - DIR_NONE)
+
+static int get_game_tick(game_ctx_t* ctx) {
+	return ctx->time.next_tick.tick / ctx->def_vals.skip_ticks;
+}
+
+static int reserve_bytes(replay_recorder_t* recorder, size_t num_bytes) {
+	if (recorder->size + num_bytes <= recorder->capacity) return 0;
+
+	size_t capacity = recorder->capacity > 0 ? recorder->capacity * 2 : 256;
+	while (capacity < recorder->size + num_bytes) capacity *= 2;
+
+	uint8_t* data = (uint8_t*)realloc(recorder->data, capacity);
+	if (data == NULL) return -1;
+
+	recorder->data = data;
+	recorder->capacity = capacity;
+	return 0;
+}
+
+static int write_varint(replay_recorder_t* recorder, uint64_t value) {
+	if (reserve_bytes(recorder, 10) != 0) return -1;
+	do {
+		uint8_t byte = value & 0x7f;
+		value >>= 7;
+		recorder->data[recorder->size++] = byte | (value != 0 ? 0x80 : 0);
+	} while (value != 0);
+	return 0;
+}
+
+static int read_varint(replay_reader_t* reader, uint64_t* value) {
+	*value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (reader->pos >= reader->size) return -1;
+		uint8_t byte = reader->data[reader->pos++];
+		*value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) return 0;
+	}
+	return -1;
+}
+
+static int write_event(replay_recorder_t* recorder, int tick, int code) {
+	if (write_varint(recorder, tick - recorder->last_tick) != 0 || write_varint(recorder, code) != 0) return -1;
+	recorder->last_tick = tick;
+	return 0;
+}
+
+int begin_replay_recording(replay_recorder_t* recorder, game_ctx_t* ctx) {
+	memset(recorder, 0, sizeof(replay_recorder_t));
+	if (reserve_bytes(recorder, REPLAY_HEADER_SIZE) != 0) return -1;
+
+	uint32_t seed = (uint32_t)ctx->state.xorshift;
+	uint64_t level_set_hash = get_level_set_hash(&ctx->def_vals.level_set);
+	memcpy(recorder->data, REPLAY_MAGIC, 4);
+	recorder->data[4] = REPLAY_VERSION;
+	recorder->data[5] = (uint8_t)ctx->def_vals.ghost_targeting;
+	for (int i = 0; i < 4; i++) recorder->data[6 + i] = (seed >> (i * 8)) & 0xff;
+	recorder->data[10] = ctx->state.ghosts.count & 0xff;
+	recorder->data[11] = (ctx->state.ghosts.count >> 8) & 0xff;
+	for (int i = 0; i < 8; i++) recorder->data[12 + i] = (level_set_hash >> (i * 8)) & 0xff;
+	recorder->size = REPLAY_HEADER_SIZE;
+	recorder->last_tick = get_game_tick(ctx);
+	return 0;
+}
+
+int record_replay_dir(replay_recorder_t* recorder, game_ctx_t* ctx, dir_t dir) {
+	return write_event(recorder, get_game_tick(ctx), dir);
+}
+
+/* Called before next_tick moves past the dropped ticks. */
+int record_replay_drop(replay_recorder_t* recorder, game_ctx_t* ctx, int num_ticks) {
+	int tick = get_game_tick(ctx);
+	while (num_ticks > 0) {
+		int num_event_ticks = num_ticks < MAX_DROP_PER_EVENT ? num_ticks : MAX_DROP_PER_EVENT;
+		if (write_event(recorder, tick, DIR_NONE + num_event_ticks - 1) != 0) return -1;
+		tick += num_event_ticks;
+		num_ticks -= num_event_ticks;
+	}
+	return 0;
+}
+
+int save_replay(replay_recorder_t* recorder, game_ctx_t* ctx, const char* path) {
+	size_t events_size = recorder->size;
+	uint64_t hash = get_state_hash(ctx);
+
+	if (write_event(recorder, recorder->last_tick, REPLAY_END) != 0) return -1;
+	if (write_varint(recorder, get_game_tick(ctx)) != 0 || write_varint(recorder, ctx->state.score) != 0) return -1;
+	if (reserve_bytes(recorder, 8) != 0) return -1;
+	for (int i = 0; i < 8; i++) recorder->data[recorder->size++] = (hash >> (i * 8)) & 0xff;
+
+	FILE* file = fopen(path, "wb");
+	int result = file != NULL && fwrite(recorder->data, 1, recorder->size, file) == recorder->size ? 0 : -1;
+	if (file != NULL && fclose(file) != 0) result = -1;
+
+	/* Drop the footer again, so recording could go on. */
+	recorder->size = events_size;
+	return result;
+}
+
+void free_replay_recorder(replay_recorder_t* recorder) {
+	free(recorder->data);
+	memset(recorder, 0, sizeof(replay_recorder_t));
+}
+
+static int read_next_event(replay_reader_t* reader) {
+	uint64_t delta, code;
+	if (read_varint(reader, &delta) != 0 || read_varint(reader, &code) != 0 || code > REPLAY_END) return -1;
+
+	reader->next_event_tick += (int)delta;
+	reader->next_event_code = (int)code;
+	return 0;
+}
+
+int load_replay(replay_reader_t* reader, const char* path) {
+	memset(reader, 0, sizeof(replay_reader_t));
+
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) return -1;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	reader->data = size > 0 ? (uint8_t*)malloc(size) : NULL;
+	reader->size = size > 0 ? (size_t)size : 0;
+	int is_read = reader->data != NULL && fread(reader->data, 1, reader->size, file) == reader->size;
+	fclose(file);
+
+	if (!is_read || reader->size < REPLAY_HEADER_SIZE || memcmp(reader->data, REPLAY_MAGIC, 4) != 0 || reader->data[4] != REPLAY_VERSION
+		|| reader->data[5] > GHOST_TARGETING_DISTANCE_FIELD) {
+		free_replay_reader(reader);
+		return -1;
+	}
+
+	reader->ghost_targeting = (ghost_targeting_t)reader->data[5];
+	uint32_t seed = 0;
+	for (int i = 0; i < 4; i++) seed |= (uint32_t)reader->data[6 + i] << (i * 8);
+	reader->seed = (int)seed;
+	reader->num_ghosts = reader->data[10] | reader->data[11] << 8;
+	for (int i = 0; i < 8; i++) reader->level_set_hash |= (uint64_t)reader->data[12 + i] << (i * 8);
+
+	/* Walk the events once to validate them and reach the footer. */
+	reader->pos = REPLAY_HEADER_SIZE;
+	do {
+		if (read_next_event(reader) != 0) {
+			free_replay_reader(reader);
+			return -1;
+		}
+	} while (reader->next_event_code != REPLAY_END);
+
+	uint64_t final_tick, final_score;
+	if (read_varint(reader, &final_tick) != 0 || read_varint(reader, &final_score) != 0 || reader->pos + 8 > reader->size) {
+		free_replay_reader(reader);
+		return -1;
+	}
+
+	reader->final_tick = (int)final_tick;
+	reader->final_score = (int)final_score;
+	for (int i = 0; i < 8; i++) reader->final_hash |= (uint64_t)reader->data[reader->pos + i] << (i * 8);
+	return 0;
+}
+
+void free_replay_reader(replay_reader_t* reader) {
+	free(reader->data);
+	memset(reader, 0, sizeof(replay_reader_t));
+}
+
+int init_replay_game(replay_reader_t* reader, game_ctx_t* ctx) {
+	ctx->def_vals.ghost_targeting = reader->ghost_targeting;
+	ctx->def_vals.num_ghosts = reader->num_ghosts;
+	init_level(ctx, 0);
+	ctx->state.xorshift = reader->seed;
+
+	reader->pos = REPLAY_HEADER_SIZE;
+	reader->next_event_tick = get_game_tick(ctx);
+	read_next_event(reader);
+	return get_level_set_hash(&ctx->def_vals.level_set) == reader->level_set_hash ? 0 : -1;
+}
+
+int step_replay(replay_reader_t* reader, game_ctx_t* ctx) {
+	int tick = get_game_tick(ctx);
+
+	while (reader->next_event_code != REPLAY_END && reader->next_event_tick <= tick) {
+		if (reader->next_event_code < DIR_NONE) {
+			ctx->state.pacman.entity_state.dir = ctx->def_vals.dirs[reader->next_event_code];
+		}
+		else {
+			int num_dropped = reader->next_event_code - DIR_NONE + 1;
+			ctx->time.next_tick.tick += num_dropped * ctx->def_vals.skip_ticks;
+			tick += num_dropped;
+		}
+		read_next_event(reader);
+	}
+
+	if (!ctx->is_running || tick >= reader->final_tick) return 0;
+
+	step_game_tick(ctx);
+	return 1;
+}
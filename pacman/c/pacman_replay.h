@@ -0,0 +1,68 @@
+#ifndef PACMAN_REPLAY_H
+#define PACMAN_REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pacman_game.h"
+
+/*
+ * Replay file: "PMRP", a version byte, the ghost targeting mode, the RNG
+ * seed, the number of ghosts as 16 bits and the 8-byte hash of the level set
+ * the game was played on (get_level_set_hash), then one event per input as two
+ * varints: game ticks since the previous event and a code. Codes below
+ * DIR_NONE set pacman's direction, REPLAY_END ends the list and anything in
+ * between skips (code - DIR_NONE + 1) game ticks the frontend dropped. After
+ * the end code come the final game tick and score as varints and the 8-byte
+ * state hash.
+ *
+ * Ticks count game ticks (next_tick / skip_ticks), dropped ones included.
+ */
+#define REPLAY_VERSION 3
+#define REPLAY_END 0xff
+
+typedef struct {
+	uint8_t* data;
+	size_t size;
+	size_t capacity;
+	int last_tick;
+} replay_recorder_t;
+
+typedef struct {
+	uint8_t* data;
+	size_t size;
+	size_t pos;
+
+	ghost_targeting_t ghost_targeting;
+	int seed;
+	int num_ghosts;
+	uint64_t level_set_hash;
+
+	int next_event_tick;
+	int next_event_code;
+
+	int final_tick;
+	int final_score;
+	uint64_t final_hash;
+} replay_reader_t;
+
+/* Call right after init_level(ctx, 0). Recording functions return -1 if out of memory. */
+int begin_replay_recording(replay_recorder_t* recorder, game_ctx_t* ctx);
+int record_replay_dir(replay_recorder_t* recorder, game_ctx_t* ctx, dir_t dir);
+int record_replay_drop(replay_recorder_t* recorder, game_ctx_t* ctx, int num_ticks);
+int save_replay(replay_recorder_t* recorder, game_ctx_t* ctx, const char* path);
+void free_replay_recorder(replay_recorder_t* recorder);
+
+/* Returns -1 if the file cannot be read or is not a replay, also when its ghost targeting mode is unknown. */
+int load_replay(replay_reader_t* reader, const char* path);
+void free_replay_reader(replay_reader_t* reader);
+
+/*
+ * Starts the recorded game on ctx's level set, returning -1 if that is not
+ * the set it was recorded on; step_replay() then runs one game tick,
+ * returning 0 once the recording is over.
+ */
+int init_replay_game(replay_reader_t* reader, game_ctx_t* ctx);
+int step_replay(replay_reader_t* reader, game_ctx_t* ctx);
+
+#endif
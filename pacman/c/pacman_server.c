@@ -0,0 +1,656 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "pacman_input.h"
+#include "pacman_level.h"
+#include "pacman_platform.h"
+#include "pacman_server.h"
+#include "pacman_workers.h"
+
+/*
+ * Hosts many games from one process (Linux only). One thread runs an epoll
+ * loop over the listening socket, the clients, a timerfd firing once per game
+ * tick and a signalfd for SIGINT and SIGTERM. On each tick every session is
+ * stepped on a worker pool, and each worker also encodes and sends the frames
+ * of its sessions, so the send calls are spread over the cores as well.
+ * Input is read and sessions come and go on the loop thread, between ticks,
+ * so no two threads ever touch the same session.
+ *
+ * A session queues its frames in a buffer of SESSION_BUFFER_SIZE bytes. When
+ * a client does not read, the socket and then the buffer fill up; frames with
+ * no room are dropped, and once EPOLLOUT has drained the buffer the client is
+ * sent a full frame to catch up.
+ */
+#define SESSION_BUFFER_SIZE 8192
+#define SESSION_GRAIN 16
+#define MAX_EPOLL_EVENTS 256
+#define DEFAULT_MAX_SESSIONS 16384
+/* Descriptors the server keeps for itself, out of the open file limit. */
+#define RESERVED_FDS 16
+
+/* epoll data of the descriptors that are not sessions; a session's is its slot plus EPOLL_SESSION_BASE. */
+enum {
+	EPOLL_LISTEN,
+	EPOLL_TIMER,
+	EPOLL_SIGNAL,
+	EPOLL_SESSION_BASE
+};
+
+typedef struct {
+	/* -1 while the slot is free. */
+	int fd;
+	int active_idx;
+	game_ctx_t game;
+
+	/* The last direction byte received since the previous tick, or DIR_NONE. */
+	uint8_t next_dir;
+	short needs_full_frame;
+	/* Waiting for EPOLLOUT; workers leave the buffer to the loop thread meanwhile. */
+	short is_writing;
+	short is_closing;
+
+	int out_begin;
+	int out_end;
+	uint8_t out[SESSION_BUFFER_SIZE];
+
+	long long num_bytes_sent;
+	long long num_bytes_received;
+	long long num_dropped_frames;
+	int num_episodes;
+} session_t;
+
+static const char* ghost_targeting_names[] = { "greedy", "table", "field" };
+
+static struct {
+	const char* socket_path;
+	int port;
+	int num_threads;
+	int ticks_per_second;
+	int duration_s;
+	int max_sessions;
+	int seed;
+	ghost_targeting_t ghost_targeting;
+	int num_ghosts;
+	const char* level_pack_path;
+
+	level_pack_t level_pack;
+	worker_pool_t pool;
+	int epoll_fd;
+	int listen_fd;
+	int timer_fd;
+	int signal_fd;
+	short is_stopping;
+
+	session_t* sessions;
+	int* free_slots;
+	int num_free_slots;
+	int* active;
+	int num_active;
+	int xorshift;
+
+	long long tick_ns;
+	long long start_ns;
+	long long num_timer_ticks;
+	long long num_ticks;
+	long long num_missed_ticks;
+	long long num_session_ticks;
+	latency_histogram_t tick_lateness;
+	latency_histogram_t tick_work;
+
+	int num_accepted;
+	int num_rejected;
+	int peak_sessions;
+	long long num_bytes_sent;
+	long long num_bytes_received;
+	long long num_dropped_frames;
+	long long num_episodes;
+} server = {
+	.socket_path = DEFAULT_SERVER_SOCKET_PATH,
+	.max_sessions = DEFAULT_MAX_SESSIONS,
+	.seed = 0x12345678,
+	.ghost_targeting = GHOST_TARGETING_GREEDY,
+	.epoll_fd = -1,
+	.listen_fd = -1,
+	.timer_fd = -1,
+	.signal_fd = -1
+};
+
+static int parse_ghost_targeting(const char* name, ghost_targeting_t* targeting) {
+	for (int i = 0; i < (int)(sizeof(ghost_targeting_names) / sizeof(ghost_targeting_names[0])); i++) {
+		if (strcmp(name, ghost_targeting_names[i]) == 0) {
+			*targeting = (ghost_targeting_t)i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static int server_xorshift32(void) {
+	int x = server.xorshift;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return server.xorshift = x;
+}
+
+static void put_u16(uint8_t* data, unsigned int value) {
+	data[0] = (uint8_t)value;
+	data[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* data, uint32_t value) {
+	put_u16(data, value & 0xffff);
+	put_u16(data + 2, value >> 16);
+}
+
+static unsigned int encode_cell(game_ctx_t* ctx, vector_2d_t pos) {
+	tile_type_t type = get_tile_repr(ctx, pos) == ' ' ? TILE_EMPTY : get_tile_type(ctx, pos);
+	return (unsigned int)(pos.y * MAX_BOARD_WIDTH + pos.x) | (unsigned int)type << SERVER_CELL_POS_BITS;
+}
+
+/* Returns NULL when the buffer has no room for size more bytes. */
+static uint8_t* reserve_output(session_t* session, int size) {
+	if (session->out_begin == session->out_end) session->out_begin = session->out_end = 0;
+
+	if (session->out_end + size > SESSION_BUFFER_SIZE && session->out_begin > 0) {
+		memmove(session->out, session->out + session->out_begin, session->out_end - session->out_begin);
+		session->out_end -= session->out_begin;
+		session->out_begin = 0;
+	}
+	if (session->out_end + size > SESSION_BUFFER_SIZE) return NULL;
+
+	uint8_t* data = session->out + session->out_end;
+	session->out_end += size;
+	return data;
+}
+
+static void queue_hello(session_t* session) {
+	uint8_t* frame = reserve_output(session, SERVER_FRAME_HEADER_SIZE);
+
+	memset(frame, 0, SERVER_FRAME_HEADER_SIZE);
+	frame[0] = SERVER_FRAME_HELLO;
+	frame[1] = (uint8_t)session->game.def_vals.level_set.max_width;
+	frame[2] = (uint8_t)session->game.def_vals.level_set.max_height;
+	put_u32(frame + 4, (uint32_t)(server.tick_ns / 1000));
+	put_u32(frame + 8, (uint32_t)getpid());
+}
+
+/* Queues the tiles the last tick changed, or all of them when the client needs a full frame. */
+static void queue_frame(session_t* session) {
+	game_ctx_t* ctx = &session->game;
+	const short width = ctx->def_vals.window_width;
+	const short height = ctx->def_vals.window_height;
+
+	if (ctx->state.is_redraw_pending) session->needs_full_frame = 1;
+	int num_cells = session->needs_full_frame ? width * height : ctx->state.num_pending_tile_updates;
+
+	uint8_t* frame = reserve_output(session, SERVER_FRAME_HEADER_SIZE + 2 * num_cells);
+	ctx->state.num_pending_tile_updates = 0;
+	ctx->state.is_redraw_pending = 0;
+	if (frame == NULL) {
+		session->needs_full_frame = 1;
+		session->num_dropped_frames++;
+		return;
+	}
+
+	frame[0] = session->needs_full_frame ? SERVER_FRAME_FULL : SERVER_FRAME_DELTA;
+	frame[1] = (uint8_t)ctx->state.num_lives;
+	put_u16(frame + 2, (unsigned int)num_cells);
+	put_u32(frame + 4, (uint32_t)(ctx->time.current_tick / ctx->def_vals.skip_ticks));
+	put_u32(frame + 8, (uint32_t)ctx->state.score);
+
+	uint8_t* cell = frame + SERVER_FRAME_HEADER_SIZE;
+	if (session->needs_full_frame) {
+		for (short y = 0; y < height; y++) {
+			for (short x = 0; x < width; x++, cell += 2) put_u16(cell, encode_cell(ctx, (vector_2d_t){ .x = x, .y = y }));
+		}
+	}
+	else {
+		for (int i = 0; i < num_cells; i++, cell += 2) put_u16(cell, encode_cell(ctx, ctx->state.pending_tile_updates[i]));
+	}
+	session->needs_full_frame = 0;
+}
+
+/* Sends as much of the buffer as the socket takes; returns -1 once the client is gone. */
+static int flush_session(session_t* session) {
+	while (session->out_begin < session->out_end) {
+		ssize_t num_sent = send(session->fd, session->out + session->out_begin, session->out_end - session->out_begin, MSG_NOSIGNAL);
+		if (num_sent < 0) {
+			if (errno == EINTR) continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+		session->out_begin += (int)num_sent;
+		session->num_bytes_sent += num_sent;
+	}
+	return 0;
+}
+
+/* Runs on a worker: nothing else touches the session until every worker is done. */
+static void tick_session(session_t* session) {
+	game_ctx_t* ctx = &session->game;
+
+	if (session->next_dir < DIR_NONE) ctx->state.pacman.entity_state.dir = ctx->def_vals.dirs[session->next_dir];
+	session->next_dir = DIR_NONE;
+
+	step_game_tick(ctx);
+	if (!ctx->is_running) {
+		session->num_episodes++;
+		restart_game(ctx);
+		session->needs_full_frame = 1;
+	}
+
+	queue_frame(session);
+	if (!session->is_writing && flush_session(session) != 0) session->is_closing = 1;
+}
+
+static void tick_sessions(void* arg, int begin, int end) {
+	(void)arg;
+	for (int i = begin; i < end; i++) tick_session(&server.sessions[server.active[i]]);
+}
+
+static void set_session_writing(session_t* session, short is_writing) {
+	struct epoll_event event = { .events = EPOLLIN | (is_writing ? EPOLLOUT : 0), .data.u64 = (uint64_t)(session - server.sessions) + EPOLL_SESSION_BASE };
+	if (epoll_ctl(server.epoll_fd, EPOLL_CTL_MOD, session->fd, &event) != 0) session->is_closing = 1;
+	else session->is_writing = is_writing;
+}
+
+static void close_session(session_t* session) {
+	close(session->fd);
+	session->fd = -1;
+	cleanup(&session->game);
+
+	server.num_bytes_sent += session->num_bytes_sent;
+	server.num_bytes_received += session->num_bytes_received;
+	server.num_dropped_frames += session->num_dropped_frames;
+	server.num_episodes += session->num_episodes;
+
+	int last = server.active[--server.num_active];
+	server.active[session->active_idx] = last;
+	server.sessions[last].active_idx = session->active_idx;
+	server.free_slots[server.num_free_slots++] = (int)(session - server.sessions);
+}
+
+static void open_session(int fd) {
+	int slot = server.free_slots[--server.num_free_slots];
+	session_t* session = &server.sessions[slot];
+
+	memset(session, 0, sizeof(session_t));
+	session->fd = fd;
+	session->next_dir = DIR_NONE;
+	session->needs_full_frame = 1;
+	session->active_idx = server.num_active;
+	server.active[server.num_active++] = slot;
+
+	game_ctx_t* ctx = &session->game;
+	ctx->def_vals.ghost_targeting = server.ghost_targeting;
+	ctx->def_vals.num_ghosts = server.num_ghosts;
+	ctx->def_vals.level_set = server.level_pack.level_set;
+	init_level(ctx, 0);
+	ctx->state.xorshift = server_xorshift32();
+
+	struct epoll_event event = { .events = EPOLLIN, .data.u64 = (uint64_t)slot + EPOLL_SESSION_BASE };
+	queue_hello(session);
+	queue_frame(session);
+	if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0 || flush_session(session) != 0) {
+		close_session(session);
+		return;
+	}
+	if (session->out_begin < session->out_end) set_session_writing(session, 1);
+
+	server.num_accepted++;
+	if (server.num_active > server.peak_sessions) server.peak_sessions = server.num_active;
+}
+
+static void accept_sessions(void) {
+	while (1) {
+		int fd = accept4(server.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			return;
+		}
+		if (server.num_free_slots == 0) {
+			close(fd);
+			server.num_rejected++;
+			continue;
+		}
+		if (server.port > 0) {
+			int on = 1;
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		}
+		open_session(fd);
+	}
+}
+
+/* Returns -1 once the client has gone. */
+static int read_session_input(session_t* session) {
+	uint8_t buf[256];
+	while (1) {
+		ssize_t num_read = recv(session->fd, buf, sizeof(buf), 0);
+		if (num_read == 0) return -1;
+		if (num_read < 0) {
+			if (errno == EINTR) continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+		}
+
+		for (ssize_t i = 0; i < num_read; i++) {
+			if (buf[i] < DIR_NONE) session->next_dir = buf[i];
+		}
+		session->num_bytes_received += num_read;
+	}
+}
+
+static void handle_session_event(int slot, uint32_t events) {
+	session_t* session = &server.sessions[slot];
+	/* Closed earlier in the same batch of events. */
+	if (session->fd < 0) return;
+
+	if ((events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && read_session_input(session) != 0) {
+		close_session(session);
+		return;
+	}
+	if (events & EPOLLOUT) {
+		if (flush_session(session) != 0) close_session(session);
+		else if (session->out_begin == session->out_end) set_session_writing(session, 0);
+	}
+	if (session->fd >= 0 && session->is_closing) close_session(session);
+}
+
+/*
+ * A timer expiration that was not read in time adds to the count, so ticks
+ * the loop was too late for are skipped and counted instead of run back to
+ * back; lateness is from the deadline of the last one.
+ */
+static void run_tick(void) {
+	uint64_t num_expirations;
+	if (read(server.timer_fd, &num_expirations, sizeof(num_expirations)) != sizeof(num_expirations)) return;
+
+	const long long tick_start_ns = get_time_ns();
+	server.num_timer_ticks += (long long)num_expirations;
+	server.num_missed_ticks += (long long)num_expirations - 1;
+	record_latency(&server.tick_lateness, tick_start_ns - (server.start_ns + server.num_timer_ticks * server.tick_ns));
+
+	run_worker_jobs(&server.pool, tick_sessions, NULL, server.num_active, SESSION_GRAIN);
+	server.num_ticks++;
+	server.num_session_ticks += server.num_active;
+
+	/* Backwards, as closing a session moves the last one into its place. */
+	for (int i = server.num_active - 1; i >= 0; i--) {
+		session_t* session = &server.sessions[server.active[i]];
+		if (!session->is_closing && !session->is_writing && session->out_begin < session->out_end) set_session_writing(session, 1);
+		if (session->is_closing) close_session(session);
+	}
+
+	const long long now_ns = get_time_ns();
+	record_latency(&server.tick_work, now_ns - tick_start_ns);
+	if (server.duration_s > 0 && now_ns - server.start_ns >= server.duration_s * 1000000000LL) server.is_stopping = 1;
+}
+
+static int open_listen_socket(void) {
+	int fd;
+	if (server.port > 0) {
+		struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)server.port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+		int on = 1;
+		fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0) return -1;
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+			close(fd);
+			return -1;
+		}
+	}
+	else {
+		struct sockaddr_un addr = { .sun_family = AF_UNIX };
+		if (strlen(server.socket_path) >= sizeof(addr.sun_path)) return -1;
+		strcpy(addr.sun_path, server.socket_path);
+
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd < 0) return -1;
+		unlink(server.socket_path);
+		if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	if (listen(fd, SOMAXCONN) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Sessions are capped by the open file limit, which is first raised as far as allowed. */
+static int get_session_limit(void) {
+	struct rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return server.max_sessions;
+
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+	getrlimit(RLIMIT_NOFILE, &limit);
+
+	long long num_fds = limit.rlim_cur == RLIM_INFINITY ? server.max_sessions : (long long)limit.rlim_cur - RESERVED_FDS;
+	return num_fds < server.max_sessions ? (int)num_fds : server.max_sessions;
+}
+
+/* SIGINT and SIGTERM arrive through the signalfd; they are blocked before the pool starts, so no worker takes them. */
+static int init_server(void) {
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	if (sigprocmask(SIG_BLOCK, &signals, NULL) != 0) return -1;
+	signal(SIGPIPE, SIG_IGN);
+
+	server.max_sessions = get_session_limit();
+	server.sessions = (session_t*)calloc(server.max_sessions, sizeof(session_t));
+	server.free_slots = (int*)malloc(server.max_sessions * sizeof(int));
+	server.active = (int*)malloc(server.max_sessions * sizeof(int));
+	if (server.max_sessions < 1 || server.sessions == NULL || server.free_slots == NULL || server.active == NULL) return -1;
+
+	for (int i = 0; i < server.max_sessions; i++) {
+		server.sessions[i].fd = -1;
+		server.free_slots[i] = server.max_sessions - 1 - i;
+	}
+	server.num_free_slots = server.max_sessions;
+	server.xorshift = server.seed;
+
+	if (init_worker_pool(&server.pool, server.num_threads) != 0) return -1;
+
+	/* A session's game only sets the tick period here; the ghosts' timings are in game ticks and do not change with it. */
+	game_ctx_t probe = { 0 };
+	probe.def_vals.level_set = server.level_pack.level_set;
+	init_level(&probe, 0);
+	server.tick_ns = server.ticks_per_second > 0 ? 1000000000LL / server.ticks_per_second : 1000000000LL * probe.def_vals.skip_ticks / probe.def_vals.ticks_per_second;
+	cleanup(&probe);
+
+	server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	server.listen_fd = open_listen_socket();
+	server.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	server.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (server.epoll_fd < 0 || server.listen_fd < 0 || server.timer_fd < 0 || server.signal_fd < 0) return -1;
+
+	const int fds[] = { [EPOLL_LISTEN] = server.listen_fd, [EPOLL_TIMER] = server.timer_fd, [EPOLL_SIGNAL] = server.signal_fd };
+	for (int i = 0; i < EPOLL_SESSION_BASE; i++) {
+		struct epoll_event event = { .events = EPOLLIN, .data.u64 = (uint64_t)i };
+		if (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, fds[i], &event) != 0) return -1;
+	}
+
+	/* Absolute deadlines, so the ticks do not drift however late each one is read. */
+	server.start_ns = get_time_ns();
+	struct itimerspec timer = {
+		.it_interval = { .tv_sec = server.tick_ns / 1000000000LL, .tv_nsec = server.tick_ns % 1000000000LL },
+		.it_value = { .tv_sec = (server.start_ns + server.tick_ns) / 1000000000LL, .tv_nsec = (server.start_ns + server.tick_ns) % 1000000000LL }
+	};
+	return timerfd_settime(server.timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+}
+
+static void shutdown_server(void) {
+	while (server.num_active > 0) close_session(&server.sessions[server.active[server.num_active - 1]]);
+
+	if (server.pool.threads != NULL) shutdown_worker_pool(&server.pool);
+	if (server.signal_fd >= 0) close(server.signal_fd);
+	if (server.timer_fd >= 0) close(server.timer_fd);
+	if (server.listen_fd >= 0) close(server.listen_fd);
+	if (server.epoll_fd >= 0) close(server.epoll_fd);
+	if (server.listen_fd >= 0 && server.port == 0) unlink(server.socket_path);
+
+	free(server.sessions);
+	free(server.free_slots);
+	free(server.active);
+	close_level_pack(&server.level_pack);
+}
+
+static void run_server(void) {
+	struct epoll_event events[MAX_EPOLL_EVENTS];
+
+	while (!server.is_stopping) {
+		int num_events = epoll_wait(server.epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+		if (num_events < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+
+		for (int i = 0; i < num_events; i++) {
+			uint64_t data = events[i].data.u64;
+			if (data == EPOLL_LISTEN) accept_sessions();
+			else if (data == EPOLL_TIMER) run_tick();
+			else if (data == EPOLL_SIGNAL) server.is_stopping = 1;
+			else handle_session_event((int)(data - EPOLL_SESSION_BASE), events[i].events);
+		}
+	}
+}
+
+/* Sessions per core is the average number of sessions over the CPU time the whole process took for them. */
+static void print_server_report(long long elapsed_ns) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	const double cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	const double avg_sessions = server.num_ticks > 0 ? (double)server.num_session_ticks / server.num_ticks : 0;
+	const double session_s = server.num_session_ticks * (server.tick_ns / 1e9);
+
+	printf("threads: %d\n", server.num_threads);
+	printf("tick_period_us: %lld\n", server.tick_ns / 1000);
+	printf("sessions_accepted: %d\n", server.num_accepted);
+	printf("sessions_rejected: %d\n", server.num_rejected);
+	printf("sessions_peak: %d\n", server.peak_sessions);
+	printf("sessions_avg: %.1f\n", avg_sessions);
+	printf("elapsed_s: %.3f\n", elapsed_ns / 1e9);
+	printf("ticks: %lld\n", server.num_ticks);
+	printf("missed_ticks: %lld\n", server.num_missed_ticks);
+	printf("tick_late_us: p50 %lld, p99 %lld, max %lld\n", get_latency_percentile_us(&server.tick_lateness, 0.5),
+		get_latency_percentile_us(&server.tick_lateness, 0.99), server.tick_lateness.max_ns / 1000);
+	printf("tick_work_us: p50 %lld, p99 %lld, max %lld\n", get_latency_percentile_us(&server.tick_work, 0.5),
+		get_latency_percentile_us(&server.tick_work, 0.99), server.tick_work.max_ns / 1000);
+	printf("session_ticks: %lld\n", server.num_session_ticks);
+	printf("episodes: %lld\n", server.num_episodes);
+	printf("dropped_frames: %lld\n", server.num_dropped_frames);
+	printf("bytes_sent: %lld\n", server.num_bytes_sent);
+	printf("bytes_received: %lld\n", server.num_bytes_received);
+	printf("bytes_per_session_per_s: %.1f\n", session_s > 0 ? server.num_bytes_sent / session_s : 0);
+	printf("cpu_s: %.3f\n", cpu_s);
+	printf("sessions_per_core: %.1f\n", cpu_s > 0 ? avg_sessions * (elapsed_ns / 1e9) / cpu_s : 0);
+}
+
+static void print_usage(const char* program) {
+	fprintf(stderr,
+		"usage: %s [-u socket_path | -p port] [-t threads] [-r ticks_per_second] [-d seconds] [-m max_sessions] [-s seed] [-g greedy|table|field] [-G ghosts] [-l level_pack]\n"
+		"  -u  listen on this Unix domain socket (default " DEFAULT_SERVER_SOCKET_PATH ")\n"
+		"  -p  listen on this TCP port of 127.0.0.1 instead\n"
+		"  -t  threads stepping the sessions (default all cores)\n"
+		"  -r  game ticks per second for every session, e.g. 60 for a stress test (default the game's own rate)\n"
+		"  -d  stop and report after this many seconds (default on SIGINT or SIGTERM)\n"
+		"  -m  most sessions at once, further connections are closed (default %d, or the open file limit)\n"
+		"  -s  seed of the RNG handing each new game its own seed; must not be 0\n"
+		"  -g  ghost targeting: greedy euclidean pick, shortest-path table or cached distance fields\n"
+		"  -G  number of ghosts in every game, cycling through the four personalities\n"
+		"  -l  play the levels of a pack built by pacman-levelc instead of the built-in maze\n",
+		program, DEFAULT_MAX_SESSIONS);
+}
+
+static int parse_server_args(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 >= argc || argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0') return -1;
+
+		const char* val = argv[++i];
+		switch (argv[i - 1][1])
+		{
+		case 'u':
+			server.socket_path = val;
+			break;
+		case 'p':
+			server.port = atoi(val);
+			break;
+		case 't':
+			server.num_threads = atoi(val);
+			break;
+		case 'r':
+			server.ticks_per_second = atoi(val);
+			break;
+		case 'd':
+			server.duration_s = atoi(val);
+			break;
+		case 'm':
+			server.max_sessions = atoi(val);
+			break;
+		case 's':
+			server.seed = (int)strtoul(val, NULL, 0);
+			break;
+		case 'g':
+			if (parse_ghost_targeting(val, &server.ghost_targeting) != 0) return -1;
+			break;
+		case 'G':
+			server.num_ghosts = atoi(val);
+			break;
+		case 'l':
+			server.level_pack_path = val;
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	if (server.port < 0 || server.port > 65535 || server.num_threads < 0 || server.ticks_per_second < 0 || server.duration_s < 0) return -1;
+	if (server.max_sessions < 1 || server.seed == 0 || server.num_ghosts < 0 || server.num_ghosts > MAX_GHOSTS) return -1;
+
+	if (server.num_threads == 0) server.num_threads = get_num_cores();
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if (parse_server_args(argc, argv) != 0) {
+		print_usage(argv[0]);
+		return 1;
+	}
+	if (server.level_pack_path != NULL && open_level_pack(&server.level_pack, server.level_pack_path) != 0) {
+		fprintf(stderr, "Error reading level pack %s\n", server.level_pack_path);
+		return 1;
+	}
+	if (init_server() != 0) {
+		perror("Error starting server");
+		shutdown_server();
+		return 1;
+	}
+
+	if (server.port > 0) fprintf(stderr, "listening on 127.0.0.1:%d\n", server.port);
+	else fprintf(stderr, "listening on %s\n", server.socket_path);
+
+	run_server();
+
+	const long long elapsed_ns = get_time_ns() - server.start_ns;
+	shutdown_server();
+	print_server_report(elapsed_ns);
+	return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef PACMAN_SERVER_H
+#define PACMAN_SERVER_H
+
+#include "pacman_game.h"
+
+/*
+ * Wire format of pacman-server (Linux only), shared with pacman-loadgen.
+ *
+ * A client sends single bytes: a dir_t below DIR_NONE turns its pacman and
+ * anything else is ignored. Of the bytes that arrive between two ticks, the
+ * last one is applied.
+ *
+ * The server sends frames, each a SERVER_FRAME_HEADER_SIZE header in little
+ * endian byte order, followed for delta and full frames by num_cells 16-bit
+ * cells:
+ *
+ *   0   u8   kind, a server_frame_kind_t
+ *   hello:
+ *   1   u8   width, of the widest level of the set
+ *   2   u8   height, of the tallest one
+ *   4   u32  tick period, in microseconds
+ *   8   u32  server pid, so a load generator on the same host can read its CPU time
+ *   delta and full:
+ *   1   u8   lives
+ *   2   u16  num_cells
+ *   4   u32  game ticks since the game began
+ *   8   u32  score
+ *
+ * A cell is y * MAX_BOARD_WIDTH + x in its low SERVER_CELL_POS_BITS bits and
+ * the tile_type_t shown there in the bits above, with eaten points, energizers
+ * and hearts shown as TILE_EMPTY. A delta frame lists the tiles that changed
+ * in a tick. A full frame lists every tile of the level; it comes right after
+ * the hello, after a restart or a level change, and once a client that was
+ * not reading has room again, since the deltas it missed were dropped.
+ */
+#define SERVER_FRAME_HEADER_SIZE 12
+#define SERVER_CELL_POS_BITS 11
+#define MAX_SERVER_FRAME_SIZE (SERVER_FRAME_HEADER_SIZE + 2 * MAX_BOARD_WIDTH * MAX_BOARD_HEIGHT)
+
+#define DEFAULT_SERVER_SOCKET_PATH "pacman-server.sock"
+
+typedef enum {
+	SERVER_FRAME_HELLO = 1,
+	SERVER_FRAME_DELTA,
+	SERVER_FRAME_FULL
+} server_frame_kind_t;
+
+#endif
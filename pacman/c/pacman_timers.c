@@ -0,0 +1,114 @@
+#include "pacman_timers.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+static int get_slot_digit(int tick, int level) {
+	return (tick >> (level * TIMER_WHEEL_SLOT_BITS)) & SLOT_MASK;
+}
+
+/*
+ * The level is the highest digit in which due and now differ, so due's digit
+ * there is ahead of now's and the wheel reaches the slot before the timer is
+ * due; a timer due now goes to now's own slot on level 0.
+ */
+static void link_timer(timer_wheel_t* wheel, game_timer_t* timers, int timer) {
+	game_timer_t* entry = &timers[timer];
+	int level = 0;
+	while (level < TIMER_WHEEL_LEVELS - 1 && (entry->due >> ((level + 1) * TIMER_WHEEL_SLOT_BITS)) != (wheel->now >> ((level + 1) * TIMER_WHEEL_SLOT_BITS))) level++;
+
+	int digit = get_slot_digit(entry->due, level);
+	short* head = &wheel->slots[level * TIMER_WHEEL_SLOTS + digit];
+
+	entry->slot = (short)(level * TIMER_WHEEL_SLOTS + digit);
+	entry->prev = -1;
+	entry->next = *head;
+	if (*head >= 0) timers[*head].prev = (short)timer;
+	*head = (short)timer;
+	wheel->occupied[level] |= 1ULL << digit;
+}
+
+static void unlink_timer(timer_wheel_t* wheel, game_timer_t* timers, int timer) {
+	game_timer_t* entry = &timers[timer];
+
+	if (entry->next >= 0) timers[entry->next].prev = entry->prev;
+	if (entry->prev >= 0) timers[entry->prev].next = entry->next;
+	else {
+		wheel->slots[entry->slot] = entry->next;
+		if (entry->next < 0) wheel->occupied[entry->slot / TIMER_WHEEL_SLOTS] &= ~(1ULL << (entry->slot & SLOT_MASK));
+	}
+	entry->slot = -1;
+}
+
+void init_timer_wheel(timer_wheel_t* wheel, game_timer_t* timers, int num_timers, int now) {
+	wheel->now = now;
+	for (int i = 0; i < TIMER_WHEEL_LEVELS; i++) wheel->occupied[i] = 0;
+	for (int i = 0; i < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; i++) wheel->slots[i] = -1;
+
+	for (int i = 0; i < num_timers; i++) timers[i] = (game_timer_t){ .due = 0, .next = -1, .prev = -1, .slot = -1 };
+}
+
+void schedule_timer(timer_wheel_t* wheel, game_timer_t* timers, int timer, int due) {
+	if (timers[timer].slot >= 0) unlink_timer(wheel, timers, timer);
+
+	timers[timer].due = due > wheel->now ? due : wheel->now + 1;
+	link_timer(wheel, timers, timer);
+}
+
+void cancel_timer(timer_wheel_t* wheel, game_timer_t* timers, int timer) {
+	if (timers[timer].slot >= 0) unlink_timer(wheel, timers, timer);
+}
+
+int is_timer_pending(const game_timer_t* timers, int timer) {
+	return timers[timer].slot >= 0;
+}
+
+static int get_lowest_digit(uint64_t slots) {
+	int digit = 0;
+	while (!((slots >> digit) & 1)) digit++;
+	return digit;
+}
+
+static void fire_slot(timer_wheel_t* wheel, game_timer_t* timers, int digit, fire_timer_t fire, void* arg) {
+	int timer;
+	while ((timer = wheel->slots[digit]) >= 0) {
+		unlink_timer(wheel, timers, timer);
+		fire(arg, timer);
+	}
+}
+
+/* now has just entered a new level 0 window: every level whose digit rolled over hands its slot down. */
+static void cascade_timers(timer_wheel_t* wheel, game_timer_t* timers) {
+	for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+		int digit = get_slot_digit(wheel->now, level);
+		int timer;
+		while ((timer = wheel->slots[level * TIMER_WHEEL_SLOTS + digit]) >= 0) {
+			unlink_timer(wheel, timers, timer);
+			link_timer(wheel, timers, timer);
+		}
+		if (digit != 0) break;
+	}
+}
+
+void advance_timer_wheel(timer_wheel_t* wheel, game_timer_t* timers, int now, fire_timer_t fire, void* arg) {
+	while (wheel->now < now) {
+		int window_end = wheel->now | SLOT_MASK;
+		int last = now < window_end ? now : window_end;
+
+		/* The slots after now's, up to last, within this window. */
+		uint64_t due = wheel->occupied[0] & (~1ULL << (wheel->now & SLOT_MASK)) & (~0ULL >> (SLOT_MASK - (last & SLOT_MASK)));
+		if (due != 0) {
+			wheel->now = (wheel->now & ~SLOT_MASK) + get_lowest_digit(due);
+			fire_slot(wheel, timers, wheel->now & SLOT_MASK, fire, arg);
+			continue;
+		}
+
+		if (last == now) {
+			wheel->now = now;
+			break;
+		}
+
+		wheel->now = window_end + 1;
+		cascade_timers(wheel, timers);
+		if (wheel->occupied[0] & 1) fire_slot(wheel, timers, 0, fire, arg);
+	}
+}
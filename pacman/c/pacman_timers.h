@@ -0,0 +1,61 @@
+#ifndef PACMAN_TIMERS_H
+#define PACMAN_TIMERS_H
+
+#include <stdint.h>
+
+/*
+ * A hierarchical timer wheel, for game events due at a known tick. Timers are
+ * the entries of a pool the caller owns and are named by their index in it;
+ * scheduling, cancelling and firing one is constant time, and ticks with
+ * nothing due cost next to nothing however many timers wait.
+ *
+ * Level 0 has a slot for each of the next TIMER_WHEEL_SLOTS ticks, and each
+ * level above covers TIMER_WHEEL_SLOTS times the span of the one below. A
+ * timer sits on the lowest level whose span still holds its due tick, and is
+ * moved down as the wheel reaches its slot. occupied marks the slots whose
+ * list is not empty, so advancing skips over empty ones a word at a time.
+ *
+ * Lists are linked by index and the wheel holds no pointers, so a copy of the
+ * wheel and of the pool is a snapshot of every timer. Indices are shorts, as
+ * with the ghost lists, which keeps the wheel under 1 KB and caps a pool at
+ * MAX_TIMERS.
+ */
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+/* Enough levels to cover any non-negative int tick. */
+#define TIMER_WHEEL_LEVELS 6
+#define MAX_TIMERS 32767
+
+typedef struct {
+	int due;
+	short next;
+	short prev;
+	/* level * TIMER_WHEEL_SLOTS + slot while pending, otherwise -1. */
+	short slot;
+} game_timer_t;
+
+typedef struct {
+	/* Every timer due at or before now has fired. */
+	int now;
+	uint64_t occupied[TIMER_WHEEL_LEVELS];
+	short slots[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+} timer_wheel_t;
+
+typedef void (*fire_timer_t)(void* arg, int timer);
+
+/* Empties the wheel and marks every timer of the pool as not pending. */
+void init_timer_wheel(timer_wheel_t* wheel, game_timer_t* timers, int num_timers, int now);
+
+/* Replaces whatever the timer was pending for; a due tick that has passed means the next advance. */
+void schedule_timer(timer_wheel_t* wheel, game_timer_t* timers, int timer, int due);
+void cancel_timer(timer_wheel_t* wheel, game_timer_t* timers, int timer);
+int is_timer_pending(const game_timer_t* timers, int timer);
+
+/*
+ * Moves the wheel on to now and calls fire(arg, timer) for each timer due by
+ * then, earliest first; a timer is no longer pending when it fires, and fire
+ * may schedule it, or any other, again.
+ */
+void advance_timer_wheel(timer_wheel_t* wheel, game_timer_t* timers, int now, fire_timer_t fire, void* arg);
+
+#endif
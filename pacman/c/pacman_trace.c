@@ -0,0 +1,86 @@
+#include "pacman_trace.h"
+
+#ifdef PACMAN_TRACE
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+	const char* name;
+	const char* arg_name;
+	long long arg;
+	long long start_ns;
+	long long end_ns;
+} trace_event_t;
+
+typedef struct trace_buffer {
+	struct trace_buffer* next;
+	int tid;
+	atomic_llong num_events;
+	trace_event_t events[TRACE_BUFFER_EVENTS];
+} trace_buffer_t;
+
+static _Atomic(trace_buffer_t*) trace_buffers = NULL;
+static atomic_int num_trace_threads = 0;
+_Thread_local int trace_mute_depth = 0;
+static _Thread_local trace_buffer_t* thread_buffer = NULL;
+
+/* Buffers are pushed onto the list and never removed until exit, so the push is the only shared write. */
+static trace_buffer_t* get_thread_buffer(void) {
+	if (thread_buffer != NULL) return thread_buffer;
+
+	trace_buffer_t* buffer = (trace_buffer_t*)calloc(1, sizeof(trace_buffer_t));
+	if (buffer == NULL) return NULL;
+	buffer->tid = atomic_fetch_add(&num_trace_threads, 1) + 1;
+
+	buffer->next = atomic_load(&trace_buffers);
+	while (!atomic_compare_exchange_weak(&trace_buffers, &buffer->next, buffer));
+
+	return thread_buffer = buffer;
+}
+
+/* An end_ns of -1 makes an instant event. */
+void record_trace_event(const char* name, long long start_ns, long long end_ns, const char* arg_name, long long arg) {
+	if (trace_mute_depth > 0) return;
+
+	trace_buffer_t* buffer = get_thread_buffer();
+	if (buffer == NULL) return;
+
+	long long idx = atomic_load_explicit(&buffer->num_events, memory_order_relaxed);
+	buffer->events[idx % TRACE_BUFFER_EVENTS] = (trace_event_t){ .name = name, .arg_name = arg_name, .arg = arg, .start_ns = start_ns, .end_ns = end_ns };
+	atomic_store_explicit(&buffer->num_events, idx + 1, memory_order_release);
+}
+
+/* Every event follows its thread's name record, so it always needs the separator. */
+static void write_trace_event(FILE* file, const trace_buffer_t* buffer, const trace_event_t* event) {
+	fprintf(file, ",\n{\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", event->name, buffer->tid, event->start_ns / 1e3);
+	if (event->end_ns < 0) fprintf(file, ",\"ph\":\"i\",\"s\":\"g\"");
+	else fprintf(file, ",\"ph\":\"X\",\"dur\":%.3f", (event->end_ns - event->start_ns) / 1e3);
+	if (event->arg_name != NULL) fprintf(file, ",\"args\":{\"%s\":%lld}", event->arg_name, event->arg);
+	fputc('}', file);
+}
+
+void write_trace(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Error writing trace %s\n", path);
+		return;
+	}
+
+	long long num_written = 0, num_dropped = 0;
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	for (trace_buffer_t* buffer = atomic_load(&trace_buffers); buffer != NULL; buffer = buffer->next) {
+		long long num_events = atomic_load_explicit(&buffer->num_events, memory_order_acquire);
+		long long first = num_events > TRACE_BUFFER_EVENTS ? num_events - TRACE_BUFFER_EVENTS : 0;
+
+		fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}", num_written > 0 ? "," : "", buffer->tid, buffer->tid);
+		num_written++;
+		for (long long i = first; i < num_events; i++, num_written++) write_trace_event(file, buffer, &buffer->events[i % TRACE_BUFFER_EVENTS]);
+		num_dropped += first;
+	}
+	fprintf(file, "\n]}\n");
+
+	if (fclose(file) != 0) fprintf(stderr, "Error writing trace %s\n", path);
+	else fprintf(stderr, "trace: %s, %d threads, %lld events dropped from full buffers\n", path, atomic_load(&num_trace_threads), num_dropped);
+}
+#endif
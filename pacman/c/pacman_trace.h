@@ -0,0 +1,52 @@
+#ifndef PACMAN_TRACE_H
+#define PACMAN_TRACE_H
+
+/*
+ * Hot-path tracing, compiled in with -DPACMAN_TRACE. TRACE_SPAN(name, statement)
+ * runs the statement and records how long it took; TRACE_SPAN_ARG() adds one
+ * named integer, such as the tick or the ghost index, and TRACE_INSTANT()
+ * marks a moment. TRACE_MUTED(statement) records nothing from within the
+ * statement on its thread, for work such as search rollouts on clone games
+ * that would bury the real game's spans. Without PACMAN_TRACE they are all the
+ * bare statement or nothing.
+ *
+ * Each thread records into a ring buffer of its own, so recording takes no
+ * locks; once full, a buffer keeps the last TRACE_BUFFER_EVENTS events.
+ * TRACE_WRITE() dumps every buffer as Chrome trace-event JSON, which
+ * chrome://tracing and ui.perfetto.dev open. Call it after the threads that
+ * trace have stopped.
+ */
+#define TRACE_BUFFER_EVENTS 65536
+#define TRACE_PATH "pacman-trace.json"
+
+#ifdef PACMAN_TRACE
+#include "pacman_platform.h"
+
+extern _Thread_local int trace_mute_depth;
+
+void record_trace_event(const char* name, long long start_ns, long long end_ns, const char* arg_name, long long arg);
+void write_trace(const char* path);
+
+/* Muted spans skip the clock too, so muted work runs at full speed. */
+#define TRACE_SPAN_ARG(name, arg_name, arg, statement) do { \
+	if (trace_mute_depth > 0) statement; \
+	else { \
+		long long trace_start_ns = get_time_ns(); \
+		statement; \
+		record_trace_event(name, trace_start_ns, get_time_ns(), arg_name, arg); \
+	} \
+} while (0)
+
+#define TRACE_SPAN(name, statement) TRACE_SPAN_ARG(name, NULL, 0, statement)
+#define TRACE_INSTANT(name, arg_name, arg) record_trace_event(name, get_time_ns(), -1, arg_name, arg)
+#define TRACE_MUTED(statement) do { trace_mute_depth++; statement; trace_mute_depth--; } while (0)
+#define TRACE_WRITE() write_trace(TRACE_PATH)
+#else
+#define TRACE_SPAN_ARG(name, arg_name, arg, statement) statement
+#define TRACE_SPAN(name, statement) statement
+#define TRACE_INSTANT(name, arg_name, arg) ((void)0)
+#define TRACE_MUTED(statement) statement
+#define TRACE_WRITE() ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+#include <stdlib.h>
+
+#include "pacman_workers.h"
+
+/* Several chunks per thread, so the others can steal from a thread whose range turns out slow. */
+#define CHUNKS_PER_THREAD 4
+#define MIN_CHUNK 32
+
+static int take_chunk(worker_queue_t* queue, int grain) {
+	if (atomic_load_explicit(&queue->next, memory_order_relaxed) >= queue->end) return -1;
+
+	int begin = atomic_fetch_add_explicit(&queue->next, grain, memory_order_relaxed);
+	return begin < queue->end ? begin : -1;
+}
+
+/* Drains the thread's own range first, then steals chunks from the others. */
+static void run_chunks(worker_pool_t* pool, int worker_id) {
+	for (int i = 0; i < pool->num_threads; i++) {
+		worker_queue_t* queue = &pool->queues[(worker_id + i) % pool->num_threads];
+
+		int begin;
+		while ((begin = take_chunk(queue, pool->grain)) != -1) {
+			int end = begin + pool->grain < queue->end ? begin + pool->grain : queue->end;
+			pool->job(pool->arg, begin, end);
+		}
+	}
+}
+
+static void* worker_main(void* param) {
+	worker_pool_t* pool = (worker_pool_t*)param;
+	/* The calling thread is worker 0. */
+	int worker_id = atomic_fetch_add_explicit(&pool->next_worker_id, 1, memory_order_relaxed) + 1;
+	int generation = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while (1) {
+		while (pool->generation == generation && !pool->is_shutting_down) pthread_cond_wait(&pool->work_ready, &pool->lock);
+		if (pool->is_shutting_down) break;
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+
+		run_chunks(pool, worker_id);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->num_busy_workers == 0) pthread_cond_signal(&pool->work_done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+int init_worker_pool(worker_pool_t* pool, int num_threads) {
+	if (num_threads < 1) return -1;
+
+	pool->num_threads = num_threads;
+	pool->threads = (pthread_t*)malloc(num_threads * sizeof(pthread_t));
+	pool->queues = (worker_queue_t*)aligned_alloc(WORKER_CACHE_LINE_SIZE, num_threads * sizeof(worker_queue_t));
+	if (pool->threads == NULL || pool->queues == NULL) {
+		free(pool->threads);
+		free(pool->queues);
+		return -1;
+	}
+	atomic_init(&pool->next_worker_id, 0);
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_ready, NULL);
+	pthread_cond_init(&pool->work_done, NULL);
+	pool->generation = 0;
+	pool->num_busy_workers = 0;
+	pool->is_shutting_down = 0;
+
+	for (int i = 1; i < num_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+			pool->num_threads = i;
+			shutdown_worker_pool(pool);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void shutdown_worker_pool(worker_pool_t* pool) {
+	pthread_mutex_lock(&pool->lock);
+	pool->is_shutting_down = 1;
+	pthread_cond_broadcast(&pool->work_ready);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 1; i < pool->num_threads; i++) pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work_ready);
+	pthread_cond_destroy(&pool->work_done);
+	free(pool->threads);
+	free(pool->queues);
+	pool->threads = NULL;
+	pool->queues = NULL;
+	pool->num_threads = 0;
+}
+
+void run_worker_jobs(worker_pool_t* pool, void (*job)(void* arg, int begin, int end), void* arg, int count, int grain) {
+	if (pool->num_threads == 1) {
+		job(arg, 0, count);
+		return;
+	}
+
+	pool->job = job;
+	pool->arg = arg;
+	pool->grain = grain;
+
+	int per_queue = (count + pool->num_threads - 1) / pool->num_threads;
+	for (int i = 0; i < pool->num_threads; i++) {
+		int begin = i * per_queue < count ? i * per_queue : count;
+		atomic_store_explicit(&pool->queues[i].next, begin, memory_order_relaxed);
+		pool->queues[i].end = begin + per_queue < count ? begin + per_queue : count;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->num_busy_workers = pool->num_threads - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_ready);
+	pthread_mutex_unlock(&pool->lock);
+
+	run_chunks(pool, 0);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->num_busy_workers > 0) pthread_cond_wait(&pool->work_done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void run_game_steps(void* arg, int begin, int end) {
+	worker_pool_t* pool = (worker_pool_t*)arg;
+	pool->step(pool->ctx, begin, end);
+}
+
+void run_worker_pool(void* param, game_ctx_t* ctx, void (*step)(game_ctx_t* ctx, int begin, int end), int count) {
+	worker_pool_t* pool = (worker_pool_t*)param;
+	int grain = count / (pool->num_threads * CHUNKS_PER_THREAD);
+
+	pool->ctx = ctx;
+	pool->step = step;
+	run_worker_jobs(pool, run_game_steps, pool, count, grain > MIN_CHUNK ? grain : MIN_CHUNK);
+}
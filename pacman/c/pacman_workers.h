@@ -0,0 +1,53 @@
+#ifndef PACMAN_WORKERS_H
+#define PACMAN_WORKERS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "pacman_game.h"
+
+#define WORKER_CACHE_LINE_SIZE 64
+
+/* One thread's share of a run, taken grain by grain from next up to end. */
+typedef struct {
+	_Alignas(WORKER_CACHE_LINE_SIZE) atomic_int next;
+	int end;
+} worker_queue_t;
+
+/*
+ * A work-stealing pool of threads (POSIX only). run_worker_jobs() splits
+ * [0, count) into one contiguous range per thread, the calling thread
+ * included; each thread works through its own range in chunks of grain, then
+ * steals chunks from the others' ranges, and the call returns once every
+ * chunk is done. run_worker_pool() does the same for a game's per-ghost steps
+ * and fits def_vals.run_parallel, with the pool as parallel_pool.
+ */
+typedef struct {
+	int num_threads;
+	pthread_t* threads;
+	worker_queue_t* queues;
+	atomic_int next_worker_id;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_ready;
+	pthread_cond_t work_done;
+	int generation;
+	int num_busy_workers;
+	short is_shutting_down;
+
+	void (*job)(void* arg, int begin, int end);
+	void* arg;
+	int grain;
+
+	game_ctx_t* ctx;
+	void (*step)(game_ctx_t* ctx, int begin, int end);
+} worker_pool_t;
+
+/* The calling thread is one of the num_threads, so num_threads - 1 are spawned. */
+int init_worker_pool(worker_pool_t* pool, int num_threads);
+void shutdown_worker_pool(worker_pool_t* pool);
+
+void run_worker_jobs(worker_pool_t* pool, void (*job)(void* arg, int begin, int end), void* arg, int count, int grain);
+void run_worker_pool(void* pool, game_ctx_t* ctx, void (*step)(game_ctx_t* ctx, int begin, int end), int count);
+
+#endif
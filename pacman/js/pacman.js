@@ -1,4 +1,5 @@
 import * as lib from "../../src/lib/quine_engine_lib.js"
+import { createCanvasRenderer } from "../../src/lib/quine_engine_canvas.js"
 
 const bgColor = "#41454d";
 
@@ -586,6 +587,7 @@ const updateGhosts = () => {
 }
 
 lib.setBackgroundColor(bgColor);
+lib.setRenderer(createCanvasRenderer);
 
 lib.initConfig({
     windowWidth: 28,
@@ -605,10 +607,6 @@ lib.setOnGameTick(() => {
     updatePacMan();
 })
 
-lib.setOnWindowResize(() => {
-    renderTiles();
-});
-
 lib.setKeybindings([
     {
         key: Direction.Up.key,
@@ -1,4 +1,13 @@
-const args = process.argv.slice(2);
+const flags = process.argv.slice(2).filter((arg) => arg.startsWith('--'));
+const args = process.argv.slice(2).filter((arg) => !arg.startsWith('--'));
+
+const knownFlags = ['--watch', '--dev', '--budget'];
+const unknownFlag = flags.find((flag) => !knownFlags.includes(flag.split('=')[0]));
+
+if(unknownFlag !== undefined) {
+    console.error(`Unknown option ${unknownFlag}; expected one of ${knownFlags.join(', ')}.`);
+    process.exit(1);
+}
 
 if(args.length < 1) {
     console.error("No required arguments provided.");
@@ -25,51 +34,102 @@ if(path.extname(srcFilePath) !== '.js') {
     process.exit(1);
 }
 
+const isWatching = flags.includes('--watch');
+const isDev = flags.includes('--dev');
+const profile = isDev ? 'dev' : 'release';
+
+// Release builds fail past the sizeBudget of package.json; --budget=<raw|gzip|brotli>:<bytes> overrides one limit.
+const budget = { ...JSON.parse(fs.readFileSync(new URL('./package.json', import.meta.url), 'utf8')).sizeBudget };
+for(const flag of flags.filter((flag) => flag.startsWith('--budget='))) {
+    const [metric, limit] = flag.substring('--budget='.length).split(':');
+    if(!['raw', 'gzip', 'brotli'].includes(metric) || !(Number(limit) > 0)) {
+        console.error(`Invalid option ${flag}; expected --budget=<raw|gzip|brotli>:<bytes>.`);
+        process.exit(1);
+    }
+    budget[metric] = Number(limit);
+}
+
 let libPath = JSON.stringify(path.resolve('../lib/quine_engine_lib.js'));
 libPath = libPath.substring(1, libPath.length-1);
 
 import * as rollup from 'rollup';
-import config from './rollup.config.mjs'
+import { createConfig } from './rollup.config.mjs'
 
-config.input = path.join(path.parse(srcFilePath).dir, `${path.parse(srcFilePath).name}-wrap.js`)
-config.output.file = `build/${path.parse(srcFilePath).name}-build.js`;
+const entryPath = path.resolve(srcFilePath);
 
-fs.copyFileSync(srcFilePath, config.input);
-
-const wrapContent = (filePath) => {
-    const before = `\nimport { setBgText } from '${libPath}';\nconst r=()=>{\nsetBgText(\`const r=\${r};r();\`);\n`;
-    const after = "\n};r();"
+const importLine = `\nimport { setBgText } from '${libPath}';`;
+const before = `\nconst r=()=>{\nsetBgText(\`const r=\${r};r();\`);\n`;
+const after = "\n};r();"
 
+// Everything after the last import becomes the body of r, which shows its own source as the background before it runs.
+const wrapContent = (content) => {
     const importEndRegex = /^(import\s|require\().*/gm;
-    const content = fs.readFileSync(filePath, 'utf8')
 
     let match;
     let insertIndex = 0;
     while ((match = importEndRegex.exec(content)) !== null) {
         insertIndex = importEndRegex.lastIndex;
     }
-    const combinedContent = content.slice(0, insertIndex) +  before + content.slice(insertIndex) + after;
-    fs.writeFileSync(filePath, combinedContent)
+    return content.slice(0, insertIndex) + importLine + before + content.slice(insertIndex) + after;
+}
+
+/*
+ * Wraps the entry as Rollup loads it, so nothing is written next to the source
+ * and builds can run side by side. The import is hoisted out of the bundle, so
+ * the rest of the wrapper is what it adds to the entry, for the size report.
+ */
+const quineWrap = () => ({
+    name: 'quine-wrap',
+    transform(code, id) {
+        if(id !== entryPath) return null;
+        return { code: wrapContent(code), map: null, meta: { quine: { wrapperLength: before.length + after.length } } };
+    }
+});
+
+const config = createConfig({
+    input: entryPath,
+    file: `build/${path.parse(srcFilePath).name}-build.js`,
+    dev: isDev,
+    budget,
+    plugins: [quineWrap()],
+});
+
+const reportBuild = (durationMs) => {
+    console.log(`Bundle created successfully in ${Math.round(durationMs)} ms (${profile}).`);
 }
 
 const createBundle = async (config) => {
+    const start = performance.now();
+    let bundle;
     try {
-        const bundle = await rollup.rollup(config);
+        bundle = await rollup.rollup(config);
         await bundle.write(config.output);
-        console.log('Bundle created successfully!');
+        reportBuild(performance.now() - start);
     } catch (error) {
         console.error('Error during bundle creation:', error);
+        process.exitCode = 1;
+    } finally {
+        if(bundle) await bundle.close();
     }
 }
 
-const cleanup = () => {
-    fs.unlinkSync(config.input);
-}
+// Rollup keeps the modules of the last build and only reloads and re-transforms the files that changed.
+const watchBundle = (config) => {
+    const watcher = rollup.watch({ ...config, watch: { clearScreen: false } });
+
+    watcher.on('event', (event) => {
+        if(event.code === 'BUNDLE_END') reportBuild(event.duration);
+        else if(event.code === 'ERROR') console.error('Error during bundle creation:', event.error);
+        else if(event.code === 'END') console.log('Watching for changes...');
+
+        if(event.result) event.result.close();
+    });
 
-const build = async () => {
-    wrapContent(config.input);
-    await createBundle(config);
-    cleanup();
+    process.on('SIGINT', async () => {
+        await watcher.close();
+        process.exit(0);
+    });
 }
 
-build();
\ No newline at end of file
+if(isWatching) watchBundle(config);
+else createBundle(config);
@@ -0,0 +1,117 @@
+import * as path from 'path';
+import * as zlib from 'zlib';
+import { minify } from 'terser';
+
+// Compressed sizes are taken at the strongest setting of each format, the way the artifacts are written.
+const compressors = {
+    gzip: [
+        { name: 'level 9', options: { level: 9, memLevel: 9 } },
+        { name: 'level 9, filtered', options: { level: 9, memLevel: 9, strategy: zlib.constants.Z_FILTERED } },
+    ],
+    brotli: [
+        { name: 'text', params: { [zlib.constants.BROTLI_PARAM_MODE]: zlib.constants.BROTLI_MODE_TEXT } },
+        { name: 'generic', params: { [zlib.constants.BROTLI_PARAM_MODE]: zlib.constants.BROTLI_MODE_GENERIC } },
+        { name: 'text, 64 KB window', params: { [zlib.constants.BROTLI_PARAM_MODE]: zlib.constants.BROTLI_MODE_TEXT, [zlib.constants.BROTLI_PARAM_LGWIN]: 16 } },
+    ],
+};
+
+const compress = (format, config, data) => format === 'gzip'
+    ? zlib.gzipSync(data, config.options)
+    : zlib.brotliCompressSync(data, { params: { [zlib.constants.BROTLI_PARAM_QUALITY]: zlib.constants.BROTLI_MAX_QUALITY, [zlib.constants.BROTLI_PARAM_SIZE_HINT]: data.length, ...config.params } });
+
+const compressSmallest = (format, data) => compressors[format]
+    .map((config) => ({ name: config.name, data: compress(format, config, data) }))
+    .reduce((best, result) => result.data.length < best.data.length ? result : best);
+
+const getSizes = (code) => {
+    const data = Buffer.from(code);
+    return { raw: data.length, gzip: compressSmallest('gzip', data).data.length, brotli: compressSmallest('brotli', data).data.length };
+}
+
+// One level deep, which is as deep as terser's option groups go.
+const mergeOptions = (base, variant) => {
+    const merged = { ...base };
+    for (const [key, value] of Object.entries(variant)) {
+        merged[key] = typeof value === 'object' && typeof base[key] === 'object' ? { ...base[key], ...value } : value;
+    }
+    return merged;
+}
+
+const compareSizes = (a, b) => a.raw - b.raw || a.brotli - b.brotli;
+
+const formatRow = (cells, widths) => cells.map((cell, i) => i === 0 ? String(cell).padEnd(widths[i]) : String(cell).padStart(widths[i])).join('  ');
+
+const printTable = (header, rows) => {
+    const widths = header.map((cell, i) => Math.max(String(cell).length, ...rows.map((row) => String(row[i]).length)));
+    console.log(formatRow(header, widths));
+    for (const row of rows) console.log(formatRow(row, widths));
+}
+
+/*
+ * The release stage: minifies each chunk with every terser variant on top of
+ * terserOptions and keeps the smallest (raw bytes, then brotli), reports the
+ * raw, gzip and brotli size of the result, attributes its bytes to the modules
+ * it came from, writes .gz and .br next to it, and fails the build past any
+ * limit of budget ({ raw, gzip, brotli }, in bytes).
+ *
+ * Minified code no longer tells which module a byte came from, so each
+ * module's share is its share of the bundle before minification. The entry
+ * says in its meta.quine.wrapperLength how much of it is the self-embedding
+ * wrapper, which is counted apart from the game code.
+ */
+export const quineSize = ({ terserOptions, terserVariants, budget = {} }) => ({
+    name: 'quine-size',
+
+    async renderChunk(code, chunk, outputOptions) {
+        // As @rollup/plugin-terser sets it, so that top-level names of an ES bundle are mangled too.
+        const baseOptions = { module: outputOptions.format === 'es', ...terserOptions };
+
+        const results = [];
+        for (const [name, variant] of Object.entries(terserVariants)) {
+            const result = await minify(code, mergeOptions(baseOptions, variant));
+            results.push({ name, code: result.code, sizes: getSizes(result.code) });
+        }
+
+        console.log(`\n${chunk.fileName}, terser variants:`);
+        printTable(['variant', 'raw', 'gzip', 'brotli'], results.map((result) => [result.name, result.sizes.raw, result.sizes.gzip, result.sizes.brotli]));
+
+        const best = results.reduce((best, result) => compareSizes(result.sizes, best.sizes) < 0 ? result : best);
+        console.log(`kept: ${best.name}`);
+        return { code: best.code, map: null };
+    },
+
+    generateBundle(outputOptions, bundle) {
+        for (const chunk of Object.values(bundle)) {
+            if (chunk.type !== 'chunk') continue;
+
+            const data = Buffer.from(chunk.code);
+            const gzip = compressSmallest('gzip', data);
+            const brotli = compressSmallest('brotli', data);
+            const sizes = { raw: data.length, gzip: gzip.data.length, brotli: brotli.data.length };
+
+            this.emitFile({ type: 'asset', fileName: `${chunk.fileName}.gz`, source: gzip.data });
+            this.emitFile({ type: 'asset', fileName: `${chunk.fileName}.br`, source: brotli.data });
+
+            console.log(`\n${chunk.fileName}: ${sizes.raw} B raw, ${sizes.gzip} B gzip (${gzip.name}), ${sizes.brotli} B brotli (${brotli.name})`);
+
+            const parts = [];
+            for (const [id, module] of Object.entries(chunk.modules)) {
+                const wrapperLength = this.getModuleInfo(id)?.meta?.quine?.wrapperLength ?? 0;
+                if (wrapperLength > 0) parts.push({ name: 'setBgText wrapper', renderedLength: wrapperLength });
+                parts.push({ name: path.relative(process.cwd(), id), renderedLength: module.renderedLength - wrapperLength });
+            }
+
+            const totalRendered = parts.reduce((total, part) => total + part.renderedLength, 0);
+            console.log('by module, as shares of the unminified bundle:');
+            printTable(['module', 'unminified', 'share', 'raw', 'gzip', 'brotli'], parts.map((part) => {
+                const share = totalRendered > 0 ? part.renderedLength / totalRendered : 0;
+                return [part.name, part.renderedLength, `${(share * 100).toFixed(1)}%`, Math.round(share * sizes.raw), Math.round(share * sizes.gzip), Math.round(share * sizes.brotli)];
+            }));
+
+            const over = Object.entries(budget).filter(([metric, limit]) => sizes[metric] > limit);
+            if (over.length > 0) {
+                this.error(`${chunk.fileName} is over its size budget: ${over.map(([metric, limit]) => `${metric} ${sizes[metric]} B > ${limit} B`).join(', ')}`);
+            }
+        }
+    },
+});
@@ -1,28 +1,44 @@
-import terser from '@rollup/plugin-terser';
+import { quineSize } from './quine-size.mjs';
 
-export default {
-    input: 'tba-input.js',
+const terserOptions = {
+    ecma: 2016,
+    compress: {
+        arguments: true,
+        booleans_as_integers: true,
+        module: true,
+        passes: 10,
+    },
+    mangle: {
+        properties: {
+            regex: /^/,
+            // Every property is mangled but those on terser's list of DOM and builtin names. These are reserved as
+            // well, as the list is not sure to hold them: the data-worker attribute, import.meta.url, a listener
+            // option and the Atomics calls of worker mode. Message keys need nothing, as the worker runs the same
+            // bundle as the page.
+            reserved: ['worker', 'url', 'passive', 'crossOriginIsolated', 'load', 'store', 'add', 'or', 'exchange']
+        }
+    }
+};
+
+// Release builds try each of these on top of terserOptions; which one wins depends on the game.
+const terserVariants = {
+    'default': {},
+    'bare-args': { format: { wrap_func_args: false } },
+    'simple-inline': { compress: { inline: 1 } },
+    'bare-args, simple-inline': { compress: { inline: 1 }, format: { wrap_func_args: false } },
+};
+
+// The dev profile leaves terser and the size stage out, so a rebuild costs a parse and a bundle; the output is bigger but behaves the same.
+export const createConfig = ({ input = 'tba-input.js', file = 'build/tba-output.js', dev = false, budget = {}, plugins = [] } = {}) => ({
+    input,
     output: {
-        file: 'build/tba-output.js',
+        file,
         inlineDynamicImports: true,
         compact: true,
         generatedCode: "es2015",
         format: 'es',
     },
-    plugins: [
-        terser({
-            ecma: 2016,
-            compress: {
-                arguments: true,
-                booleans_as_integers: true,
-                module: true,
-                passes: 10,
-            },
-            mangle: {
-                properties: {
-                    regex: /^/
-                }
-            }
-        })
-    ],
-};
\ No newline at end of file
+    plugins: dev ? plugins : [...plugins, quineSize({ terserOptions, terserVariants, budget })],
+});
+
+export default createConfig();
@@ -0,0 +1,117 @@
+import { rootElement, charsPerRow, charSizePx, charBoxSizePercent, backgroundColor, getCharIndex, measureRow } from './quine_engine_lib.js';
+
+/*
+ * Draws the layout of the DOM renderer on a 2D canvas, or returns null where
+ * there is no 2D canvas. Every distinct glyph is rasterized once into an atlas
+ * (white, then tinted per color on first use), the background text is drawn
+ * once into an offscreen canvas, and each frame only the cells recolored
+ * since the last one are redrawn.
+ */
+export const createCanvasRenderer = () => {
+    if (document.createElement('canvas').getContext('2d') === null) return null;
+
+    let canvas, context, baseCanvas, atlas;
+    let glyphIndices, tintedAtlases, chars, cellXs, cellWidths;
+    let atlasCellWidth = 0, rowHeight = 0, pixelRatio = 1;
+    let dirtyCells = new Map();
+
+    const getTintedAtlas = (color) => {
+        let tinted = tintedAtlases.get(color);
+        if (typeof tinted !== 'undefined') return tinted;
+
+        tinted = document.createElement('canvas');
+        tinted.width = atlas.width;
+        tinted.height = atlas.height;
+        const tintedContext = tinted.getContext('2d');
+        tintedContext.drawImage(atlas, 0, 0);
+        tintedContext.globalCompositeOperation = 'source-in';
+        tintedContext.fillStyle = color;
+        tintedContext.fillRect(0, 0, tinted.width, tinted.height);
+        tintedAtlases.set(color, tinted);
+        return tinted;
+    }
+
+    const drawCell = (target, idx, color) => {
+        const row = Math.floor(idx / charsPerRow);
+        const x = cellXs[idx] * pixelRatio, y = row * rowHeight * pixelRatio;
+        const w = cellWidths[idx] * pixelRatio, h = rowHeight * pixelRatio;
+        target.clearRect(x, y, w, h);
+        target.drawImage(getTintedAtlas(color), glyphIndices.get(chars[idx]) * atlasCellWidth, 0, w, h, x, y, w, h);
+    }
+
+    const mount = (newChars) => {
+        chars = newChars;
+        pixelRatio = window.devicePixelRatio || 1;
+        rootElement.innerHTML = '';
+        const rowMetrics = measureRow();
+        rowHeight = rowMetrics.height;
+
+        const font = `${charSizePx}px ${getComputedStyle(rootElement).fontFamily}`;
+        const measureContext = document.createElement('canvas').getContext('2d');
+        measureContext.font = font;
+
+        /* Flex cells grow past min-width for wide glyphs, so positions are summed per row. */
+        const minCellWidth = charSizePx * charBoxSizePercent;
+        cellXs = new Float32Array(chars.length);
+        cellWidths = new Float32Array(chars.length);
+        glyphIndices = new Map();
+        let maxCellWidth = minCellWidth, rowX = 0;
+        chars.forEach((ch, idx) => {
+            if (idx % charsPerRow === 0) {
+                rowX = 0;
+                return;
+            }
+            if (!glyphIndices.has(ch)) glyphIndices.set(ch, glyphIndices.size);
+            cellXs[idx] = rowX;
+            cellWidths[idx] = Math.max(minCellWidth, measureContext.measureText(ch).width);
+            maxCellWidth = Math.max(maxCellWidth, cellWidths[idx]);
+            rowX += cellWidths[idx];
+        });
+
+        atlasCellWidth = Math.ceil(maxCellWidth * pixelRatio);
+        atlas = document.createElement('canvas');
+        atlas.width = Math.max(1, atlasCellWidth * glyphIndices.size);
+        atlas.height = Math.max(1, Math.ceil(rowHeight * pixelRatio));
+        const atlasContext = atlas.getContext('2d');
+        atlasContext.scale(pixelRatio, pixelRatio);
+        atlasContext.font = font;
+        atlasContext.fillStyle = '#ffffff';
+        glyphIndices.forEach((glyphIdx, ch) => atlasContext.fillText(ch, glyphIdx * atlasCellWidth / pixelRatio, rowMetrics.baseline));
+        tintedAtlases = new Map();
+
+        const numRows = Math.ceil(chars.length / charsPerRow);
+        canvas = document.createElement('canvas');
+        canvas.width = Math.ceil(rootElement.clientWidth * pixelRatio);
+        canvas.height = Math.max(1, Math.ceil(numRows * rowHeight * pixelRatio));
+        canvas.style['display'] = 'block';
+        canvas.style['width'] = `${canvas.width / pixelRatio}px`;
+        canvas.style['height'] = `${canvas.height / pixelRatio}px`;
+
+        baseCanvas = document.createElement('canvas');
+        baseCanvas.width = canvas.width;
+        baseCanvas.height = canvas.height;
+        const baseContext = baseCanvas.getContext('2d');
+        chars.forEach((_, idx) => {
+            if (idx % charsPerRow !== 0) drawCell(baseContext, idx, backgroundColor);
+        });
+
+        context = canvas.getContext('2d');
+        context.drawImage(baseCanvas, 0, 0);
+        rootElement.appendChild(canvas);
+        dirtyCells = new Map();
+    }
+
+    return {
+        mount: mount,
+        /* Positions and the base canvas depend on charsPerRow throughout, so the whole canvas is laid out again. */
+        reflow: mount,
+        setCell: (x, y, color) => {
+            const idx = getCharIndex(x, y, chars.length);
+            if (idx !== -1) dirtyCells.set(idx, color);
+        },
+        flush: () => {
+            dirtyCells.forEach((color, idx) => drawCell(context, idx, color));
+            dirtyCells.clear();
+        },
+    };
+}
@@ -0,0 +1,105 @@
+import { rootElement, charsPerRow, backgroundColor, rowStyle, getCellStyle, getCharIndex, measureRow } from './quine_engine_lib.js';
+
+const escapeHtml = (ch) => ch === '<' ? '&lt;' : ch === '>' ? '&gt;' : ch === '&' ? '&amp;' : ch;
+
+/*
+ * Lays the text out as rows of one element per character, but only the rows
+ * in or near the visible part of rootElement are in the DOM: a spacer keeps
+ * the height of the whole text, and rows are added and dropped as it scrolls.
+ * Colors of cells off screen are kept and applied when their row is built.
+ */
+export const createDomRenderer = () => {
+    const overscanRows = 8;
+    let chars = [], spacer = null;
+    let numRows = 0, rowHeight = 1;
+    let rows = new Map();
+    let cellColors = new Map();
+    let isUpdatePending = false;
+
+    const getRowHtml = (row) => {
+        const end = Math.min((row + 1) * charsPerRow, chars.length);
+        let html = '';
+        for (let idx = row * charsPerRow + 1; idx < end; idx++)
+            html += `<div style="${getCellStyle(cellColors.get(idx) ?? backgroundColor)}">${escapeHtml(chars[idx])}</div>`;
+        return html;
+    }
+
+    const getVisibleRows = () => ({
+        first: Math.max(0, Math.floor(rootElement.scrollTop / rowHeight) - overscanRows),
+        last: Math.min(numRows - 1, Math.ceil((rootElement.scrollTop + rootElement.clientHeight) / rowHeight) + overscanRows),
+    });
+
+    /* Drops the rows that went off screen and builds those that came on; with rebuild, rows already built are redone too. */
+    const updateRows = (rebuild = false) => {
+        isUpdatePending = false;
+        const { first, last } = getVisibleRows();
+
+        rows.forEach((element, row) => {
+            if (row >= first && row <= last) return;
+            element.remove();
+            rows.delete(row);
+        });
+
+        for (let row = first; row <= last; row++) {
+            let element = rows.get(row);
+            if (typeof element !== 'undefined') {
+                if (rebuild) element.innerHTML = getRowHtml(row);
+                continue;
+            }
+            element = document.createElement('div');
+            element.setAttribute('style', `${rowStyle}position:absolute;left:0;top:${row * rowHeight}px;`);
+            element.innerHTML = getRowHtml(row);
+            spacer.appendChild(element);
+            rows.set(row, element);
+        }
+    }
+
+    const onScroll = () => {
+        if (isUpdatePending) return;
+        isUpdatePending = true;
+        requestAnimationFrame(() => updateRows());
+    }
+
+    const layOut = (newChars) => {
+        chars = newChars;
+        numRows = Math.ceil(chars.length / charsPerRow);
+        spacer.style['height'] = `${numRows * rowHeight}px`;
+        cellColors.clear();
+    }
+
+    return {
+        mount: (newChars) => {
+            rootElement.removeEventListener('scroll', onScroll);
+            rootElement.innerHTML = '';
+            rowHeight = Math.max(1, measureRow().height);
+
+            spacer = document.createElement('div');
+            spacer.setAttribute('style', 'position:relative;width:100%;');
+            rootElement.appendChild(spacer);
+            rows.clear();
+
+            layOut(newChars);
+            updateRows();
+            rootElement.addEventListener('scroll', onScroll, { passive: true });
+        },
+        /* Only the rows on screen are rebuilt; the rest are built from the new layout as they scroll in. */
+        reflow: (newChars) => {
+            layOut(newChars);
+            updateRows(true);
+        },
+        /* The viewport changed size but not width in characters, so no row changes, and only those coming on screen are built. */
+        updateViewport: () => updateRows(),
+        setCell: (x, y, color) => {
+            const idx = getCharIndex(x, y, chars.length);
+            if (idx === -1) return;
+
+            if (color === backgroundColor) cellColors.delete(idx);
+            else cellColors.set(idx, color);
+
+            const pixel = rows.get(Math.floor(idx / charsPerRow))?.children[idx % charsPerRow - 1];
+            if (typeof pixel !== 'undefined')
+                pixel.style['color'] = color;
+        },
+        flush: () => { },
+    };
+}
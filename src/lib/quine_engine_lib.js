@@ -2,14 +2,26 @@ let isRunning = true;
 let currentTick = 0;
 let nextTick = 0;
 let pendingTileUpdates = [];
+/* The last color given to each cell of the game grid, row by row, so the grid can be laid out again after a reflow. */
+let gridColors = [];
 
 let config = {
     ticksPerSecond: 60,
     skipTicks: 16,
+    maxCatchupTicks: 4,
     windowWidth: 0,
     windowHeight: 0,
 }
 
+const numFrameStatSamples = 240;
+let frameStats = {
+    frameMs: new Float64Array(numFrameStatSamples),
+    tickMs: new Float64Array(numFrameStatSamples),
+    numFrames: 0,
+    numTicks: 0,
+    numDroppedTicks: 0,
+}
+
 let rootId = 'game';
 let rootElement;
 
@@ -25,52 +37,194 @@ let afterRun = () => { }
 
 let onGameTick = () => { }
 let onFrameRender = () => {
+    const offsetX = getGridOffsetX();
     while (pendingTileUpdates.length > 0) {
         const change = pendingTileUpdates.shift();
-        setPixel(change.x, change.y, change.color);
+        setPixel(change.x + offsetX, change.y, change.color);
     }
 }
 
 let onWindowResize = () => { }
 
+/*
+ * What follows up to the tick loop is shared with the renderer modules
+ * (quine_engine_canvas.js, quine_engine_dom.js) and with worker mode
+ * (quine_engine_worker.js). A game imports only the ones it uses, so the
+ * rest stay out of its bundle; games themselves do not need these exports.
+ */
+export { rootElement, charsPerRow, charSizePx, charBoxSizePercent, backgroundColor, config, frameStats, numFrameStatSamples, gridColors, renderer };
+
+export const rowStyle = 'width:100%;display:flex;flex-wrap:nowrap;';
+export const getCellStyle = (color) => `color: ${color}; font-size:${charSizePx}px; min-width: ${charBoxSizePercent}em; min-height: ${charBoxSizePercent}em;user-select:none;`;
+
+/*
+ * The grid is centered on the background text, whose rows lose their first
+ * character to the row break. Where nothing is rendered, as in a game worker,
+ * the grid is drawn in its own coordinates and placing it is left to the page.
+ */
+export const getGridOffsetX = () => renderer === null ? 0 : Math.floor((charsPerRow - config.windowWidth) / 2) - 1;
+
+const getCharsPerRow = () => Math.floor(rootElement.offsetWidth / (charSizePx * charBoxSizePercent));
+
+/* The index in chars of the cell at x, y, or -1 past the end of its row or of the text. */
+export const getCharIndex = (x, y, numChars) => {
+    const idx = y * charsPerRow + 1 + x;
+    return x >= 0 && y >= 0 && x < charsPerRow - 1 && idx < numChars ? idx : -1;
+}
+
+/* Row height and baseline are taken from a probe row, so they match the DOM layout exactly. */
+export const measureRow = () => {
+    const row = document.createElement('div');
+    row.setAttribute('style', rowStyle);
+    row.innerHTML = `<div style="${getCellStyle(backgroundColor)}">M<span style="display:inline-block;width:0;height:0;"></span></div>`;
+    rootElement.appendChild(row);
+    const rowRect = row.getBoundingClientRect();
+    const baseline = row.getElementsByTagName('span')[0].getBoundingClientRect().top - rowRect.top;
+    rootElement.removeChild(row);
+    return { height: rowRect.height, baseline: baseline };
+}
+
+/*
+ * A renderer owns what is inside rootElement. mount() lays out the background
+ * text (every character that starts a row is dropped, as the row break takes
+ * its place), reflow() lays the same text out again once charsPerRow has
+ * changed, setCell() recolors one cell and flush() is called once per frame,
+ * after onFrameRender. Both mount() and reflow() leave every cell in the
+ * background color. The game picks its renderers with setRenderer; a factory
+ * returns null where its renderer cannot draw, and the next one is tried.
+ */
+let renderer = null;
+let rendererFactories = [];
+
+const getBgChars = () => bgText.split("").filter(ch => ch !== ' ');
+
+/* Puts the retained game grid back on a freshly laid out background, at the current offset. */
+const reapplyGrid = () => {
+    const offsetX = getGridOffsetX();
+    gridColors.forEach((color, idx) => renderer.setCell(idx % config.windowWidth + offsetX, Math.floor(idx / config.windowWidth), color));
+}
+
 const renderBackground = () => {
     rootElement = document.getElementById(rootId);
-    charsPerRow = Math.floor(rootElement.offsetWidth / (charSizePx * charBoxSizePercent));
+    charsPerRow = getCharsPerRow();
 
-    if(bgText.length < 1) {
+    renderer ??= rendererFactories.reduce((found, createRenderer) => found ?? createRenderer(), null);
+    if(bgText.length < 1 || renderer === null) {
         rootElement.innerHTML = '';
         return;
     }
-    const res = '<div style="width:100%;display:flex;flex-wrap:nowrap;">' + bgText.split("").filter(ch => ch !== ' ').map((ch, idx) => {
-        if (idx % charsPerRow === 0) return `</div><div style="width:100%;display:flex;flex-wrap:nowrap;">`
-        else return `<div style="color: ${backgroundColor}; font-size:${charSizePx}px; min-width: ${charBoxSizePercent}em; min-height: ${charBoxSizePercent}em;user-select:none;">${ch}</div>`
-    }).join("") + '</div>';
 
-    rootElement.innerHTML = res;
     rootElement.style['font-size'] = `${charSizePx}px`;
     rootElement.style['overflow-x'] = 'hidden';
     rootElement.style['overflow-y'] = 'auto';
-    rootElement.removeChild(rootElement.children[0]);
+    renderer.mount(getBgChars());
+    reapplyGrid();
 }
 
-const run = async () => {
+/*
+ * Runs once a resize has settled. A resize that keeps the width in characters
+ * changes no row, so the layout is kept; otherwise the renderer lays the text
+ * out again and the game grid is put back from gridColors, so the game does
+ * not have to submit it again.
+ */
+const reflowBackground = () => {
+    if (renderer === null || bgText.length < 1) return;
+
+    const newCharsPerRow = getCharsPerRow();
+    if (newCharsPerRow === charsPerRow) {
+        renderer.updateViewport?.();
+        return;
+    }
+
+    charsPerRow = newCharsPerRow;
+    renderer.reflow(getBgChars());
+    reapplyGrid();
+    onWindowResize();
+}
+
+const resizeDebounceMs = 150;
+let resizeTimeout = null;
+let isResizeListenerAdded = false;
+
+const onResize = () => {
+    clearTimeout(resizeTimeout);
+    resizeTimeout = setTimeout(reflowBackground, resizeDebounceMs);
+}
+
+/*
+ * Set by a module that runs the game loop somewhere else than on the page,
+ * i.e. quine_engine_worker.js. start(showBackground, runGame) replaces
+ * start(), requestFrame(callback) schedules the loop's frames, setPixel()
+ * replaces drawing and sendInput(event) replaces running a keybinding's
+ * action, where event is list << 16 | index of the keybinding.
+ */
+let runner = null;
+let keybindingLists = [];
+
+/* Runs the action of a keybinding sent as list << 16 | index, as both sides of a runner make the same setKeybindings calls. */
+export const applyInput = (event) => keybindingLists[event >> 16]?.[event & 0xffff]?.action();
+
+export const setRunner = (newRunner) => { runner = newRunner; }
+
+const getPercentiles = (samples, count) => {
+    const sorted = samples.slice(0, Math.min(count, samples.length)).sort();
+    const at = (p) => sorted.length > 0 ? sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))] : 0;
+    return { p50: at(0.5), p90: at(0.9), p99: at(0.99), max: at(1) };
+}
+
+/*
+ * Game ticks run on a fixed timestep of skipTicks / ticksPerSecond seconds,
+ * fed by the real time between display frames. onGameTick sees currentTick
+ * set to the tick it was scheduled for, so game speed does not depend on the
+ * display rate or on render cost. At most maxCatchupTicks ticks run per frame;
+ * the rest of a long stall (e.g. a background tab) is dropped.
+ */
+const run = () => {
     beforeRun();
 
-    let sleepTime = 0;
-    isRunning = true;
-    while (isRunning) {
-        currentTick++;
-        while (currentTick > nextTick) {
+    const tickMs = config.skipTicks * 1000 / config.ticksPerSecond;
+    const requestFrame = runner?.requestFrame ?? requestAnimationFrame;
+    let accumulatorMs = tickMs;
+    let lastFrameTime = -1;
+
+    const onFrame = (now) => {
+        if (!isRunning) {
+            afterRun();
+            return;
+        }
+
+        if (lastFrameTime >= 0) {
+            frameStats.frameMs[frameStats.numFrames++ % numFrameStatSamples] = now - lastFrameTime;
+            accumulatorMs += now - lastFrameTime;
+        }
+        lastFrameTime = now;
+
+        let numCatchupTicks = 0;
+        while (accumulatorMs >= tickMs && numCatchupTicks < config.maxCatchupTicks && isRunning) {
+            currentTick = nextTick;
+            const tickStart = performance.now();
             onGameTick();
+            frameStats.tickMs[frameStats.numTicks++ % numFrameStatSamples] = performance.now() - tickStart;
+
             nextTick += config.skipTicks;
+            accumulatorMs -= tickMs;
+            numCatchupTicks++;
+        }
+
+        if (accumulatorMs >= tickMs) {
+            const numDroppedTicks = Math.floor(accumulatorMs / tickMs);
+            frameStats.numDroppedTicks += numDroppedTicks;
+            nextTick += numDroppedTicks * config.skipTicks;
+            accumulatorMs -= numDroppedTicks * tickMs;
         }
+
         onFrameRender();
-        sleepTime = nextTick - currentTick;
-        if (sleepTime >= 0)
-            await new Promise(r => setTimeout(r, sleepTime));
+        renderer?.flush();
+        requestFrame(onFrame);
     }
 
-    afterRun();
+    isRunning = true;
+    requestFrame(onFrame);
 }
 
 export const setBgText = (newBgText) => { bgText = newBgText; }
@@ -93,26 +247,46 @@ export const setAfterRun = (newAfterRun) => { afterRun = newAfterRun; }
 export const setOnGameTick = (newOnGameTick) => { onGameTick = newOnGameTick; }
 
 export const setOnFrameRender = (newOnFrameRender) => { onFrameRender = newOnFrameRender; }
+/* In worker mode x and y are grid coordinates, as the worker does not know where the page puts the grid. */
 export const setPixel = (x, y, color) => {
-    const pixel = rootElement.children[y]?.children[x];
-    if(typeof pixel !== 'undefined')
-        pixel.style['color'] = color;
+    if (runner?.setPixel) runner.setPixel(x, y, color);
+    else renderer?.setCell(x, y, color);
 }
 
+/*
+ * Renderer factories in order of preference, e.g. createCanvasRenderer from
+ * quine_engine_canvas.js, then createDomRenderer from quine_engine_dom.js as
+ * a fallback without 2D canvas support; call before start().
+ */
+export const setRenderer = (...newRendererFactories) => { rendererFactories = newRendererFactories; renderer = null; }
+
 export const setOnWindowResize = (newOnWindowResize) => { onWindowResize = newOnWindowResize; }
 
 export const getCurrentGameTick = () => { return currentTick; }
 
 export const getTicksPerSecond = () => { return config.ticksPerSecond; }
 
+/* Percentiles (ms) over the last numFrameStatSamples display frames and game ticks. */
+export const getFrameStats = () => {
+    return {
+        frameMs: getPercentiles(frameStats.frameMs, frameStats.numFrames),
+        tickMs: getPercentiles(frameStats.tickMs, frameStats.numTicks),
+        numFrames: frameStats.numFrames,
+        numTicks: frameStats.numTicks,
+        numDroppedTicks: frameStats.numDroppedTicks,
+    };
+}
+
 export const getWindowDimensions = () => { return { windowWidth: config.windowWidth, windowHeight: config.windowHeight }; }
 
 export const initConfig = (newConfig) => {
     config = { ...config, ...newConfig };
 };
 
+/* x and y are in game grid coordinates; the grid is placed on the background when the frame is drawn. */
 export const renderAtPos = (x, y, color) => {
-    x += Math.floor((charsPerRow - config.windowWidth) / 2) - 1;
+    if (gridColors.length !== config.windowWidth * config.windowHeight) gridColors = new Array(config.windowWidth * config.windowHeight);
+    if (x >= 0 && y >= 0 && x < config.windowWidth && y < config.windowHeight) gridColors[y * config.windowWidth + x] = color;
     pendingTileUpdates.push({ x: x, y: y, color: color })
 }
 
@@ -121,25 +295,42 @@ export const clearPendingFrameChanges = () => {
 }
 
 export const setKeybindings = (keybindings) => {
+    const listIdx = keybindingLists.length;
+    keybindingLists.push(keybindings);
+    if (typeof window === 'undefined') return;
+
     window.addEventListener('keypress', (e) => {
         e = e.key.toLocaleLowerCase();
-        keybindings.forEach(keybinding => {
+        keybindings.forEach((keybinding, idx) => {
             if (keybinding.key === e) {
-                keybinding.action();
+                if (runner?.sendInput) runner.sendInput(listIdx << 16 | idx);
+                else keybinding.action();
             }
         });
     }, false);
 }
 
-export const start = () => {
-    window.addEventListener("resize", (_) => {
-        let windowWidth = rootElement.offsetWidth;
-        charsPerRow = Math.floor(windowWidth / (charSizePx * charBoxSizePercent));
-        renderBackground();
-        onWindowResize();
-    });
+/* A restart lays out a clean background, as the new game draws its grid from scratch. */
+const showBackground = () => {
+    if (!isResizeListenerAdded) {
+        window.addEventListener("resize", onResize);
+        isResizeListenerAdded = true;
+    }
 
+    gridColors = [];
     renderBackground();
+}
+
+const runGame = () => {
     init();
     run();
+}
+
+export const start = () => {
+    if (runner !== null) {
+        runner.start(showBackground, runGame);
+        return;
+    }
+    showBackground();
+    runGame();
 }
\ No newline at end of file
@@ -0,0 +1,239 @@
+import { rootElement, config, frameStats, numFrameStatSamples, gridColors, renderer, getGridOffsetX, applyInput, setRunner, start } from './quine_engine_lib.js';
+
+/*
+ * Worker mode, for games that call useWorkerMode() and pages that opt in
+ * with a data-worker attribute on the root element and are cross-origin
+ * isolated (SharedArrayBuffer needs it). The page loads the game into a
+ * module Worker as well, where the same lib.* calls drive the tick loop; the
+ * page itself only lays out the background, draws the grid and forwards
+ * input. Without isolation the game runs on the page as usual.
+ *
+ * The two share one buffer: a header, the tick times of the last
+ * numFrameStatSamples ticks, a ring of input events, a dirty bit per grid row
+ * and one color index per grid cell. The worker writes cells and then their
+ * row's bit, and bumps seq once per frame; the page skips frames whose seq it
+ * has seen, and otherwise takes the dirty rows and redraws the cells of them
+ * that changed. Color strings cannot be shared, so the worker numbers them
+ * and posts each new one; a cell whose color has not arrived yet stays dirty
+ * for the next frame. When the game restarts, the worker clears the cells and
+ * posts a restart, and the page lays out a clean background and redraws every
+ * cell drawn since.
+ *
+ * An input event is the index of a keybinding (list << 16 | index, as both
+ * sides make the same setKeybindings calls). The page writes it to the ring
+ * and posts a nudge, so the worker also sees input while its loop is stopped.
+ * The game script may write to page elements through document.getElementById,
+ * which the worker forwards to the page.
+ */
+const isWorker = typeof WorkerGlobalScope !== 'undefined' && self instanceof WorkerGlobalScope;
+
+const sharedHeaderSlots = { seq: 0, inputWrite: 1, inputRead: 2, numTicks: 3, numDroppedTicks: 4 };
+/* Even, so the tick times after the header are 8-byte aligned. */
+const sharedHeaderLength = 6;
+const inputRingSize = 64;
+
+let shared = null;
+let gameWorker = null;
+let isStartPending = false;
+let hasGameStarted = false;
+let colorIndices = new Map();
+let palette = [];
+let showCleanBackground = null;
+
+const createShared = (buffer) => {
+    const numCells = config.windowWidth * config.windowHeight;
+    const numDirtyWords = Math.ceil(config.windowHeight / 32);
+    const intsOffset = sharedHeaderLength * 4 + numFrameStatSamples * 8;
+    buffer ??= new SharedArrayBuffer(intsOffset + (inputRingSize + numDirtyWords + numCells) * 4);
+    return {
+        buffer: buffer,
+        header: new Int32Array(buffer, 0, sharedHeaderLength),
+        tickMs: new Float64Array(buffer, sharedHeaderLength * 4, numFrameStatSamples),
+        input: new Int32Array(buffer, intsOffset, inputRingSize),
+        dirtyRows: new Int32Array(buffer, intsOffset + inputRingSize * 4, numDirtyWords),
+        cells: new Int32Array(buffer, intsOffset + (inputRingSize + numDirtyWords) * 4, numCells),
+        lastSeq: -1,
+    };
+}
+
+/* Worker side: a cell holds its color index plus one, so 0 is a cell never drawn. */
+const writeSharedCell = (x, y, color) => {
+    if (x < 0 || y < 0 || x >= config.windowWidth || y >= config.windowHeight) return;
+
+    let colorIdx = colorIndices.get(color);
+    if (typeof colorIdx === 'undefined') {
+        colorIdx = colorIndices.size;
+        colorIndices.set(color, colorIdx);
+        postMessage({ type: 'color', index: colorIdx, color: color });
+    }
+    Atomics.store(shared.cells, y * config.windowWidth + x, colorIdx + 1);
+    Atomics.or(shared.dirtyRows, y >> 5, 1 << (y & 31));
+}
+
+const drainSharedInput = () => {
+    let read = Atomics.load(shared.header, sharedHeaderSlots.inputRead);
+    const write = Atomics.load(shared.header, sharedHeaderSlots.inputWrite);
+    while (read !== write) {
+        const event = shared.input[read];
+        read = (read + 1) % inputRingSize;
+        Atomics.store(shared.header, sharedHeaderSlots.inputRead, read);
+        applyInput(event);
+    }
+}
+
+/* A worker has no display frames, so it wakes once per tick, and takes the input that came in first. */
+const requestWorkerFrame = (callback) => {
+    Atomics.store(shared.header, sharedHeaderSlots.numTicks, frameStats.numTicks);
+    Atomics.store(shared.header, sharedHeaderSlots.numDroppedTicks, frameStats.numDroppedTicks);
+    Atomics.add(shared.header, sharedHeaderSlots.seq, 1);
+    setTimeout(() => {
+        drainSharedInput();
+        callback(performance.now());
+    }, config.skipTicks * 1000 / config.ticksPerSecond);
+}
+
+const workerRunner = {
+    start: (_, runGame) => {
+        isStartPending = shared === null;
+        if (isStartPending) return;
+
+        if (hasGameStarted) {
+            shared.cells.fill(0);
+            postMessage({ type: 'restart' });
+        }
+        hasGameStarted = true;
+        runGame();
+    },
+    requestFrame: requestWorkerFrame,
+    setPixel: writeSharedCell,
+}
+
+/* Page side: an event that finds the ring full is dropped. */
+const postSharedInput = (event) => {
+    const write = Atomics.load(shared.header, sharedHeaderSlots.inputWrite);
+    const next = (write + 1) % inputRingSize;
+    if (next === Atomics.load(shared.header, sharedHeaderSlots.inputRead)) return;
+
+    shared.input[write] = event;
+    Atomics.store(shared.header, sharedHeaderSlots.inputWrite, next);
+    gameWorker.postMessage({ type: 'input' });
+}
+
+const markAllRowsDirty = () => {
+    for (let word = 0; word < shared.dirtyRows.length; word++) {
+        const numRows = Math.min(32, config.windowHeight - word * 32);
+        Atomics.or(shared.dirtyRows, word, numRows === 32 ? -1 : (1 << numRows) - 1);
+    }
+    shared.lastSeq = -1;
+}
+
+const flushSharedGrid = () => {
+    const seq = Atomics.load(shared.header, sharedHeaderSlots.seq);
+    if (seq === shared.lastSeq) return;
+    shared.lastSeq = seq;
+
+    const offsetX = getGridOffsetX();
+    for (let word = 0; word < shared.dirtyRows.length; word++) {
+        let rowBits = Atomics.exchange(shared.dirtyRows, word, 0);
+        while (rowBits !== 0) {
+            const bit = 31 - Math.clz32(rowBits & -rowBits);
+            rowBits &= rowBits - 1;
+
+            const y = word * 32 + bit;
+            for (let x = 0; x < config.windowWidth; x++) {
+                const cell = y * config.windowWidth + x;
+                const colorIdx = Atomics.load(shared.cells, cell);
+                if (colorIdx === 0) continue;
+
+                const color = palette[colorIdx - 1];
+                if (typeof color === 'undefined') {
+                    Atomics.or(shared.dirtyRows, word, 1 << bit);
+                    shared.lastSeq = -1;
+                    continue;
+                }
+                if (gridColors[cell] === color) continue;
+
+                gridColors[cell] = color;
+                renderer?.setCell(x + offsetX, y, color);
+            }
+        }
+    }
+}
+
+/* The page's tick stats are the worker's, which it publishes once per frame. */
+const startWorker = () => {
+    shared = createShared();
+    frameStats.tickMs = shared.tickMs;
+
+    gameWorker = new Worker(import.meta.url, { type: 'module' });
+    gameWorker.addEventListener('message', (e) => {
+        if (e.data.type === 'color') palette[e.data.index] = e.data.color;
+        else if (e.data.type === 'restart') {
+            showCleanBackground();
+            markAllRowsDirty();
+        }
+        else if (e.data.type === 'element') {
+            const element = document.getElementById(e.data.id);
+            if (element !== null) element[e.data.property] = e.data.value;
+        }
+    });
+    gameWorker.addEventListener('error', (e) => console.error('Error in game worker:', e.message));
+    gameWorker.postMessage({ type: 'init', buffer: shared.buffer });
+
+    let lastFrameTime = -1;
+    const onFrame = (now) => {
+        if (lastFrameTime >= 0) frameStats.frameMs[frameStats.numFrames++ % numFrameStatSamples] = now - lastFrameTime;
+        lastFrameTime = now;
+        frameStats.numTicks = Atomics.load(shared.header, sharedHeaderSlots.numTicks);
+        frameStats.numDroppedTicks = Atomics.load(shared.header, sharedHeaderSlots.numDroppedTicks);
+
+        flushSharedGrid();
+        renderer?.flush();
+        requestAnimationFrame(onFrame);
+    }
+    requestAnimationFrame(onFrame);
+}
+
+/* Without opt-in or isolation the page drops the runner, so the game runs on it as if worker mode was never asked for. */
+const pageRunner = {
+    start: (showBackground, runGame) => {
+        if (gameWorker !== null) return;
+
+        showCleanBackground = showBackground;
+        showBackground();
+        if (typeof rootElement.dataset.worker !== 'undefined' && globalThis.crossOriginIsolated && typeof SharedArrayBuffer !== 'undefined') {
+            startWorker();
+            return;
+        }
+        setRunner(null);
+        runGame();
+    },
+    sendInput: postSharedInput,
+}
+
+/* Call before any other lib call that draws or starts the game; see above. */
+export const useWorkerMode = () => {
+    if (!isWorker) {
+        setRunner(pageRunner);
+        return;
+    }
+
+    globalThis.document ??= {
+        getElementById: (id) => new Proxy({}, {
+            set: (_, property, value) => {
+                postMessage({ type: 'element', id: id, property: property, value: value });
+                return true;
+            },
+        }),
+    };
+
+    addEventListener('message', (e) => {
+        if (e.data.type === 'init') {
+            shared = createShared(e.data.buffer);
+            frameStats.tickMs = shared.tickMs;
+            if (isStartPending) start();
+        }
+        else if (e.data.type === 'input' && shared !== null) drainSharedInput();
+    });
+    setRunner(workerRunner);
+}